@@ -128,38 +128,46 @@ void QGeoCodeReplyTomTom::onNetworkReplyFinished()
     if (reply->error() != QNetworkReply::NoError)
         return;
 
-    QList<QGeoLocation> locations;
-    QJsonDocument document = QJsonDocument::fromJson(reply->readAll());
-    if (Q_UNLIKELY(!document.isObject())) {
-        setError(ParseError, tr("Response parse error"));
-        return;
-    }
-
-    const QVariantMap response = document.object().toVariantMap();
-    const QVariantMap summary = response.value(QLatin1String("summary")).toMap();
-
-    const bool reverse = response.contains(QLatin1String("addresses"));
-    QVariantList results;
-    if (reverse) {
-        results = response.value(QLatin1String("addresses")).toList();
-        parseReverseGeocodeResult(locations, results);
-    } else {
-        results = response.value(QLatin1String("results")).toList();
-        parseGeocodeResult(locations, results);
-    }
-    //const int totalResults = summary.value(QLatin1String("totalResults")).toInt();
-
-//    QGeoCodeReplyTomTomPrivate *replyPrivate
-//            = static_cast<QGeoCodeReplyTomTomPrivate *>(QGeoCodeReplyPrivate::get(*this));
-//    const QGeoShape &bounds = replyPrivate->m_bounds;
-//    if (bounds.isValid()) {
-//        // Sort
-//    }
-
-    qDebug() << document;
+    const QByteArray payload = reply->readAll();
+    QTomTomCommon::parseInBackground(this, [this, payload]() -> std::function<void()> {
+        QList<QGeoLocation> locations;
+        QJsonDocument document = QJsonDocument::fromJson(payload);
+        if (Q_UNLIKELY(!document.isObject())) {
+            return [this]() {
+                setError(ParseError, tr("Response parse error"));
+            };
+        }
 
-    setLocations(locations);
-    setFinished(true);
+        const QVariantMap response = document.object().toVariantMap();
+        const QVariantMap summary = response.value(QLatin1String("summary")).toMap();
+
+        const bool reverse = response.contains(QLatin1String("addresses"));
+        QVariantList results;
+        if (reverse) {
+            results = response.value(QLatin1String("addresses")).toList();
+            parseReverseGeocodeResult(locations, results);
+        } else {
+            results = response.value(QLatin1String("results")).toList();
+            parseGeocodeResult(locations, results);
+        }
+        //const int totalResults = summary.value(QLatin1String("totalResults")).toInt();
+
+//        QGeoCodeReplyTomTomPrivate *replyPrivate
+//                = static_cast<QGeoCodeReplyTomTomPrivate *>(QGeoCodeReplyPrivate::get(*this));
+//        const QGeoShape &bounds = replyPrivate->m_bounds;
+//        if (bounds.isValid()) {
+//            // Sort
+//        }
+
+        qDebug() << document;
+
+        return [this, locations]() {
+            if (isFinished())
+                return;
+            setLocations(locations);
+            setFinished(true);
+        };
+    });
 }
 
 void QGeoCodeReplyTomTom::onNetworkReplyError(QNetworkReply::NetworkError error)
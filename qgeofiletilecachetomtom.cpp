@@ -19,20 +19,1285 @@
 ****************************************************************************/
 
 #include "qgeofiletilecachetomtom.h"
+#include "qgeomapreplytomtom.h"
+#include "qgeotileevictionpolicytomtom.h"
+#include "qgeotilearchivetomtom.h"
+#include <QtPositioning/QGeoRectangle>
+#include <QtCore/qmath.h>
 #include <QtLocation/private/qgeotilespec_p.h>
 #include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QRandomGenerator>
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QImage>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QPointer>
+#include <QRunnable>
+#include <limits>
+#ifdef Q_OS_UNIX
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#endif
 
 QT_BEGIN_NAMESPACE
 
+static const int staleTilesInterval = 2000; // ms between two eviction rounds
+static const int staleTilesBatch = 64; // max tiles evicted per round
+
+static const int handoffSize = 64;
+
+static const int journalInterval = 1000; // ms between two journal syncs
+static const int journalLockTimeout = 50; // ms, the sync is retried on the next round
+static const qint64 journalCompactSize = 1024 * 1024;
+static const char journalMagic[] = "TomTomJournal";
+static const int sharedWriteDelay = 100; // ms, so that other processes see new tiles soon
+static const int partialMaxAge = 60; // s, older partial files in shared mode are leftovers
+
+class QGeoTileReadTaskTomTom : public QRunnable
+{
+public:
+    QGeoTileReadTaskTomTom(QGeoFileTileCacheTomTom *cache, const QGeoTileSpec &spec,
+                           const QString &filename, QGeoMapReplyTomTom *reply)
+        : m_cache(cache), m_spec(spec), m_filename(filename), m_reply(reply)
+    {
+    }
+
+    QGeoTileReadTaskTomTom(QGeoFileTileCacheTomTom *cache, const QGeoTileSpec &spec,
+                           const QSharedPointer<QGeoTileArchiveTomTom> &archive, QGeoMapReplyTomTom *reply)
+        : m_cache(cache), m_spec(spec), m_archive(archive), m_reply(reply)
+    {
+    }
+
+    // Reads a tile that may have been published by another process, and is not registered yet.
+    QGeoTileReadTaskTomTom(QGeoFileTileCacheTomTom *cache, const QGeoTileSpec &spec,
+                           const QString &filename, QGeoMapReplyTomTom *reply, int priority)
+        : m_cache(cache), m_spec(spec), m_filename(filename), m_reply(reply), m_adopt(true), m_priority(priority)
+    {
+    }
+
+    void run() override
+    {
+        QByteArray bytes;
+        if (m_archive) {
+            bytes = m_archive->tile(m_spec); // also verifies it, on first access
+        } else {
+            QFile file(m_filename);
+            if (file.open(QIODevice::ReadOnly))
+                bytes = file.readAll();
+        }
+
+        // The reply may go away at any time, so it is only dereferenced back in the cache thread.
+        // The cache itself outlives the task, as it waits for the pool on destruction.
+        QGeoFileTileCacheTomTom *cache = m_cache;
+        const QGeoTileSpec spec = m_spec;
+        const QPointer<QGeoMapReplyTomTom> reply = m_reply;
+        if (m_adopt) {
+            const QString filename = m_filename;
+            const int priority = m_priority;
+            QMetaObject::invokeMethod(cache, [cache, spec, filename, bytes, reply, priority]() {
+                cache->tileAdopted(spec, filename, bytes, reply.data(), priority);
+            }, Qt::QueuedConnection);
+            return;
+        }
+        QMetaObject::invokeMethod(cache, [cache, spec, bytes, reply]() {
+            cache->tileRead(spec, bytes, reply.data());
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    QGeoFileTileCacheTomTom *m_cache;
+    QGeoTileSpec m_spec;
+    QString m_filename;
+    QSharedPointer<QGeoTileArchiveTomTom> m_archive;
+    QPointer<QGeoMapReplyTomTom> m_reply;
+    bool m_adopt = false;
+    int m_priority = 0;
+};
+
+static const QLatin1String partialSuffix(".part");
+
+/*
+    Temporary files are named after their target, the writing process and a counter,
+    as "<target>.<pid>.<n>.part", so that no two writers ever share one, not even
+    across the processes of a shared cache.
+*/
+static QString partialName(const QString &filename)
+{
+    static QAtomicInteger<quint32> counter;
+    return filename + QLatin1Char('.') + QString::number(QCoreApplication::applicationPid())
+            + QLatin1Char('.') + QString::number(counter.fetchAndAddRelaxed(1)) + partialSuffix;
+}
+
+#ifdef Q_OS_UNIX
+// The process that wrote a temporary file named by partialName(), or 0 if unknown.
+static qint64 partialOwner(const QString &name)
+{
+    const QStringList parts = name.split(QLatin1Char('.'));
+    if (parts.size() < 4)
+        return 0;
+    bool ok = false;
+    const qint64 pid = parts.at(parts.size() - 3).toLongLong(&ok);
+    return ok ? pid : 0;
+}
+#endif
+
+static bool renameOver(const QString &from, const QString &to)
+{
+#ifdef Q_OS_UNIX
+    return ::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+#else
+    QFile::remove(to);
+    return QFile::rename(from, to);
+#endif
+}
+
+/*
+    Writes one batch of tiles. In crash safe mode tiles are first written to temporary
+    files, synced once for the whole batch and then atomically renamed into place, so that
+    a tile file is either complete or absent.
+*/
+class QGeoTileWriteTaskTomTom : public QRunnable
+{
+public:
+    QGeoTileWriteTaskTomTom(QGeoFileTileCacheTomTom *cache, const QVector<QGeoFileTileCacheTomTom::PendingWrite> &batch,
+                            const QString &directory, bool crashSafe)
+        : m_cache(cache), m_batch(batch), m_directory(directory), m_crashSafe(crashSafe)
+    {
+    }
+
+    void run() override
+    {
+        QVector<QGeoFileTileCacheTomTom::PendingWrite> written;
+        QVector<QGeoFileTileCacheTomTom::PendingWrite> staged;
+        QStringList partials;
+        for (const QGeoFileTileCacheTomTom::PendingWrite &w : qAsConst(m_batch)) {
+            const QString target = m_crashSafe ? partialName(w.filename) : w.filename;
+            QFile file(target);
+            if (!file.open(QIODevice::WriteOnly) || file.write(w.bytes) != w.bytes.size()) {
+                qWarning() << "QGeoFileTileCacheTomTom: unable to write" << target;
+                file.remove();
+                continue;
+            }
+#if defined(Q_OS_UNIX) && !defined(Q_OS_LINUX)
+            if (m_crashSafe) {
+                file.flush();
+                ::fsync(file.handle());
+            }
+#endif
+            file.close();
+            if (m_crashSafe) {
+                staged.append(w);
+                partials.append(target);
+            } else {
+                written.append(w);
+            }
+        }
+
+        if (m_crashSafe) {
+#ifdef Q_OS_LINUX
+            // One sync for the whole batch, instead of one per tile.
+            const int dirFd = ::open(QFile::encodeName(m_directory).constData(), O_RDONLY);
+            if (dirFd >= 0) {
+                ::syncfs(dirFd);
+                ::close(dirFd);
+            }
+#endif
+            for (int i = 0; i < staged.size(); ++i) {
+                if (renameOver(partials.at(i), staged.at(i).filename))
+                    written.append(staged.at(i));
+                else
+                    QFile::remove(partials.at(i));
+            }
+        }
+
+        QGeoFileTileCacheTomTom *cache = m_cache;
+        QMetaObject::invokeMethod(cache, [cache, written]() {
+            cache->tilesWritten(written);
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    QGeoFileTileCacheTomTom *m_cache;
+    QVector<QGeoFileTileCacheTomTom::PendingWrite> m_batch;
+    QString m_directory;
+    bool m_crashSafe;
+};
+
+static const int importBatch = 256; // tiles registered at once
+
+/*
+    Unpacks the tiles of an archive into the cache directory, each published by rename.
+*/
+class QGeoTileImportTaskTomTom : public QRunnable
+{
+public:
+    QGeoTileImportTaskTomTom(QGeoFileTileCacheTomTom *cache, const QSharedPointer<QGeoTileArchiveTomTom> &archive,
+                             const QVector<QGeoTileArchiveTomTom::Tile> &tiles)
+        : m_cache(cache), m_archive(archive), m_tiles(tiles)
+    {
+    }
+
+    void run() override
+    {
+        QVector<QGeoTileSpec> specs;
+        QStringList filenames;
+        for (const QGeoTileArchiveTomTom::Tile &t : qAsConst(m_tiles)) {
+            const QByteArray bytes = m_archive->tile(t.spec);
+            if (bytes.isEmpty())
+                continue;
+            const QString partial = partialName(t.filename);
+            QFile out(partial);
+            if (!out.open(QIODevice::WriteOnly) || out.write(bytes) != bytes.size()) {
+                out.remove();
+                continue;
+            }
+            out.close();
+            if (!renameOver(partial, t.filename)) {
+                QFile::remove(partial);
+                continue;
+            }
+            specs.append(t.spec);
+            filenames.append(t.filename);
+            if (specs.size() == importBatch) {
+                report(specs, filenames);
+                specs.clear();
+                filenames.clear();
+            }
+        }
+        report(specs, filenames);
+    }
+
+private:
+    void report(const QVector<QGeoTileSpec> &specs, const QStringList &filenames)
+    {
+        if (specs.isEmpty())
+            return;
+        QGeoFileTileCacheTomTom *cache = m_cache;
+        QMetaObject::invokeMethod(cache, [cache, specs, filenames]() {
+            cache->tilesImported(specs, filenames);
+        }, Qt::QueuedConnection);
+    }
+
+    QGeoFileTileCacheTomTom *m_cache;
+    QSharedPointer<QGeoTileArchiveTomTom> m_archive;
+    QVector<QGeoTileArchiveTomTom::Tile> m_tiles;
+};
+
+static const int recompressInterval = 10000; // ms
+static const int recompressBatch = 4; // tiles per idle round
+static const char recompressedKey[] = "TomTomCache";
+static const char recompressedValue[] = "recompressed";
+static const int recompressKeptSlack = 1024; // stale names tolerated in the kept list
+
+/*
+    Re-encodes a cached PNG tile with maximum deflate, reducing it to a palette when it
+    has no more than 256 colors. In lossy mode images with more colors get quantized too,
+    which only suits imagery: antialiased vector styles would show the dithering.
+    Tiles are marked with a text chunk so that they are not processed again, those that
+    would not shrink are reported as kept and recorded by the cache instead.
+*/
+class QGeoTileRecompressTaskTomTom : public QRunnable
+{
+public:
+    QGeoTileRecompressTaskTomTom(QGeoFileTileCacheTomTom *cache, const QGeoTileSpec &spec,
+                                 const QString &filename, bool lossy)
+        : m_cache(cache), m_spec(spec), m_filename(filename), m_lossy(lossy)
+    {
+    }
+
+    void run() override
+    {
+        const QGeoFileTileCacheTomTom::RecompressResult result = recompress();
+        QGeoFileTileCacheTomTom *cache = m_cache;
+        const QGeoTileSpec spec = m_spec;
+        const QString filename = m_filename;
+        QMetaObject::invokeMethod(cache, [cache, spec, filename, result]() {
+            cache->tileRecompressed(spec, filename, result);
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    static QVector<QRgb> palette(const QImage &image)
+    {
+        QVector<QRgb> colors;
+        QSet<QRgb> seen;
+        for (int y = 0; y < image.height(); ++y) {
+            const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+            for (int x = 0; x < image.width(); ++x) {
+                if (seen.contains(line[x]))
+                    continue;
+                if (seen.size() == 256)
+                    return QVector<QRgb>();
+                seen.insert(line[x]);
+                colors.append(line[x]);
+            }
+        }
+        return colors;
+    }
+
+    QGeoFileTileCacheTomTom::RecompressResult recompress()
+    {
+        QFile file(m_filename);
+        if (!file.open(QIODevice::ReadOnly))
+            return QGeoFileTileCacheTomTom::RecompressFailed;
+        QByteArray original = file.readAll();
+        file.close();
+
+        QBuffer source(&original);
+        QImageReader reader(&source, "png");
+        if (reader.text(QLatin1String(recompressedKey)) == QLatin1String(recompressedValue))
+            return QGeoFileTileCacheTomTom::RecompressKept;
+        QImage image = reader.read();
+        if (image.isNull())
+            return QGeoFileTileCacheTomTom::RecompressFailed;
+
+        if (image.format() != QImage::Format_Indexed8) {
+            image = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32
+                                                                  : QImage::Format_RGB32);
+            const QVector<QRgb> colors = palette(image);
+            if (!colors.isEmpty())
+                image = image.convertToFormat(QImage::Format_Indexed8, colors, Qt::ThresholdDither);
+            else if (m_lossy)
+                image = image.convertToFormat(QImage::Format_Indexed8, Qt::DiffuseDither);
+        }
+
+        QByteArray recompressed;
+        QBuffer target(&recompressed);
+        target.open(QIODevice::WriteOnly);
+        QImageWriter writer(&target, "png");
+        writer.setQuality(0); // maximum deflate level
+        writer.setText(QLatin1String(recompressedKey), QLatin1String(recompressedValue));
+        if (!writer.write(image))
+            return QGeoFileTileCacheTomTom::RecompressFailed;
+        if (recompressed.size() >= original.size())
+            return QGeoFileTileCacheTomTom::RecompressKept;
+
+        const QString partial = partialName(m_filename);
+        QFile out(partial);
+        if (!out.open(QIODevice::WriteOnly) || out.write(recompressed) != recompressed.size()) {
+            out.remove();
+            return QGeoFileTileCacheTomTom::RecompressFailed;
+        }
+        out.close();
+        if (!renameOver(partial, m_filename)) {
+            QFile::remove(partial);
+            return QGeoFileTileCacheTomTom::RecompressFailed;
+        }
+        return QGeoFileTileCacheTomTom::RecompressReplaced;
+    }
+
+    QGeoFileTileCacheTomTom *m_cache;
+    QGeoTileSpec m_spec;
+    QString m_filename;
+    bool m_lossy;
+};
+
+static QGeoRectangle tileBounds(const QGeoTileSpec &spec)
+{
+    const double n = double(1 << spec.zoom());
+    auto latitude = [n](int y) { return qRadiansToDegrees(std::atan(std::sinh(M_PI * (1.0 - 2.0 * y / n)))); };
+    return QGeoRectangle(QGeoCoordinate(latitude(spec.y()), spec.x() / n * 360.0 - 180.0),
+                         QGeoCoordinate(latitude(spec.y() + 1), (spec.x() + 1) / n * 360.0 - 180.0));
+}
+
+static quint64 staleBucket(const QGeoTileSpec &spec)
+{
+    // Highest zooms first: they are the cheapest to refetch and the least likely to be revisited.
+    return (quint64(spec.mapId()) << 32) | quint64(0xff - spec.zoom());
+}
+
 QGeoFileTileCacheTomTom::QGeoFileTileCacheTomTom(const QList<QGeoMapType> &/*mapTypes*/, int scaleFactor, const QString &directory, QObject *parent)
     :QGeoFileTileCache(directory, parent)
 {
     m_scaleFactor = qBound(1, scaleFactor, 2);
+    m_staleTilesTimer.setInterval(staleTilesInterval);
+    connect(&m_staleTilesTimer, &QTimer::timeout, this, &QGeoFileTileCacheTomTom::evictStaleTiles);
+    m_ioPool.setMaxThreadCount(2);
+    m_writePool.setMaxThreadCount(1); // batches are written in order
+    m_writeTimer.setSingleShot(true);
+    m_writeTimer.setInterval(2000);
+    connect(&m_writeTimer, &QTimer::timeout, this, &QGeoFileTileCacheTomTom::flushWrites);
+    m_recompressTimer.setInterval(recompressInterval);
+    connect(&m_recompressTimer, &QTimer::timeout, this, &QGeoFileTileCacheTomTom::recompressIdleTiles);
+    m_journalTimer.setInterval(journalInterval);
+    connect(&m_journalTimer, &QTimer::timeout, this, &QGeoFileTileCacheTomTom::syncJournal);
+    m_maxDiskUsage = QGeoFileTileCache::maxDiskUsage();
 }
 
 QGeoFileTileCacheTomTom::~QGeoFileTileCacheTomTom()
 {
+    m_ioPool.clear();
+    m_ioPool.waitForDone();
+    // Whatever is still queued is written out before leaving. Tiles written here are not
+    // registered anymore, but loadTiles() picks them up on the next start.
+    flushWrites();
+    m_writePool.waitForDone();
+}
+
+void QGeoFileTileCacheTomTom::init()
+{
+    if (m_sharedCache) {
+        // Evictions must be journaled, so they always go through a policy.
+        if (!m_evictionPolicy)
+            setEvictionPolicy(new QGeoTileEvictionPolicyLruTomTom);
+        m_writeTimer.setInterval(qMin(m_writeTimer.interval(), sharedWriteDelay));
+        m_evictorLock.reset(new QLockFile(QDir(directory_).filePath(QStringLiteral("tomtom_evictor.lock"))));
+        m_evictorLock->setStaleLockTime(0); // held for the lifetime of the process
+        m_evictorLock->tryLock(0);
+    }
+
+    // Leftovers of batches interrupted by a crash. In shared mode they may also belong to
+    // a batch another process is writing right now, unless that process is gone or the
+    // file is too old.
+    QDir dir(directory_);
+    const QFileInfoList partials = dir.entryInfoList(QStringList() << QStringLiteral("*") + partialSuffix, QDir::Files);
+    const QDateTime now = QDateTime::currentDateTime();
+    for (const QFileInfo &partial : partials) {
+        bool leftover = !m_sharedCache || partial.lastModified().secsTo(now) > partialMaxAge;
+#ifdef Q_OS_UNIX
+        const qint64 owner = partialOwner(partial.fileName());
+        if (owner > 0 && ::kill(pid_t(owner), 0) != 0 && errno == ESRCH)
+            leftover = true;
+#endif
+        if (leftover)
+            dir.remove(partial.fileName());
+    }
+
+    /*
+        setEvictionPolicy(), also called above for shared mode, sets the budget of diskCache_,
+        so QGeoFileTileCache::init() does not apply its default. Without this, the budget would stay the one of the empty
+        diskCache_ and the whole disk cache would be evicted below.
+    */
+    if (m_evictionPolicy && !m_maxDiskUsageSet)
+        m_maxDiskUsage = (costStrategyDisk() == ByteSize) ? 50 * 1024 * 1024 : 1000;
+
+    QGeoFileTileCache::init();
+    if (m_recompressionMode != NoRecompression)
+        loadRecompressKept();
+
+    if (m_evictionPolicy) {
+        for (const QGeoTileSpec &spec : diskCache_.keys()) {
+            QSharedPointer<QGeoCachedTileDisk> td = diskCache_.object(spec);
+            if (td)
+                diskAdded(spec, QFileInfo(td->filename).size());
+        }
+        enforceDiskUsage();
+    }
+
+    if (m_sharedCache) {
+        syncJournal();
+        m_journalTimer.start();
+    }
+}
+
+/*
+    Replaces the eviction of QGeoFileTileCache with the given policy, taking ownership of it.
+    Passing nullptr restores the default. To be set before init().
+*/
+void QGeoFileTileCacheTomTom::setEvictionPolicy(QGeoTileEvictionPolicyTomTom *policy)
+{
+    m_evictionPolicy.reset(policy);
+    // With a policy in place diskCache_ must never evict on its own.
+    QGeoFileTileCache::setMaxDiskUsage(m_evictionPolicy ? std::numeric_limits<int>::max() : m_maxDiskUsage);
+}
+
+void QGeoFileTileCacheTomTom::setMaxDiskUsage(int diskUsage)
+{
+    m_maxDiskUsage = diskUsage;
+    m_maxDiskUsageSet = true;
+    if (m_evictionPolicy)
+        enforceDiskUsage();
+    else
+        QGeoFileTileCache::setMaxDiskUsage(diskUsage);
+}
+
+int QGeoFileTileCacheTomTom::maxDiskUsage() const
+{
+    return m_maxDiskUsage;
+}
+
+void QGeoFileTileCacheTomTom::printStats()
+{
+    QGeoFileTileCache::printStats();
+    const quint64 lookups = m_diskHitCount + m_diskMissCount;
+    qDebug() << "TomTom disk cache policy:" << (m_evictionPolicy ? m_evictionPolicy->name() : QStringLiteral("default"))
+             << "hits:" << m_diskHitCount << "misses:" << m_diskMissCount
+             << "hit rate:" << (lookups ? 100.0 * m_diskHitCount / lookups : 0.0) << "%";
+}
+
+void QGeoFileTileCacheTomTom::diskAccessed(const QGeoTileSpec &spec, bool hit)
+{
+    if (hit) {
+        ++m_diskHitCount;
+        if (m_evictionPolicy)
+            m_evictionPolicy->touch(spec);
+    } else {
+        ++m_diskMissCount;
+    }
+}
+
+void QGeoFileTileCacheTomTom::diskAdded(const QGeoTileSpec &spec, int size)
+{
+    if (!m_evictionPolicy)
+        return;
+    m_evictionPolicy->insert(spec, costStrategyDisk() == ByteSize ? size : 1);
+}
+
+void QGeoFileTileCacheTomTom::diskRemoved(const QGeoTileSpec &spec)
+{
+    m_recompressKept.remove(spec);
+    if (m_evictionPolicy)
+        m_evictionPolicy->remove(spec);
+}
+
+void QGeoFileTileCacheTomTom::enforceDiskUsage()
+{
+    if (!m_evictionPolicy || !isEvictor())
+        return;
+
+    while (m_evictionPolicy->count() && m_evictionPolicy->totalCost() > m_maxDiskUsage) {
+        const QGeoTileSpec spec = m_evictionPolicy->takeVictim();
+        QSharedPointer<QGeoCachedTileDisk> td = diskCache_.object(spec);
+        // remove() detaches the cached tile without deleting the file, so do it here.
+        diskCache_.remove(spec);
+        m_recompressKept.remove(spec);
+        if (td) {
+            QFile::remove(td->filename);
+            appendJournal('-', td->filename);
+        }
+    }
+}
+
+bool QGeoFileTileCacheTomTom::sharedCache() const
+{
+    return m_sharedCache;
+}
+
+/*
+    Enables sharing the cache directory with other processes using the same setting.
+    To be set before init().
+*/
+void QGeoFileTileCacheTomTom::setSharedCache(bool enabled)
+{
+    m_sharedCache = enabled;
+}
+
+bool QGeoFileTileCacheTomTom::isEvictor() const
+{
+    return !m_sharedCache || (m_evictorLock && m_evictorLock->isLocked());
+}
+
+QString QGeoFileTileCacheTomTom::journalPath() const
+{
+    return QDir(directory_).filePath(QStringLiteral("tomtom_journal"));
+}
+
+void QGeoFileTileCacheTomTom::appendJournal(char op, const QString &filename)
+{
+    if (!m_sharedCache)
+        return;
+    m_journalBacklog += op;
+    m_journalBacklog += QFileInfo(filename).fileName().toUtf8();
+    m_journalBacklog += '\n';
+}
+
+/*
+    Registers a tile that another process published, but that is not announced in the
+    journal yet. Returns the registered tile, or null if it is not on disk.
+    This checks the disk on the calling thread: asynchronous reads go through
+    tileAdopted() instead.
+*/
+QSharedPointer<QGeoCachedTileDisk> QGeoFileTileCacheTomTom::adoptTile(const QGeoTileSpec &spec)
+{
+    const QString filename = tileSpecToFilename(spec, QStringLiteral("png"), directory_);
+    const QFileInfo info(filename);
+    if (!info.exists())
+        return QSharedPointer<QGeoCachedTileDisk>();
+
+    addToDiskCache(spec, filename);
+    diskAdded(spec, info.size());
+    return diskCache_.object(spec);
+}
+
+/*
+    The journal is a text file listing the tiles published ("+name") and evicted ("-name")
+    by any of the processes sharing the cache, and it is only accessed under its lock file.
+    Each process replays what others appended since its last sync and appends its own
+    changes. The first line identifies the journal, and changes when the evictor compacts it,
+    so that the other processes replay it from the start.
+*/
+void QGeoFileTileCacheTomTom::syncJournal()
+{
+    if (m_evictorLock && !m_evictorLock->isLocked() && m_evictorLock->tryLock(0))
+        enforceDiskUsage(); // the previous evictor is gone
+
+    QLockFile lock(journalPath() + QLatin1String(".lock"));
+    if (!lock.tryLock(journalLockTimeout))
+        return;
+
+    QFile journal(journalPath());
+    if (!journal.open(QIODevice::ReadWrite)) {
+        qWarning() << "QGeoFileTileCacheTomTom: unable to open" << journal.fileName();
+        return;
+    }
+
+    QByteArray header = journal.readLine();
+    if (!header.startsWith(journalMagic)) {
+        header = QByteArray(journalMagic) + ' ' + QByteArray::number(QRandomGenerator::global()->generate64()) + '\n';
+        journal.resize(0);
+        journal.seek(0);
+        journal.write(header);
+    }
+    if (header != m_journalHeader) {
+        m_journalHeader = header;
+        m_journalOffset = header.size();
+    }
+
+    journal.seek(m_journalOffset);
+    while (!journal.atEnd()) {
+        const QByteArray line = journal.readLine();
+        m_journalOffset += line.size();
+        if (line.endsWith('\n')) // anything else is the leftover of a crash
+            replayJournal(line.left(line.size() - 1));
+    }
+
+    enforceDiskUsage();
+
+    if (!m_journalBacklog.isEmpty()) {
+        journal.seek(journal.size());
+        journal.write(m_journalBacklog);
+        m_journalBacklog.clear();
+        m_journalOffset = journal.size();
+    }
+
+    if (!isEvictor() || journal.size() < journalCompactSize)
+        return;
+    journal.close();
+
+    QByteArray compacted = QByteArray(journalMagic) + ' ' + QByteArray::number(QRandomGenerator::global()->generate64()) + '\n';
+    const int headerSize = compacted.size();
+    for (const QGeoTileSpec &spec : diskCache_.keys()) {
+        QSharedPointer<QGeoCachedTileDisk> td = diskCache_.object(spec);
+        if (!td)
+            continue;
+        compacted += '+';
+        compacted += QFileInfo(td->filename).fileName().toUtf8();
+        compacted += '\n';
+    }
+    const QString partial = partialName(journalPath());
+    QFile out(partial);
+    if (!out.open(QIODevice::WriteOnly) || out.write(compacted) != compacted.size()) {
+        out.remove();
+        return;
+    }
+    out.close();
+    if (!renameOver(partial, journalPath())) {
+        QFile::remove(partial);
+        return;
+    }
+    m_journalHeader = compacted.left(headerSize);
+    m_journalOffset = compacted.size();
+}
+
+void QGeoFileTileCacheTomTom::replayJournal(const QByteArray &line)
+{
+    if (line.size() < 2)
+        return;
+    const QString name = QString::fromUtf8(line.mid(1));
+    const QGeoTileSpec spec = filenameToTileSpec(name);
+    if (spec == QGeoTileSpec())
+        return;
+
+    if (line.at(0) == '+') {
+        if (diskCache_.contains(spec))
+            return;
+        const QString filename = QDir(directory_).filePath(name);
+        const QFileInfo info(filename);
+        if (!info.exists()) // evicted already
+            return;
+        addToDiskCache(spec, filename);
+        diskAdded(spec, info.size());
+    } else if (line.at(0) == '-') {
+        // The file is gone already, only the entry is left to drop.
+        diskCache_.remove(spec);
+        diskRemoved(spec);
+    }
+}
+
+void QGeoFileTileCacheTomTom::setWriteBatchSize(int tiles)
+{
+    m_writeBatchSize = qMax(0, tiles);
+}
+
+void QGeoFileTileCacheTomTom::setWriteDelay(int msec)
+{
+    m_writeTimer.setInterval(qMax(0, msec));
+}
+
+void QGeoFileTileCacheTomTom::setCrashSafeWrites(bool enabled)
+{
+    m_crashSafeWrites = enabled;
+}
+
+void QGeoFileTileCacheTomTom::flushWrites()
+{
+    m_writeTimer.stop();
+    if (m_writeQueue.isEmpty())
+        return;
+
+    // In shared mode tiles are always published by rename, so that others never read partial files.
+    m_writePool.start(new QGeoTileWriteTaskTomTom(this, m_writeQueue, directory_, m_crashSafeWrites || m_sharedCache));
+    m_writeQueue.clear();
+}
+
+void QGeoFileTileCacheTomTom::tilesWritten(const QVector<PendingWrite> &batch)
+{
+    for (const PendingWrite &w : batch) {
+        // A newer insert of the same tile may be queued already
+        if (m_pendingWrites.value(w.spec).isSharedWith(w.bytes))
+            m_pendingWrites.remove(w.spec);
+        addToDiskCache(w.spec, w.filename);
+        diskAdded(w.spec, w.bytes.size());
+        appendJournal('+', w.filename);
+        m_recompressKept.remove(w.spec); // new content, worth another try
+        if (m_recompressionMode != NoRecompression)
+            m_recompressCandidates.append(w.spec);
+    }
+    if (m_sharedCache)
+        syncJournal(); // also enforces the disk usage
+    else
+        enforceDiskUsage();
+}
+
+void QGeoFileTileCacheTomTom::setRecompressionMode(RecompressionMode mode)
+{
+    m_recompressionMode = mode;
+    if (mode == NoRecompression)
+        m_recompressTimer.stop();
+    else
+        m_recompressTimer.start();
+}
+
+/*
+    The map types whose tiles get quantized in lossy mode, normally the imagery ones.
+    Tiles of other map types are recompressed losslessly.
+*/
+void QGeoFileTileCacheTomTom::setLossyMapIds(const QSet<int> &mapIds)
+{
+    m_lossyMapIds = mapIds;
+}
+
+/*
+    Recompresses a few tiles per round, and only while the cache is otherwise idle:
+    no reads running, no writes pending.
+*/
+void QGeoFileTileCacheTomTom::recompressIdleTiles()
+{
+    if (m_recompressInFlight || m_ioPool.activeThreadCount() || !m_pendingWrites.isEmpty())
+        return;
+
+    int queued = 0;
+    while (!m_recompressCandidates.isEmpty() && queued < recompressBatch) {
+        const QGeoTileSpec spec = m_recompressCandidates.takeLast();
+        if (m_recompressKept.contains(spec))
+            continue;
+        QSharedPointer<QGeoCachedTileDisk> td = diskCache_.object(spec);
+        if (!td)
+            continue;
+        // A tile queued twice is skipped by the task itself, through the text chunk.
+        // On the write pool, so that it never races with a batch writing the same file
+        const bool lossy = m_recompressionMode == LossyRecompression && m_lossyMapIds.contains(spec.mapId());
+        m_writePool.start(new QGeoTileRecompressTaskTomTom(this, spec, td->filename, lossy), -1);
+        ++m_recompressInFlight;
+        ++queued;
+    }
+}
+
+QString QGeoFileTileCacheTomTom::recompressKeptPath() const
+{
+    return QDir(directory_).filePath(QStringLiteral("tomtom_recompress_kept"));
+}
+
+/*
+    Tiles that did not shrink are listed by name in a file next to the tiles, so that they
+    are not decoded and encoded again on every start. Only tiles still on disk are kept
+    in memory, and the file is rewritten once it lists too many that are gone.
+*/
+void QGeoFileTileCacheTomTom::loadRecompressKept()
+{
+    m_recompressKept.clear();
+    QFile file(recompressKeptPath());
+    int listed = 0;
+    if (file.open(QIODevice::ReadOnly)) {
+        while (!file.atEnd()) {
+            const QByteArray line = file.readLine();
+            if (!line.endsWith('\n'))
+                continue;
+            ++listed;
+            const QGeoTileSpec spec = filenameToTileSpec(QString::fromUtf8(line.left(line.size() - 1)));
+            if (spec != QGeoTileSpec() && diskCache_.contains(spec))
+                m_recompressKept.insert(spec);
+        }
+        file.close();
+    }
+
+    m_recompressCandidates.clear();
+    for (const QGeoTileSpec &spec : diskCache_.keys()) {
+        if (!m_recompressKept.contains(spec))
+            m_recompressCandidates.append(spec);
+    }
+
+    if (listed <= 2 * m_recompressKept.size() + recompressKeptSlack || !isEvictor())
+        return;
+    QByteArray compacted;
+    for (const QGeoTileSpec &spec : qAsConst(m_recompressKept)) {
+        compacted += QFileInfo(tileSpecToFilename(spec, QStringLiteral("png"), directory_)).fileName().toUtf8();
+        compacted += '\n';
+    }
+    const QString partial = partialName(recompressKeptPath());
+    QFile out(partial);
+    if (!out.open(QIODevice::WriteOnly) || out.write(compacted) != compacted.size()) {
+        out.remove();
+        return;
+    }
+    out.close();
+    if (!renameOver(partial, recompressKeptPath()))
+        QFile::remove(partial);
+}
+
+void QGeoFileTileCacheTomTom::tileRecompressed(const QGeoTileSpec &spec, const QString &filename, RecompressResult result)
+{
+    --m_recompressInFlight;
+    if (result == RecompressKept && diskCache_.contains(spec) && !m_recompressKept.contains(spec)) {
+        m_recompressKept.insert(spec);
+        QFile kept(recompressKeptPath());
+        if (kept.open(QIODevice::WriteOnly | QIODevice::Append))
+            kept.write(QFileInfo(filename).fileName().toUtf8() + '\n');
+    }
+    if (result != RecompressReplaced)
+        return;
+
+    QSharedPointer<QGeoCachedTileDisk> td = diskCache_.object(spec);
+    if (!td) {
+        // Evicted in the meantime
+        QFile::remove(filename);
+        return;
+    }
+    // Re-register the tile to account for its new size. The replaced entry must not delete the file.
+    td->cache = nullptr;
+    addToDiskCache(spec, filename);
+    if (m_evictionPolicy && m_evictionPolicy->contains(spec))
+        diskAdded(spec, QFileInfo(filename).size());
+}
+
+bool QGeoFileTileCacheTomTom::asyncDiskReads() const
+{
+    return m_asyncDiskReads;
+}
+
+void QGeoFileTileCacheTomTom::setAsyncDiskReads(bool enabled)
+{
+    m_asyncDiskReads = enabled;
+}
+
+void QGeoFileTileCacheTomTom::setMaxIoThreads(int threads)
+{
+    m_ioPool.setMaxThreadCount(qMax(1, threads));
+}
+
+/*
+    Queues the read of a disk cached tile on the I/O pool, returning false if the tile is
+    not on disk. The data is delivered to the reply, as if it came from the network.
+*/
+bool QGeoFileTileCacheTomTom::readTileAsync(const QGeoTileSpec &spec, int priority, QGeoMapReplyTomTom *reply)
+{
+    if (!m_asyncDiskReads)
+        return false;
+
+    const auto pending = m_pendingWrites.constFind(spec);
+    if (pending != m_pendingWrites.constEnd()) {
+        const QByteArray bytes = pending.value();
+        diskAccessed(spec, true);
+        const QPointer<QGeoMapReplyTomTom> guard = reply;
+        QMetaObject::invokeMethod(this, [this, spec, bytes, guard]() {
+            tileRead(spec, bytes, guard.data());
+        }, Qt::QueuedConnection);
+        return true;
+    }
+
+    QSharedPointer<QGeoCachedTileDisk> td = diskCache_.object(spec);
+    if (!td && m_sharedCache) {
+        // Another process may have published it already: try reading it on the I/O pool,
+        // tileAdopted() falls back to the archives and the network.
+        m_ioPool.start(new QGeoTileReadTaskTomTom(this, spec, tileSpecToFilename(spec, QStringLiteral("png"), directory_),
+                                                  reply, priority), priority);
+        return true;
+    }
+    if (!td) {
+        const QSharedPointer<QGeoTileArchiveTomTom> archive = archiveFor(spec);
+        diskAccessed(spec, !archive.isNull());
+        if (!archive)
+            return false;
+        m_ioPool.start(new QGeoTileReadTaskTomTom(this, spec, archive, reply), priority);
+        return true;
+    }
+
+    diskAccessed(spec, true);
+    m_ioPool.start(new QGeoTileReadTaskTomTom(this, spec, td->filename, reply), priority);
+    return true;
+}
+
+void QGeoFileTileCacheTomTom::skipDiskInsert(const QGeoTileSpec &spec)
+{
+    m_diskHits.insert(spec);
+}
+
+// Undoes skipDiskInsert(), for fetches that failed or were aborted before inserting.
+void QGeoFileTileCacheTomTom::keepDiskInsert(const QGeoTileSpec &spec)
+{
+    m_diskHits.remove(spec);
+}
+
+void QGeoFileTileCacheTomTom::tileRead(const QGeoTileSpec &spec, const QByteArray &bytes, QGeoMapReplyTomTom *reply)
+{
+    if (bytes.isEmpty()) {
+        // The file is gone or unreadable: forget about it, the reply will refetch the tile.
+        diskCache_.remove(spec);
+        diskRemoved(spec);
+    } else if (reply && !reply->isFinished()) {
+        m_diskHits.insert(spec);
+    }
+
+    if (reply)
+        reply->setCachedData(bytes);
+}
+
+/*
+    Completes the read of a tile which was not registered, in shared mode. Tiles found on
+    disk are registered as if announced in the journal.
+*/
+void QGeoFileTileCacheTomTom::tileAdopted(const QGeoTileSpec &spec, const QString &filename,
+                                          const QByteArray &bytes, QGeoMapReplyTomTom *reply, int priority)
+{
+    if (bytes.isEmpty()) {
+        const QSharedPointer<QGeoTileArchiveTomTom> archive = archiveFor(spec);
+        diskAccessed(spec, !archive.isNull());
+        if (archive && reply && !reply->isFinished())
+            m_ioPool.start(new QGeoTileReadTaskTomTom(this, spec, archive, reply), priority);
+        else if (reply)
+            reply->setCachedData(QByteArray());
+        return;
+    }
+
+    if (!diskCache_.contains(spec)) {
+        addToDiskCache(spec, filename);
+        diskAdded(spec, bytes.size());
+    }
+    diskAccessed(spec, true);
+    tileRead(spec, bytes, reply);
+}
+
+QSharedPointer<QGeoTileArchiveTomTom> QGeoFileTileCacheTomTom::archiveFor(const QGeoTileSpec &spec) const
+{
+    for (const QSharedPointer<QGeoTileArchiveTomTom> &archive : m_archives) {
+        if (archive->contains(spec))
+            return archive;
+    }
+    return QSharedPointer<QGeoTileArchiveTomTom>();
+}
+
+/*
+    Makes the tiles of the archive available without unpacking them. Archives are
+    looked up in the order they were mounted, after the disk cache.
+*/
+bool QGeoFileTileCacheTomTom::mountArchive(const QString &path)
+{
+    QSharedPointer<QGeoTileArchiveTomTom> archive(new QGeoTileArchiveTomTom(path));
+    if (!archive->open()) {
+        qWarning() << "QGeoFileTileCacheTomTom: unable to mount" << path << archive->errorString();
+        return false;
+    }
+    if (archive->scaleFactor() != m_scaleFactor) {
+        qWarning() << "QGeoFileTileCacheTomTom: scale factor mismatch in" << path;
+        return false;
+    }
+    m_archives.append(archive);
+    return true;
+}
+
+/*
+    Unpacks the tiles of the archive that are not cached yet into the disk cache,
+    in the background.
+*/
+bool QGeoFileTileCacheTomTom::importArchive(const QString &path)
+{
+    QSharedPointer<QGeoTileArchiveTomTom> archive(new QGeoTileArchiveTomTom(path));
+    if (!archive->open()) {
+        qWarning() << "QGeoFileTileCacheTomTom: unable to import" << path << archive->errorString();
+        return false;
+    }
+    if (archive->scaleFactor() != m_scaleFactor) {
+        qWarning() << "QGeoFileTileCacheTomTom: scale factor mismatch in" << path;
+        return false;
+    }
+
+    QVector<QGeoTileArchiveTomTom::Tile> tiles;
+    for (const QGeoTileSpec &spec : archive->tiles()) {
+        if (diskCache_.contains(spec) || m_pendingWrites.contains(spec))
+            continue;
+        QGeoTileArchiveTomTom::Tile t;
+        t.spec = spec;
+        t.filename = tileSpecToFilename(spec, QStringLiteral("png"), directory_);
+        tiles.append(t);
+    }
+    if (!tiles.isEmpty())
+        m_writePool.start(new QGeoTileImportTaskTomTom(this, archive, tiles));
+    return true;
+}
+
+void QGeoFileTileCacheTomTom::tilesImported(const QVector<QGeoTileSpec> &specs, const QStringList &filenames)
+{
+    for (int i = 0; i < specs.size(); ++i) {
+        if (diskCache_.contains(specs.at(i)))
+            continue;
+        addToDiskCache(specs.at(i), filenames.at(i));
+        diskAdded(specs.at(i), QFileInfo(filenames.at(i)).size());
+        appendJournal('+', filenames.at(i));
+    }
+    if (m_sharedCache)
+        syncJournal();
+    else
+        enforceDiskUsage();
+}
+
+/*
+    Packs the given tile files into an archive, on the global thread pool, which the
+    application waits for when it quits.
+*/
+class QGeoTileExportTaskTomTom : public QRunnable
+{
+public:
+    QGeoTileExportTaskTomTom(const QString &path, int scaleFactor, const QVector<QGeoTileArchiveTomTom::Tile> &tiles)
+        : m_path(path), m_scaleFactor(scaleFactor), m_tiles(tiles)
+    {
+    }
+
+    void run() override
+    {
+        QString error;
+        if (!QGeoTileArchiveTomTom::write(m_path, m_scaleFactor, m_tiles, &error))
+            qWarning() << "QGeoFileTileCacheTomTom: unable to export" << m_path << error;
+    }
+
+private:
+    QString m_path;
+    int m_scaleFactor;
+    QVector<QGeoTileArchiveTomTom::Tile> m_tiles;
+};
+
+/*
+    Packs the tiles on disk into an archive, optionally only those of the current map
+    version intersecting region, within the given zoom levels. Blocks until done.
+*/
+bool QGeoFileTileCacheTomTom::exportArchive(const QString &path, const QGeoRectangle &region, int minZoom, int maxZoom)
+{
+    QString error;
+    if (!QGeoTileArchiveTomTom::write(path, m_scaleFactor, exportTiles(region, minZoom, maxZoom), &error)) {
+        qWarning() << "QGeoFileTileCacheTomTom: unable to export" << path << error;
+        return false;
+    }
+    return true;
+}
+
+/*
+    Like exportArchive(), but only lists the tiles on the calling thread: reading them and
+    writing the archive happen on the global thread pool, so that the cache can go away
+    in the meantime. QCoreApplication waits for the export when the application quits.
+*/
+void QGeoFileTileCacheTomTom::exportArchiveInBackground(const QString &path, const QGeoRectangle &region, int minZoom, int maxZoom)
+{
+    QThreadPool::globalInstance()->start(new QGeoTileExportTaskTomTom(path, m_scaleFactor,
+                                                                      exportTiles(region, minZoom, maxZoom)));
+}
+
+// Flushes the pending writes, and lists the tiles on disk to export.
+QVector<QGeoTileArchiveTomTom::Tile> QGeoFileTileCacheTomTom::exportTiles(const QGeoRectangle &region, int minZoom, int maxZoom)
+{
+    flushWrites();
+    m_writePool.waitForDone();
+
+    QVector<QGeoTileArchiveTomTom::Tile> tiles;
+    QDir dir(directory_);
+    const QStringList files = dir.entryList(QStringList() << QStringLiteral("*.png"), QDir::Files);
+    for (const QString &file : files) {
+        const QGeoTileSpec spec = filenameToTileSpec(file);
+        if (spec == QGeoTileSpec() || spec.zoom() < minZoom || spec.zoom() > maxZoom)
+            continue;
+        if (m_tileVersion != -1 && spec.version() != m_tileVersion)
+            continue;
+        if (region.isValid() && !region.intersects(tileBounds(spec)))
+            continue;
+        QGeoTileArchiveTomTom::Tile t;
+        t.spec = spec;
+        t.filename = dir.filePath(file);
+        tiles.append(t);
+    }
+    return tiles;
+}
+
+QSharedPointer<QGeoTileTexture> QGeoFileTileCacheTomTom::get(const QGeoTileSpec &spec)
+{
+    if (!m_asyncDiskReads) {
+        QSharedPointer<QGeoTileTexture> tt = getFromMemory(spec);
+        if (tt)
+            return tt;
+        if (m_pendingWrites.contains(spec)) {
+            diskAccessed(spec, true);
+            return decodeTile(spec, m_pendingWrites.value(spec));
+        }
+        if (diskCache_.contains(spec) || (m_sharedCache && adoptTile(spec))) {
+            diskAccessed(spec, true);
+            return getFromDisk(spec);
+        }
+        const QSharedPointer<QGeoTileArchiveTomTom> archive = archiveFor(spec);
+        diskAccessed(spec, !archive.isNull());
+        if (archive) {
+            const QByteArray bytes = archive->tile(spec);
+            if (!bytes.isEmpty())
+                return decodeTile(spec, bytes);
+        }
+        return QSharedPointer<QGeoTileTexture>();
+    }
+
+    QSharedPointer<QGeoTileTexture> tt = getFromMemory(spec);
+    if (tt)
+        return tt;
+
+    const QByteArray bytes = m_handoff.take(spec);
+    if (!bytes.isEmpty()) {
+        m_handoffOrder.removeOne(spec);
+        return decodeTile(spec, bytes);
+    }
+
+    // Disk hits are not served here, the tile fetcher resolves them asynchronously.
+    return QSharedPointer<QGeoTileTexture>();
+}
+
+void QGeoFileTileCacheTomTom::insert(const QGeoTileSpec &spec,
+                                     const QByteArray &bytes,
+                                     const QString &format,
+                                     QAbstractGeoTileCache::CacheAreas areas)
+{
+    if (bytes.isEmpty())
+        return;
+
+    if (m_diskHits.remove(spec))
+        areas &= ~QAbstractGeoTileCache::DiskCache;
+
+    if ((areas & QAbstractGeoTileCache::DiskCache) && (m_writeBatchSize > 1 || m_sharedCache)) {
+        areas &= ~QAbstractGeoTileCache::DiskCache;
+        PendingWrite w;
+        w.spec = spec;
+        w.filename = tileSpecToFilename(spec, format, directory_);
+        w.bytes = bytes;
+        m_writeQueue.append(w);
+        m_pendingWrites.insert(spec, bytes);
+        if (m_writeQueue.size() >= m_writeBatchSize)
+            flushWrites();
+        else if (!m_writeTimer.isActive())
+            m_writeTimer.start();
+    }
+
+    QGeoFileTileCache::insert(spec, bytes, format, areas);
+    if ((areas & QAbstractGeoTileCache::DiskCache) && diskCache_.contains(spec)) {
+        diskAdded(spec, bytes.size());
+        enforceDiskUsage();
+    }
+
+    if (m_asyncDiskReads) {
+        if (!m_handoff.contains(spec))
+            m_handoffOrder.append(spec);
+        m_handoff.insert(spec, bytes);
+        while (m_handoffOrder.size() > handoffSize)
+            m_handoff.remove(m_handoffOrder.takeFirst());
+    }
+}
+
+QSharedPointer<QGeoTileTexture> QGeoFileTileCacheTomTom::decodeTile(const QGeoTileSpec &spec, const QByteArray &bytes)
+{
+    QImage image;
+    if (!image.loadFromData(bytes)) {
+        handleError(spec, QLatin1String("Problem with tile image"));
+        return QSharedPointer<QGeoTileTexture>(0);
+    }
+
+    // Converting it here, instead of in each QSGTexture::bind()
+    if (image.format() != QImage::Format_RGB32 && image.format() != QImage::Format_ARGB32_Premultiplied)
+        image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    return addToTextureCache(spec, image);
+}
+
+int QGeoFileTileCacheTomTom::tileVersion() const
+{
+    return m_tileVersion;
+}
+
+/*
+    Tiles belonging to other map versions are not flushed at once, as that would
+    stall the thread and empty the cache in one go. They are instead collected per
+    layer and zoom level, and removed a small batch at a time by evictStaleTiles().
+*/
+void QGeoFileTileCacheTomTom::setTileVersion(int version)
+{
+    if (version == m_tileVersion)
+        return;
+    m_tileVersion = version;
+
+    m_staleTiles.clear();
+    for (const QGeoTileSpec &spec : diskCache_.keys()) {
+        if (spec.version() != m_tileVersion)
+            m_staleTiles[staleBucket(spec)].append(spec);
+    }
+
+    if (m_staleTiles.isEmpty())
+        m_staleTilesTimer.stop();
+    else if (!m_staleTilesTimer.isActive())
+        m_staleTilesTimer.start();
+}
+
+void QGeoFileTileCacheTomTom::evictStaleTiles()
+{
+    int evicted = 0;
+    while (!m_staleTiles.isEmpty() && evicted < staleTilesBatch) {
+        QVector<QGeoTileSpec> &bucket = m_staleTiles.first();
+        while (!bucket.isEmpty() && evicted < staleTilesBatch) {
+            const QGeoTileSpec spec = bucket.takeLast();
+            if (!diskCache_.contains(spec))
+                continue;
+            // remove() detaches the cached tile without deleting the file, so do it here.
+            diskCache_.remove(spec);
+            diskRemoved(spec);
+            memoryCache_.remove(spec);
+            textureCache_.remove(spec);
+            const QString filename = tileSpecToFilename(spec, QStringLiteral("png"), directory_);
+            QFile::remove(filename);
+            appendJournal('-', filename);
+            ++evicted;
+        }
+        if (bucket.isEmpty())
+            m_staleTiles.erase(m_staleTiles.begin());
+    }
 
+    if (m_staleTiles.isEmpty())
+        m_staleTilesTimer.stop();
 }
 
 QString QGeoFileTileCacheTomTom::tileSpecToFilename(const QGeoTileSpec &spec, const QString &format, const QString &directory) const
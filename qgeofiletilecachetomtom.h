@@ -21,11 +21,20 @@
 #ifndef QGEOFILETILECACHETOMTOM_H
 #define QGEOFILETILECACHETOMTOM_H
 
+#include "qgeotilearchivetomtom.h"
 #include <QtLocation/private/qgeofiletilecache_p.h>
 #include <QMap>
+#include <QTimer>
+#include <QThreadPool>
+#include <QScopedPointer>
+#include <QLockFile>
 
 QT_BEGIN_NAMESPACE
 
+class QGeoMapReplyTomTom;
+class QGeoTileEvictionPolicyTomTom;
+class QGeoRectangle;
+
 class QGeoFileTileCacheTomTom : public QGeoFileTileCache
 {
     Q_OBJECT
@@ -33,11 +42,150 @@ public:
     QGeoFileTileCacheTomTom(const QList<QGeoMapType> &mapTypes, int scaleFactor, const QString &directory = QString(), QObject *parent = 0);
     ~QGeoFileTileCacheTomTom();
 
+    int tileVersion() const;
+    void setTileVersion(int version);
+
+    bool asyncDiskReads() const;
+    void setAsyncDiskReads(bool enabled);
+    void setMaxIoThreads(int threads);
+    bool readTileAsync(const QGeoTileSpec &spec, int priority, QGeoMapReplyTomTom *reply);
+    void skipDiskInsert(const QGeoTileSpec &spec);
+    void keepDiskInsert(const QGeoTileSpec &spec);
+
+    void setWriteBatchSize(int tiles);
+    void setWriteDelay(int msec);
+    void setCrashSafeWrites(bool enabled);
+    bool sharedCache() const;
+    void setSharedCache(bool enabled);
+
+    enum RecompressionMode {
+        NoRecompression = 0,
+        LosslessRecompression,
+        LossyRecompression
+    };
+    void setRecompressionMode(RecompressionMode mode);
+    void setLossyMapIds(const QSet<int> &mapIds);
+
+    enum RecompressResult {
+        RecompressFailed = 0,
+        RecompressKept, // already recompressed, or would not shrink
+        RecompressReplaced
+    };
+
+    void setEvictionPolicy(QGeoTileEvictionPolicyTomTom *policy);
+    void setMaxDiskUsage(int diskUsage) override;
+    int maxDiskUsage() const override;
+    void printStats() override;
+
+    bool mountArchive(const QString &path);
+    bool importArchive(const QString &path);
+    bool exportArchive(const QString &path, const QGeoRectangle &region, int minZoom = 0, int maxZoom = 30);
+    void exportArchiveInBackground(const QString &path, const QGeoRectangle &region, int minZoom = 0, int maxZoom = 30);
+
+    QSharedPointer<QGeoTileTexture> get(const QGeoTileSpec &spec) override;
+    void insert(const QGeoTileSpec &spec,
+                const QByteArray &bytes,
+                const QString &format,
+                QAbstractGeoTileCache::CacheAreas areas = QAbstractGeoTileCache::AllCaches) override;
+
+    struct PendingWrite
+    {
+        QGeoTileSpec spec;
+        QString filename;
+        QByteArray bytes;
+    };
+
+public Q_SLOTS:
+    void flushWrites();
+
 protected:
+    void init() override;
     QString tileSpecToFilename(const QGeoTileSpec &spec, const QString &format, const QString &directory) const override;
     QGeoTileSpec filenameToTileSpec(const QString &filename) const override;
 
+private Q_SLOTS:
+    void evictStaleTiles();
+    void recompressIdleTiles();
+    void syncJournal();
+
+private:
+    void tileRead(const QGeoTileSpec &spec, const QByteArray &bytes, QGeoMapReplyTomTom *reply);
+    void tileAdopted(const QGeoTileSpec &spec, const QString &filename,
+                     const QByteArray &bytes, QGeoMapReplyTomTom *reply, int priority);
+    void tilesWritten(const QVector<PendingWrite> &batch);
+    void tilesImported(const QVector<QGeoTileSpec> &specs, const QStringList &filenames);
+    void tileRecompressed(const QGeoTileSpec &spec, const QString &filename, RecompressResult result);
+    void loadRecompressKept();
+    QString recompressKeptPath() const;
+    QSharedPointer<QGeoTileTexture> decodeTile(const QGeoTileSpec &spec, const QByteArray &bytes);
+    void diskAccessed(const QGeoTileSpec &spec, bool hit);
+    void diskAdded(const QGeoTileSpec &spec, int size);
+    void diskRemoved(const QGeoTileSpec &spec);
+    void enforceDiskUsage();
+    QSharedPointer<QGeoCachedTileDisk> adoptTile(const QGeoTileSpec &spec);
+    void appendJournal(char op, const QString &filename);
+    void replayJournal(const QByteArray &line);
+    QString journalPath() const;
+    bool isEvictor() const;
+    QSharedPointer<QGeoTileArchiveTomTom> archiveFor(const QGeoTileSpec &spec) const;
+    QVector<QGeoTileArchiveTomTom::Tile> exportTiles(const QGeoRectangle &region, int minZoom, int maxZoom);
+
+    friend class QGeoTileReadTaskTomTom;
+    friend class QGeoTileWriteTaskTomTom;
+    friend class QGeoTileRecompressTaskTomTom;
+    friend class QGeoTileImportTaskTomTom;
+
+protected:
     int m_scaleFactor;
+    int m_tileVersion = -1;
+    // Tiles of a previous map version, bucketed by (mapId, zoom) and evicted one bucket at a time.
+    QMap<quint64, QVector<QGeoTileSpec>> m_staleTiles;
+    QTimer m_staleTilesTimer;
+
+    bool m_asyncDiskReads = true;
+    QThreadPool m_ioPool;
+    // Tiles which must not be written to disk when inserted: just read from there,
+    // or fetched in a degraded form.
+    QSet<QGeoTileSpec> m_diskHits;
+    // Bytes of the latest inserts, consumed by the get() that follows each insert,
+    // so that they can be served also when the memory tier is disabled.
+    QHash<QGeoTileSpec, QByteArray> m_handoff;
+    QList<QGeoTileSpec> m_handoffOrder;
+
+    // Write-behind: disk inserts are queued and written in batches on m_writePool.
+    int m_writeBatchSize = 32;
+    bool m_crashSafeWrites = false;
+    QVector<PendingWrite> m_writeQueue;
+    QHash<QGeoTileSpec, QByteArray> m_pendingWrites; // queued or being written, still served from here
+    QTimer m_writeTimer;
+    QThreadPool m_writePool;
+
+    // Idle time recompression of the tiles on disk
+    RecompressionMode m_recompressionMode = NoRecompression;
+    QSet<int> m_lossyMapIds; // quantized in lossy mode, the others stay lossless
+    QList<QGeoTileSpec> m_recompressCandidates;
+    QSet<QGeoTileSpec> m_recompressKept; // did not shrink, only those still on disk
+    int m_recompressInFlight = 0;
+    QTimer m_recompressTimer;
+
+    // When set, disk eviction is driven by the policy instead of diskCache_.
+    QScopedPointer<QGeoTileEvictionPolicyTomTom> m_evictionPolicy;
+    int m_maxDiskUsage;
+    bool m_maxDiskUsageSet = false;
+    quint64 m_diskHitCount = 0;
+    quint64 m_diskMissCount = 0;
+
+    // Shared mode: several processes on one cache directory. Tiles are published by rename
+    // and announced in a journal, and only the process holding the evictor lock evicts.
+    bool m_sharedCache = false;
+    QScopedPointer<QLockFile> m_evictorLock;
+    QByteArray m_journalHeader;
+    qint64 m_journalOffset = 0;
+    QByteArray m_journalBacklog;
+    QTimer m_journalTimer;
+
+    // Read only archives, looked up after the disk cache
+    QVector<QSharedPointer<QGeoTileArchiveTomTom>> m_archives;
 };
 
 QT_END_NAMESPACE
@@ -22,13 +22,60 @@
 
 #include <QtLocation/private/qgeotilespec_p.h>
 
+static const int defaultBufferSize = 32 * 1024; // without Content-Length
+static const int maxPooledBuffers = 64;
+
+QByteArray QGeoTileBufferPoolTomTom::acquire(int size)
+{
+    if (size <= 0)
+        size = defaultBufferSize;
+
+    for (auto it = m_buffers.begin(); it != m_buffers.end(); ++it) {
+        // Not too large either, as the buffer ends up in the memory cache as it is
+        if (it->isDetached() && it->capacity() >= size && it->capacity() <= 2 * size) {
+            QByteArray buffer = *it;
+            m_buffers.erase(it);
+            buffer.resize(0); // keeps the capacity, as it was reserved
+            return buffer;
+        }
+    }
+
+    QByteArray buffer;
+    buffer.reserve(size);
+    return buffer;
+}
+
+void QGeoTileBufferPoolTomTom::release(const QByteArray &buffer)
+{
+    if (buffer.capacity() == 0)
+        return;
+    m_buffers.append(buffer);
+    while (m_buffers.size() > maxPooledBuffers)
+        m_buffers.removeFirst();
+}
+
+QGeoMapReplyTomTom::QGeoMapReplyTomTom(const QGeoTileSpec &spec, QObject *parent)
+:   QGeoTiledMapReply(spec, parent)
+{
+}
+
 QGeoMapReplyTomTom::QGeoMapReplyTomTom(QNetworkReply *reply, const QGeoTileSpec &spec, QObject *parent)
 :   QGeoTiledMapReply(spec, parent)
+{
+    setNetworkReply(reply);
+}
+
+QGeoMapReplyTomTom::~QGeoMapReplyTomTom()
+{
+}
+
+void QGeoMapReplyTomTom::setNetworkReply(QNetworkReply *reply)
 {
     if (!reply) {
         setError(UnknownError, QStringLiteral("Null reply"));
-        return;** Contact: https://www.qt.io/licensing/
+        return;
     }
+    connect(reply, SIGNAL(readyRead()), this, SLOT(networkReplyReadyRead()));
     connect(reply, SIGNAL(finished()), this, SLOT(networkReplyFinished()));
     connect(reply, SIGNAL(error(QNetworkReply::NetworkError)),
             this, SLOT(networkReplyError(QNetworkReply::NetworkError)));
@@ -36,8 +83,65 @@ QGeoMapReplyTomTom::QGeoMapReplyTomTom(QNetworkReply *reply, const QGeoTileSpec
     connect(this, &QObject::destroyed, reply, &QObject::deleteLater);
 }
 
-QGeoMapReplyTomTom::~QGeoMapReplyTomTom()
+void QGeoMapReplyTomTom::setBufferPool(const QSharedPointer<QGeoTileBufferPoolTomTom> &pool)
 {
+    m_bufferPool = pool;
+}
+
+void QGeoMapReplyTomTom::networkReplyReadyRead()
+{
+    readAvailable(static_cast<QNetworkReply *>(sender()));
+}
+
+// Reads straight into the tile buffer, sized upfront from Content-Length when available.
+void QGeoMapReplyTomTom::readAvailable(QNetworkReply *reply)
+{
+    const qint64 available = reply->bytesAvailable();
+    if (available <= 0)
+        return;
+
+    if (m_buffer.capacity() == 0) {
+        const int expected = reply->header(QNetworkRequest::ContentLengthHeader).toInt();
+        if (m_bufferPool) {
+            m_buffer = m_bufferPool->acquire(qMax(expected, int(available)));
+        } else {
+            m_buffer.reserve(qMax(expected, int(available)));
+        }
+    }
+
+    const int used = m_buffer.size();
+    if (used + available > m_buffer.capacity())
+        m_buffer.reserve(qMax(int(used + available), 2 * m_buffer.capacity()));
+    m_buffer.resize(used + int(available));
+    const qint64 read = reply->read(m_buffer.data() + used, available);
+    m_buffer.resize(used + int(qMax<qint64>(0, read)));
+}
+
+QByteArray QGeoMapReplyTomTom::takeBuffer()
+{
+    QByteArray buffer;
+    buffer.swap(m_buffer);
+    if (m_bufferPool)
+        m_bufferPool->release(buffer);
+    return buffer;
+}
+
+// Completes the reply with tile data read from the disk cache.
+// An empty array means the tile could not be read, and it has to be fetched instead.
+void QGeoMapReplyTomTom::setCachedData(const QByteArray &bytes)
+{
+    if (isFinished())
+        return;
+
+    if (bytes.isEmpty()) {
+        emit cacheMissed();
+        return;
+    }
+
+    setMapImageData(bytes);
+    setMapImageFormat(QByteArrayLiteral("png"));
+    setCached(true);
+    setFinished(true);
 }
 
 void QGeoMapReplyTomTom::networkReplyFinished()
@@ -45,15 +149,25 @@ void QGeoMapReplyTomTom::networkReplyFinished()
     QNetworkReply *reply = static_cast<QNetworkReply *>(sender());
     reply->deleteLater();
 
-    if (reply->error() != QNetworkReply::NoError)
+    if (reply->error() != QNetworkReply::NoError) {
+        takeBuffer();
         return;
+    }
 
     // ToDo: honor tile expiration? it comes with reply->rawHeader("Expires"). However, they usually
     // last one day. Which is typically too little for a cache to be really useful.
     // Ideally even for cached tiles requests should be fired to verify that the remote resource hasn't changed.
     // In other words reply->rawHeader("ETag") should be fetched and stored, and used in tile requests.
     // But this requires a redesign of the tilecache.
-    setMapImageData(reply->readAll());
+    readAvailable(reply);
+    // Shared with the caches from here on, without copies. Unless the buffer is well larger
+    // than the tile: a pooled one of up to twice the size, or defaultBufferSize without
+    // Content-Length. The caches only charge size(), so such a buffer gets copied to fit,
+    // and the pool keeps the large one.
+    QByteArray data = takeBuffer();
+    if (data.capacity() > data.size() + data.size() / 4)
+        data.squeeze();
+    setMapImageData(data);
     setMapImageFormat(QByteArrayLiteral("png"));
     setFinished(true);
 }
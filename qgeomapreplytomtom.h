@@ -24,20 +24,52 @@
 #include <QtNetwork/QNetworkReply>
 #include <QtLocation/private/qgeotiledmapreply_p.h>
 #include <QtCore/QPointer>
+#include <QtCore/QSharedPointer>
 
 QT_BEGIN_NAMESPACE
 
+/*
+    Recycles tile download buffers. Buffers handed out are filled by a single reply and
+    released once complete, after which they are shared with the tile caches. They get
+    reused as soon as nobody else references them anymore.
+*/
+class QGeoTileBufferPoolTomTom
+{
+public:
+    QByteArray acquire(int size);
+    void release(const QByteArray &buffer);
+
+private:
+    QList<QByteArray> m_buffers;
+};
+
 class QGeoMapReplyTomTom : public QGeoTiledMapReply
 {
     Q_OBJECT
 
 public:
+    explicit QGeoMapReplyTomTom(const QGeoTileSpec &spec, QObject *parent = 0);
     explicit QGeoMapReplyTomTom(QNetworkReply *reply, const QGeoTileSpec &spec, QObject *parent = 0);
     ~QGeoMapReplyTomTom();
 
+    void setNetworkReply(QNetworkReply *reply);
+    void setBufferPool(const QSharedPointer<QGeoTileBufferPoolTomTom> &pool);
+    void setCachedData(const QByteArray &bytes);
+
+Q_SIGNALS:
+    void cacheMissed();
+
 private Q_SLOTS:
     void networkReplyFinished();
     void networkReplyError(QNetworkReply::NetworkError error);
+    void networkReplyReadyRead();
+
+private:
+    void readAvailable(QNetworkReply *reply);
+    QByteArray takeBuffer();
+
+    QSharedPointer<QGeoTileBufferPoolTomTom> m_bufferPool;
+    QByteArray m_buffer;
 };
 
 QT_END_NAMESPACE
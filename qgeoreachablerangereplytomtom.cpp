@@ -0,0 +1,209 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#include "qgeoreachablerangereplytomtom.h"
+#include "qtomtomcommon.h"
+#include "qtomtomjsonreader.h"
+
+QT_BEGIN_NAMESPACE
+
+QGeoReachableRangeReplyTomTom::QGeoReachableRangeReplyTomTom(int origins, int budgets, QObject *parent)
+    : QObject(parent),
+      m_origins(origins),
+      m_budgets(budgets),
+      m_ranges(origins * budgets),
+      m_pending(origins * budgets)
+{
+    if (!m_pending) {
+        m_finished = true;
+        QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection);
+    }
+}
+
+QGeoReachableRangeReplyTomTom::~QGeoReachableRangeReplyTomTom()
+{
+    cancelRequests();
+}
+
+int QGeoReachableRangeReplyTomTom::originCount() const
+{
+    return m_origins;
+}
+
+int QGeoReachableRangeReplyTomTom::budgetCount() const
+{
+    return m_budgets;
+}
+
+QGeoPolygon QGeoReachableRangeReplyTomTom::range(int origin, int budget) const
+{
+    return m_ranges.at(origin * m_budgets + budget);
+}
+
+bool QGeoReachableRangeReplyTomTom::isFinished() const
+{
+    return m_finished;
+}
+
+QGeoRouteReply::Error QGeoReachableRangeReplyTomTom::error() const
+{
+    return m_error;
+}
+
+QString QGeoReachableRangeReplyTomTom::errorString() const
+{
+    return m_errorString;
+}
+
+/*
+    A range that is already known, from the cache. It is reported asynchronously,
+    like the others.
+*/
+void QGeoReachableRangeReplyTomTom::addRange(int origin, int budget, const QGeoPolygon &range)
+{
+    QMetaObject::invokeMethod(this, [this, origin, budget, range]() {
+        rangeDone(origin, budget, range);
+    }, Qt::QueuedConnection);
+}
+
+void QGeoReachableRangeReplyTomTom::addRequest(QNetworkReply *reply, int origin, int budget)
+{
+    m_requests.insert(reply, qMakePair(origin, budget));
+    connect(reply, &QNetworkReply::finished, this, &QGeoReachableRangeReplyTomTom::onNetworkReplyFinished);
+}
+
+void QGeoReachableRangeReplyTomTom::abort()
+{
+    if (m_finished)
+        return;
+    m_finished = true;
+    cancelRequests();
+    emit aborted();
+}
+
+void QGeoReachableRangeReplyTomTom::cancelRequests()
+{
+    const QList<QNetworkReply *> replies = m_requests.keys();
+    m_requests.clear();
+    for (QNetworkReply *reply: replies) {
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+    }
+}
+
+void QGeoReachableRangeReplyTomTom::onNetworkReplyFinished()
+{
+    QNetworkReply *reply = static_cast<QNetworkReply *>(sender());
+    reply->deleteLater();
+    const QPair<int, int> item = m_requests.take(reply);
+    if (m_finished)
+        return;
+
+    if (reply->error() != QNetworkReply::NoError) {
+        setError(QGeoRouteReply::CommunicationError, reply->errorString());
+        return;
+    }
+
+    const QByteArray payload = reply->readAll();
+    QTomTomCommon::parseInBackground(this, [this, payload, item]() -> std::function<void()> {
+        QList<QGeoCoordinate> boundary;
+        QTomTomJsonReader reader(payload);
+        if (reader.next() == QTomTomJsonReader::BeginObject) {
+            while (reader.next() == QTomTomJsonReader::Name) {
+                if (!reader.isName("reachableRange")) {
+                    reader.skipValue();
+                    continue;
+                }
+                if (reader.next() != QTomTomJsonReader::BeginObject) {
+                    reader.skipCurrent();
+                    continue;
+                }
+                while (reader.next() == QTomTomJsonReader::Name) {
+                    if (!reader.isName("boundary")) {
+                        reader.skipValue();
+                        continue;
+                    }
+                    if (reader.next() != QTomTomJsonReader::BeginArray) {
+                        reader.skipCurrent();
+                        continue;
+                    }
+                    while (reader.next() == QTomTomJsonReader::BeginObject) {
+                        QGeoCoordinate c;
+                        while (reader.next() == QTomTomJsonReader::Name) {
+                            if (reader.isName("latitude")) {
+                                reader.next();
+                                c.setLatitude(reader.number());
+                            } else if (reader.isName("longitude")) {
+                                reader.next();
+                                c.setLongitude(reader.number());
+                            } else {
+                                reader.skipValue();
+                            }
+                        }
+                        boundary.append(c);
+                    }
+                }
+            }
+        }
+
+        QString errorString;
+        if (reader.hasError())
+            errorString = reader.errorString();
+        else if (boundary.size() < 3)
+            errorString = QStringLiteral("No reachable range boundary");
+        const QGeoPolygon range(boundary);
+
+        return [this, item, range, errorString]() {
+            if (m_finished)
+                return;
+            if (!errorString.isEmpty())
+                setError(QGeoRouteReply::ParseError, errorString);
+            else
+                rangeDone(item.first, item.second, range);
+        };
+    });
+}
+
+void QGeoReachableRangeReplyTomTom::rangeDone(int origin, int budget, const QGeoPolygon &range)
+{
+    if (m_finished)
+        return;
+    m_ranges[origin * m_budgets + budget] = range;
+    emit rangeCalculated(origin, budget, range);
+    if (--m_pending == 0) {
+        m_finished = true;
+        emit finished();
+    }
+}
+
+void QGeoReachableRangeReplyTomTom::setError(QGeoRouteReply::Error error, const QString &errorString)
+{
+    if (m_finished)
+        return;
+    m_finished = true;
+    m_error = error;
+    m_errorString = errorString;
+    cancelRequests();
+    emit this->error(error, errorString);
+    emit finished();
+}
+
+QT_END_NAMESPACE
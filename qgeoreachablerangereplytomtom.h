@@ -0,0 +1,93 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#ifndef QGEOREACHABLERANGEREPLYTOMTOM_H
+#define QGEOREACHABLERANGEREPLYTOMTOM_H
+
+#include <QtNetwork/QNetworkReply>
+#include <QtLocation/QGeoRouteReply>
+#include <QtPositioning/QGeoPolygon>
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+#include <QtCore/QVector>
+
+QT_BEGIN_NAMESPACE
+
+/*
+    Areas reachable from a set of origins within a set of budgets, one polygon per
+    origin and budget, computed by the reachable range service. All ranges are requested
+    at once, and reported as they arrive.
+*/
+class QGeoReachableRangeReplyTomTom : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum BudgetType {
+        TimeBudget,     // seconds
+        DistanceBudget, // meters
+        EnergyBudget,   // kWh, requires an electric consumption model
+        FuelBudget      // liters, requires a combustion consumption model
+    };
+    Q_ENUM(BudgetType)
+
+    QGeoReachableRangeReplyTomTom(int origins, int budgets, QObject *parent = nullptr);
+    ~QGeoReachableRangeReplyTomTom();
+
+    int originCount() const;
+    int budgetCount() const;
+    QGeoPolygon range(int origin, int budget) const;
+    bool isFinished() const;
+    QGeoRouteReply::Error error() const;
+    QString errorString() const;
+
+    void addRange(int origin, int budget, const QGeoPolygon &range);
+    void addRequest(QNetworkReply *reply, int origin, int budget);
+
+public Q_SLOTS:
+    void abort();
+
+Q_SIGNALS:
+    void rangeCalculated(int origin, int budget, const QGeoPolygon &range);
+    void finished();
+    void error(QGeoRouteReply::Error error, const QString &errorString);
+    void aborted();
+
+private Q_SLOTS:
+    void onNetworkReplyFinished();
+
+private:
+    void rangeDone(int origin, int budget, const QGeoPolygon &range);
+    void setError(QGeoRouteReply::Error error, const QString &errorString);
+    void cancelRequests();
+
+    int m_origins;
+    int m_budgets;
+    QVector<QGeoPolygon> m_ranges;
+    QHash<QNetworkReply *, QPair<int, int>> m_requests;
+    int m_pending;
+    bool m_finished = false;
+    QGeoRouteReply::Error m_error = QGeoRouteReply::NoError;
+    QString m_errorString;
+};
+
+QT_END_NAMESPACE
+
+#endif // QGEOREACHABLERANGEREPLYTOMTOM_H
@@ -0,0 +1,232 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#include "qgeoroutebatchreplytomtom.h"
+#include "qgeoroutetomtom.h"
+#include "qtomtomcommon.h"
+#include "qtomtomjsonreader.h"
+#include <QtLocation/private/qgeorouteparser_p.h>
+#include <QtCore/QDebug>
+
+QT_BEGIN_NAMESPACE
+
+QGeoRouteBatchReplyTomTom::QGeoRouteBatchReplyTomTom(const QList<QGeoRouteRequest> &requests,
+                                                     const QGeoRouteParser *parser,
+                                                     QObject *parent)
+    : QObject(parent), m_requests(requests), m_parser(parser)
+{
+}
+
+QGeoRouteBatchReplyTomTom::~QGeoRouteBatchReplyTomTom()
+{
+    for (auto it = m_batches.cbegin(); it != m_batches.cend(); ++it) {
+        it.key()->disconnect(this);
+        it.key()->abort();
+        it.key()->deleteLater();
+    }
+}
+
+QList<QGeoRouteRequest> QGeoRouteBatchReplyTomTom::requests() const
+{
+    return m_requests;
+}
+
+int QGeoRouteBatchReplyTomTom::count() const
+{
+    return m_requests.size();
+}
+
+int QGeoRouteBatchReplyTomTom::completedCount() const
+{
+    return m_completed;
+}
+
+bool QGeoRouteBatchReplyTomTom::isFinished() const
+{
+    return m_aborted || m_completed == m_requests.size();
+}
+
+/*
+    Takes over the reply to the submission of requests [first, first + count).
+*/
+void QGeoRouteBatchReplyTomTom::addBatch(QNetworkReply *reply, int first, int count)
+{
+    watch(reply, Batch{first, count});
+}
+
+void QGeoRouteBatchReplyTomTom::abort()
+{
+    if (isFinished())
+        return;
+    m_aborted = true;
+    const QList<QNetworkReply *> replies = m_batches.keys();
+    m_batches.clear();
+    for (QNetworkReply *reply: replies) {
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+    }
+    emit aborted();
+}
+
+void QGeoRouteBatchReplyTomTom::watch(QNetworkReply *reply, const Batch &batch)
+{
+    m_batches.insert(reply, batch);
+    connect(reply, &QNetworkReply::finished, this, &QGeoRouteBatchReplyTomTom::onNetworkReplyFinished);
+}
+
+/*
+    The submission answers 202 with the download location in the Location header.
+    Downloading answers 202 again while the batch is still being processed, and 200 with
+    the results once it is done. Small batches may be answered with 200 right away.
+*/
+void QGeoRouteBatchReplyTomTom::onNetworkReplyFinished()
+{
+    QNetworkReply *reply = static_cast<QNetworkReply *>(sender());
+    reply->deleteLater();
+    const Batch batch = m_batches.take(reply);
+    if (m_aborted)
+        return;
+
+    if (reply->error() != QNetworkReply::NoError) {
+        batchFailed(batch, QGeoRouteReply::CommunicationError, reply->errorString());
+        return;
+    }
+
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status == 202) {
+        watch(QTomTomCommon::downloadAsyncResult(reply), batch);
+        return;
+    }
+    if (status != 200) {
+        batchFailed(batch, QGeoRouteReply::CommunicationError,
+                    QStringLiteral("Unexpected batch status %1").arg(status));
+        return;
+    }
+    parseBatch(reply->readAll(), batch);
+}
+
+/*
+    Only cuts the batch into items, on the parser pool. The items are then parsed
+    independently, so that the first routes come out while the others are still parsing.
+*/
+void QGeoRouteBatchReplyTomTom::parseBatch(const QByteArray &payload, const Batch &batch)
+{
+    QTomTomCommon::parseInBackground(this, [this, payload, batch]() -> std::function<void()> {
+        QVector<int> statusCodes;
+        QVector<QByteArray> responses;
+        QString errorString;
+
+        QTomTomJsonReader reader(payload);
+        if (reader.next() == QTomTomJsonReader::BeginObject) {
+            while (reader.next() == QTomTomJsonReader::Name) {
+                if (!reader.isName("batchItems")) {
+                    reader.skipValue();
+                    continue;
+                }
+                if (reader.next() != QTomTomJsonReader::BeginArray) {
+                    reader.skipCurrent();
+                    continue;
+                }
+                while (reader.next() == QTomTomJsonReader::BeginObject) {
+                    int statusCode = 0;
+                    QByteArray response;
+                    while (reader.next() == QTomTomJsonReader::Name) {
+                        if (reader.isName("statusCode")) {
+                            reader.next();
+                            statusCode = reader.toInt();
+                        } else if (reader.isName("response")) {
+                            response = reader.rawValue();
+                        } else {
+                            reader.skipValue();
+                        }
+                    }
+                    statusCodes.append(statusCode);
+                    responses.append(response);
+                }
+            }
+        }
+        if (reader.hasError())
+            errorString = reader.errorString();
+        else if (statusCodes.size() != batch.count)
+            errorString = QStringLiteral("Batch returned %1 items out of %2").arg(statusCodes.size()).arg(batch.count);
+
+        return [this, batch, statusCodes, responses, errorString]() {
+            if (!errorString.isEmpty()) {
+                batchFailed(batch, QGeoRouteReply::ParseError, errorString);
+                return;
+            }
+            for (int i = 0; i < batch.count; ++i) {
+                if (statusCodes.at(i) == 200) {
+                    parseItem(batch.first + i, responses.at(i));
+                } else {
+                    emit routeError(batch.first + i, QGeoRouteReply::CommunicationError,
+                                    QStringLiteral("Batch item failed with status %1").arg(statusCodes.at(i)));
+                    itemDone();
+                }
+            }
+        };
+    });
+}
+
+void QGeoRouteBatchReplyTomTom::parseItem(int index, const QByteArray &response)
+{
+    const QGeoRouteParser *parser = m_parser;
+    const QGeoRouteRequest request = m_requests.at(index);
+    QTomTomCommon::parseInBackground(this, [this, parser, index, request, response]() -> std::function<void()> {
+        QList<QGeoRoute> routes;
+        QString errorString;
+        const QGeoRouteReply::Error error = parser->parseReply(routes, errorString, response, request);
+
+        QList<QGeoRoute> georoutes;
+        for (const QGeoRoute &route : routes.mid(0, request.numberAlternativeRoutes() + 1)) {
+            QGeoRouteTomTom georoute(route, QVariantMap());
+            georoute.setRequest(request);
+            for (QGeoRoute &leg: georoute.routeLegs())
+                leg.setRequest(request);
+            georoutes.append(georoute);
+        }
+
+        return [this, index, error, errorString, georoutes]() {
+            if (error == QGeoRouteReply::NoError)
+                emit routesCalculated(index, georoutes);
+            else
+                emit routeError(index, error, errorString);
+            itemDone();
+        };
+    });
+}
+
+void QGeoRouteBatchReplyTomTom::batchFailed(const Batch &batch, QGeoRouteReply::Error error,
+                                           const QString &errorString)
+{
+    for (int i = 0; i < batch.count; ++i) {
+        emit routeError(batch.first + i, error, errorString);
+        itemDone();
+    }
+}
+
+void QGeoRouteBatchReplyTomTom::itemDone()
+{
+    if (++m_completed == m_requests.size())
+        emit finished();
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,89 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#ifndef QGEOROUTEBATCHREPLYTOMTOM_H
+#define QGEOROUTEBATCHREPLYTOMTOM_H
+
+#include <QtNetwork/QNetworkReply>
+#include <QtLocation/QGeoRouteReply>
+#include <QtLocation/QGeoRouteRequest>
+#include <QtLocation/QGeoRoute>
+#include <QtCore/QHash>
+
+QT_BEGIN_NAMESPACE
+
+class QGeoRouteParser;
+
+/*
+    Results of many independent route requests, computed through the asynchronous batch
+    routing service. Requests are submitted in several batches at once, and the routes of each
+    request are reported, by index, as soon as they are parsed.
+*/
+class QGeoRouteBatchReplyTomTom : public QObject
+{
+    Q_OBJECT
+
+public:
+    QGeoRouteBatchReplyTomTom(const QList<QGeoRouteRequest> &requests, const QGeoRouteParser *parser,
+                              QObject *parent = nullptr);
+    ~QGeoRouteBatchReplyTomTom();
+
+    QList<QGeoRouteRequest> requests() const;
+    int count() const;
+    int completedCount() const;
+    bool isFinished() const;
+
+    void addBatch(QNetworkReply *reply, int first, int count);
+
+public Q_SLOTS:
+    void abort();
+
+Q_SIGNALS:
+    void routesCalculated(int index, const QList<QGeoRoute> &routes);
+    void routeError(int index, QGeoRouteReply::Error error, const QString &errorString);
+    void finished();
+    void aborted();
+
+private Q_SLOTS:
+    void onNetworkReplyFinished();
+
+private:
+    struct Batch
+    {
+        int first;
+        int count;
+    };
+
+    void watch(QNetworkReply *reply, const Batch &batch);
+    void parseBatch(const QByteArray &payload, const Batch &batch);
+    void parseItem(int index, const QByteArray &response);
+    void batchFailed(const Batch &batch, QGeoRouteReply::Error error, const QString &errorString);
+    void itemDone();
+
+    QList<QGeoRouteRequest> m_requests;
+    const QGeoRouteParser *m_parser;
+    QHash<QNetworkReply *, Batch> m_batches;
+    int m_completed = 0;
+    bool m_aborted = false;
+};
+
+QT_END_NAMESPACE
+
+#endif // QGEOROUTEBATCHREPLYTOMTOM_H
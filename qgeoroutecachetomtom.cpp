@@ -0,0 +1,267 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#include "qgeoroutecachetomtom.h"
+#include "qtomtomcommon.h"
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QFileInfo>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QRunnable>
+#include <QtCore/QSaveFile>
+#include <QtCore/QDebug>
+#include <algorithm>
+
+QT_BEGIN_NAMESPACE
+
+namespace {
+
+// Waypoints closer than ~1m share the cached route
+const int kWaypointDecimals = 5;
+// Origins within the same ~100m cell share the cached reachable range
+const int kRangeOriginDecimals = 3;
+
+class QGeoRouteCacheWriteTaskTomTom : public QRunnable
+{
+public:
+    QGeoRouteCacheWriteTaskTomTom(const QString &path, const QByteArray &payload)
+        : m_path(path), m_payload(payload) {}
+
+    void run() override
+    {
+        QSaveFile file(m_path);
+        if (!file.open(QIODevice::WriteOnly)
+                || file.write(m_payload) != m_payload.size()
+                || !file.commit()) {
+            qWarning() << "QGeoRouteCacheTomTom: failed to write" << m_path << file.errorString();
+        }
+    }
+
+private:
+    QString m_path;
+    QByteArray m_payload;
+};
+
+class QGeoRouteCachePruneTaskTomTom : public QRunnable
+{
+public:
+    QGeoRouteCachePruneTaskTomTom(const QString &directory, int timeToLive)
+        : m_directory(directory), m_timeToLive(timeToLive) {}
+
+    void run() override
+    {
+        const QDateTime oldest = QDateTime::currentDateTimeUtc().addSecs(-m_timeToLive);
+        QDirIterator it(m_directory, QStringList() << QStringLiteral("*.json"), QDir::Files);
+        while (it.hasNext()) {
+            it.next();
+            if (it.fileInfo().lastModified() < oldest)
+                QFile::remove(it.filePath());
+        }
+    }
+
+private:
+    QString m_directory;
+    int m_timeToLive;
+};
+
+} // namespace
+
+QGeoRouteCacheTomTom::QGeoRouteCacheTomTom(const QString &directory)
+    : m_directory(directory)
+{
+    m_memory.setMaxCost(64);
+    m_ranges.setMaxCost(64);
+    if (!m_directory.isEmpty())
+        QDir::root().mkpath(m_directory);
+}
+
+void QGeoRouteCacheTomTom::setTimeToLive(int seconds)
+{
+    m_ttl = qMax(0, seconds);
+}
+
+void QGeoRouteCacheTomTom::setTrafficTimeToLive(int seconds)
+{
+    m_trafficTtl = qMax(0, seconds);
+}
+
+void QGeoRouteCacheTomTom::setMaxMemoryEntries(int entries)
+{
+    m_memory.setMaxCost(qMax(0, entries));
+    m_ranges.setMaxCost(qMax(0, entries));
+}
+
+/*
+    Everything that changes the reply goes into the key, in a fixed order.
+    Waypoints are quantized, and the extra parameters serialized with sorted keys,
+    so that equivalent requests built differently still match.
+*/
+QByteArray QGeoRouteCacheTomTom::key(const QGeoRouteRequest &request, const QByteArray &language)
+{
+    QByteArray key = QByteArrayLiteral("1");
+    key += QByteArrayLiteral("|w=");
+    for (const QGeoCoordinate &w: request.waypoints()) {
+        key += QByteArray::number(w.latitude(), 'f', kWaypointDecimals) + ','
+             + QByteArray::number(w.longitude(), 'f', kWaypointDecimals) + ':';
+    }
+    key += QByteArrayLiteral("|m=") + QByteArray::number(int(request.travelModes()));
+    key += QByteArrayLiteral("|a=") + QByteArray::number(request.numberAlternativeRoutes());
+    key += QByteArrayLiteral("|o=") + QByteArray::number(int(request.routeOptimization()));
+    key += QByteArrayLiteral("|s=") + QByteArray::number(int(request.segmentDetail()))
+         + ',' + QByteArray::number(int(request.maneuverDetail()));
+    key += QByteArrayLiteral("|l=") + language;
+
+    QList<QGeoRouteRequest::FeatureType> features = request.featureTypes();
+    std::sort(features.begin(), features.end());
+    key += QByteArrayLiteral("|f=");
+    for (QGeoRouteRequest::FeatureType f: qAsConst(features))
+        key += QByteArray::number(int(f)) + ':' + QByteArray::number(int(request.featureWeight(f))) + ',';
+
+    const QVariantMap extra = request.extraParameters();
+    if (!extra.isEmpty())
+        key += QByteArrayLiteral("|x=") + QJsonDocument::fromVariant(extra).toJson(QJsonDocument::Compact);
+    return key;
+}
+
+/*
+    TomTom routes motorized travel with live traffic by default,
+    so those travel times go stale much sooner than the geometry.
+*/
+bool QGeoRouteCacheTomTom::isTrafficSensitive(const QGeoRouteRequest &request)
+{
+    if (request.featureWeight(QGeoRouteRequest::TrafficFeature) == QGeoRouteRequest::AvoidFeatureWeight)
+        return false;
+    return request.travelModes() & (QGeoRouteRequest::CarTravel | QGeoRouteRequest::TruckTravel);
+}
+
+/*
+    budget is the budget query item, e.g. "timeBudgetInSec=600". Only the options
+    sent to the reachable range service take part in the key.
+*/
+QByteArray QGeoRouteCacheTomTom::rangeKey(const QGeoCoordinate &origin, const QByteArray &budget,
+                                          const QGeoRouteRequest &options)
+{
+    QByteArray key = QByteArrayLiteral("r1");
+    key += QByteArrayLiteral("|c=") + QByteArray::number(origin.latitude(), 'f', kRangeOriginDecimals) + ','
+         + QByteArray::number(origin.longitude(), 'f', kRangeOriginDecimals);
+    key += QByteArrayLiteral("|b=") + budget;
+    key += QByteArrayLiteral("|m=") + QByteArray::number(int(options.travelModes()));
+    key += QByteArrayLiteral("|o=") + QByteArray::number(int(options.routeOptimization()));
+    key += QByteArrayLiteral("|t=") + QByteArray::number(int(options.featureWeight(QGeoRouteRequest::TrafficFeature)));
+    const QVariantMap extra = options.extraParameters();
+    if (!extra.isEmpty())
+        key += QByteArrayLiteral("|x=") + QJsonDocument::fromVariant(extra).toJson(QJsonDocument::Compact);
+    return key;
+}
+
+bool QGeoRouteCacheTomTom::routes(const QByteArray &key, bool traffic, QList<QGeoRoute> *routes)
+{
+    if (!timeToLive(traffic))
+        return false;
+    Entry *entry = m_memory.object(key);
+    if (!entry)
+        return false;
+    if (entry->expiry < QDateTime::currentMSecsSinceEpoch()) {
+        m_memory.remove(key);
+        return false;
+    }
+    *routes = entry->routes;
+    return true;
+}
+
+/*
+    Path of the cached reply for key, if there is one that has not yet expired.
+    Expiry is based on the modification time, so the payload is stored as is.
+*/
+QString QGeoRouteCacheTomTom::file(const QByteArray &key, bool traffic) const
+{
+    const int ttl = timeToLive(traffic);
+    if (!ttl || m_directory.isEmpty())
+        return QString();
+    const QString path = filePath(key);
+    const QFileInfo info(path);
+    if (!info.exists() || info.lastModified().addSecs(ttl) < QDateTime::currentDateTimeUtc())
+        return QString();
+    return path;
+}
+
+void QGeoRouteCacheTomTom::insert(const QByteArray &key, bool traffic, const QList<QGeoRoute> &routes,
+                                  const QByteArray &payload)
+{
+    const int ttl = timeToLive(traffic);
+    if (!ttl)
+        return;
+    if (m_memory.maxCost() > 0) {
+        const qint64 expiry = QDateTime::currentMSecsSinceEpoch() + qint64(ttl) * 1000;
+        m_memory.insert(key, new Entry{routes, expiry});
+    }
+    if (!m_directory.isEmpty() && !payload.isEmpty())
+        QTomTomCommon::parserPool()->start(new QGeoRouteCacheWriteTaskTomTom(filePath(key), payload));
+}
+
+bool QGeoRouteCacheTomTom::range(const QByteArray &key, bool traffic, QGeoPolygon *range)
+{
+    if (!timeToLive(traffic))
+        return false;
+    RangeEntry *entry = m_ranges.object(key);
+    if (!entry)
+        return false;
+    if (entry->expiry < QDateTime::currentMSecsSinceEpoch()) {
+        m_ranges.remove(key);
+        return false;
+    }
+    *range = entry->range;
+    return true;
+}
+
+void QGeoRouteCacheTomTom::insertRange(const QByteArray &key, bool traffic, const QGeoPolygon &range)
+{
+    const int ttl = timeToLive(traffic);
+    if (!ttl || m_ranges.maxCost() <= 0)
+        return;
+    const qint64 expiry = QDateTime::currentMSecsSinceEpoch() + qint64(ttl) * 1000;
+    m_ranges.insert(key, new RangeEntry{range, expiry});
+}
+
+int QGeoRouteCacheTomTom::timeToLive(bool traffic) const
+{
+    return (traffic) ? qMin(m_trafficTtl, m_ttl) : m_ttl;
+}
+
+QString QGeoRouteCacheTomTom::filePath(const QByteArray &key) const
+{
+    return m_directory + QLatin1Char('/')
+            + QString::fromLatin1(QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex())
+            + QLatin1String(".json");
+}
+
+/*
+    Removes the replies on disk older than the longest time to live, in the background.
+*/
+void QGeoRouteCacheTomTom::prune()
+{
+    if (m_directory.isEmpty())
+        return;
+    QTomTomCommon::parserPool()->start(new QGeoRouteCachePruneTaskTomTom(m_directory, m_ttl));
+}
+
+QT_END_NAMESPACE
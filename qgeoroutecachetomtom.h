@@ -0,0 +1,85 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#ifndef QGEOROUTECACHETOMTOM_H
+#define QGEOROUTECACHETOMTOM_H
+
+#include <QtLocation/QGeoRoute>
+#include <QtLocation/QGeoRouteRequest>
+#include <QtPositioning/QGeoPolygon>
+#include <QtCore/QCache>
+#include <QtCore/QString>
+
+QT_BEGIN_NAMESPACE
+
+/*
+    Calculated routes, keyed by a normalized route request.
+    Parsed routes are kept in memory, and the raw replies on disk, if a directory is set.
+    Reachable ranges are kept in memory only, keyed by origin cell and budget.
+    Results that depend on live traffic expire after their own, shorter, time to live.
+    A time to live of 0 disables caching for that kind of result.
+*/
+class QGeoRouteCacheTomTom
+{
+public:
+    QGeoRouteCacheTomTom(const QString &directory);
+
+    void setTimeToLive(int seconds);
+    void setTrafficTimeToLive(int seconds);
+    void setMaxMemoryEntries(int entries);
+
+    static QByteArray key(const QGeoRouteRequest &request, const QByteArray &language);
+    static bool isTrafficSensitive(const QGeoRouteRequest &request);
+    static QByteArray rangeKey(const QGeoCoordinate &origin, const QByteArray &budget,
+                               const QGeoRouteRequest &options);
+
+    bool routes(const QByteArray &key, bool traffic, QList<QGeoRoute> *routes);
+    QString file(const QByteArray &key, bool traffic) const;
+    void insert(const QByteArray &key, bool traffic, const QList<QGeoRoute> &routes, const QByteArray &payload);
+    void prune();
+
+    bool range(const QByteArray &key, bool traffic, QGeoPolygon *range);
+    void insertRange(const QByteArray &key, bool traffic, const QGeoPolygon &range);
+
+private:
+    struct Entry
+    {
+        QList<QGeoRoute> routes;
+        qint64 expiry;
+    };
+    struct RangeEntry
+    {
+        QGeoPolygon range;
+        qint64 expiry;
+    };
+
+    int timeToLive(bool traffic) const;
+    QString filePath(const QByteArray &key) const;
+
+    QString m_directory;
+    QCache<QByteArray, Entry> m_memory;
+    QCache<QByteArray, RangeEntry> m_ranges;
+    int m_ttl = 86400;
+    int m_trafficTtl = 300;
+};
+
+QT_END_NAMESPACE
+
+#endif // QGEOROUTECACHETOMTOM_H
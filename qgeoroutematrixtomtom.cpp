@@ -0,0 +1,274 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#include "qgeoroutematrixtomtom.h"
+#include "qtomtomcommon.h"
+#include "qtomtomjsonreader.h"
+
+QT_BEGIN_NAMESPACE
+
+QGeoRouteMatrixTomTom::QGeoRouteMatrixTomTom(int origins, int destinations)
+    : m_origins(origins),
+      m_destinations(destinations),
+      m_travelTimes(origins * destinations, -1),
+      m_distances(origins * destinations, -1)
+{
+}
+
+int QGeoRouteMatrixTomTom::originCount() const
+{
+    return m_origins;
+}
+
+int QGeoRouteMatrixTomTom::destinationCount() const
+{
+    return m_destinations;
+}
+
+bool QGeoRouteMatrixTomTom::isValid(int origin, int destination) const
+{
+    return travelTime(origin, destination) >= 0;
+}
+
+int QGeoRouteMatrixTomTom::travelTime(int origin, int destination) const
+{
+    return m_travelTimes.at(origin * m_destinations + destination);
+}
+
+int QGeoRouteMatrixTomTom::distance(int origin, int destination) const
+{
+    return m_distances.at(origin * m_destinations + destination);
+}
+
+void QGeoRouteMatrixTomTom::set(int origin, int destination, int travelTime, int distance)
+{
+    m_travelTimes[origin * m_destinations + destination] = travelTime;
+    m_distances[origin * m_destinations + destination] = distance;
+}
+
+QGeoRouteMatrixReplyTomTom::QGeoRouteMatrixReplyTomTom(int origins, int destinations, QObject *parent)
+    : QObject(parent), m_matrix(origins, destinations)
+{
+    // Nothing to compute: finished already, the signal follows once connected to
+    if (!origins || !destinations) {
+        m_finished = true;
+        QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection);
+    }
+}
+
+QGeoRouteMatrixReplyTomTom::~QGeoRouteMatrixReplyTomTom()
+{
+    cancelTiles();
+}
+
+QGeoRouteMatrixTomTom QGeoRouteMatrixReplyTomTom::matrix() const
+{
+    return m_matrix;
+}
+
+bool QGeoRouteMatrixReplyTomTom::isFinished() const
+{
+    return m_finished;
+}
+
+QGeoRouteReply::Error QGeoRouteMatrixReplyTomTom::error() const
+{
+    return m_error;
+}
+
+QString QGeoRouteMatrixReplyTomTom::errorString() const
+{
+    return m_errorString;
+}
+
+/*
+    Takes over the reply to the submission of the given tile of the matrix.
+*/
+void QGeoRouteMatrixReplyTomTom::addTile(QNetworkReply *reply, int firstOrigin, int origins,
+                                         int firstDestination, int destinations)
+{
+    ++m_pendingTiles;
+    watch(reply, Tile{firstOrigin, origins, firstDestination, destinations});
+}
+
+void QGeoRouteMatrixReplyTomTom::abort()
+{
+    if (m_finished)
+        return;
+    m_finished = true;
+    cancelTiles();
+    emit aborted();
+}
+
+void QGeoRouteMatrixReplyTomTom::cancelTiles()
+{
+    const QList<QNetworkReply *> replies = m_tiles.keys();
+    m_tiles.clear();
+    for (QNetworkReply *reply: replies) {
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+    }
+}
+
+void QGeoRouteMatrixReplyTomTom::watch(QNetworkReply *reply, const Tile &tile)
+{
+    m_tiles.insert(reply, tile);
+    connect(reply, &QNetworkReply::finished, this, &QGeoRouteMatrixReplyTomTom::onNetworkReplyFinished);
+}
+
+void QGeoRouteMatrixReplyTomTom::onNetworkReplyFinished()
+{
+    QNetworkReply *reply = static_cast<QNetworkReply *>(sender());
+    reply->deleteLater();
+    const Tile tile = m_tiles.take(reply);
+    if (m_finished)
+        return;
+
+    if (reply->error() != QNetworkReply::NoError) {
+        setError(QGeoRouteReply::CommunicationError, reply->errorString());
+        return;
+    }
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status == 202) {
+        watch(QTomTomCommon::downloadAsyncResult(reply), tile);
+        return;
+    }
+    if (status != 200) {
+        setError(QGeoRouteReply::CommunicationError, QStringLiteral("Unexpected matrix status %1").arg(status));
+        return;
+    }
+    parseTile(reply->readAll(), tile);
+}
+
+/*
+    A tile is read on the parser pool into flat arrays, then copied into the matrix.
+    Cells are expected in the order of the request; those without a route are left at -1.
+*/
+void QGeoRouteMatrixReplyTomTom::parseTile(const QByteArray &payload, const Tile &tile)
+{
+    QTomTomCommon::parseInBackground(this, [this, payload, tile]() -> std::function<void()> {
+        const int cells = tile.origins * tile.destinations;
+        QVector<qint32> travelTimes(cells, -1);
+        QVector<qint32> distances(cells, -1);
+        int row = 0;
+        int cell = 0;
+
+        QTomTomJsonReader reader(payload);
+        if (reader.next() == QTomTomJsonReader::BeginObject) {
+            while (reader.next() == QTomTomJsonReader::Name) {
+                if (!reader.isName("matrix")) {
+                    reader.skipValue();
+                    continue;
+                }
+                if (reader.next() != QTomTomJsonReader::BeginArray) {
+                    reader.skipCurrent();
+                    continue;
+                }
+                for (row = 0; reader.next() == QTomTomJsonReader::BeginArray; ++row) {
+                    for (int column = 0; reader.next() == QTomTomJsonReader::BeginObject; ++column) {
+                        int statusCode = 0;
+                        int travelTime = -1;
+                        int distance = -1;
+                        while (reader.next() == QTomTomJsonReader::Name) {
+                            if (reader.isName("statusCode")) {
+                                reader.next();
+                                statusCode = reader.toInt();
+                            } else if (reader.isName("response")) {
+                                if (reader.next() != QTomTomJsonReader::BeginObject) {
+                                    reader.skipCurrent();
+                                    continue;
+                                }
+                                while (reader.next() == QTomTomJsonReader::Name) {
+                                    if (!reader.isName("routeSummary")) {
+                                        reader.skipValue();
+                                        continue;
+                                    }
+                                    if (reader.next() != QTomTomJsonReader::BeginObject) {
+                                        reader.skipCurrent();
+                                        continue;
+                                    }
+                                    while (reader.next() == QTomTomJsonReader::Name) {
+                                        if (reader.isName("travelTimeInSeconds")) {
+                                            reader.next();
+                                            travelTime = reader.toInt();
+                                        } else if (reader.isName("lengthInMeters")) {
+                                            reader.next();
+                                            distance = reader.toInt();
+                                        } else {
+                                            reader.skipValue();
+                                        }
+                                    }
+                                }
+                            } else {
+                                reader.skipValue();
+                            }
+                        }
+                        if (row < tile.origins && column < tile.destinations && statusCode == 200) {
+                            travelTimes[row * tile.destinations + column] = travelTime;
+                            distances[row * tile.destinations + column] = distance;
+                        }
+                        ++cell;
+                    }
+                }
+            }
+        }
+
+        QString errorString;
+        if (reader.hasError())
+            errorString = reader.errorString();
+        else if (cell != cells)
+            errorString = QStringLiteral("Matrix returned %1 cells out of %2").arg(cell).arg(cells);
+
+        return [this, tile, travelTimes, distances, errorString]() {
+            if (m_finished)
+                return;
+            if (!errorString.isEmpty()) {
+                setError(QGeoRouteReply::ParseError, errorString);
+                return;
+            }
+            for (int o = 0; o < tile.origins; ++o) {
+                for (int d = 0; d < tile.destinations; ++d) {
+                    const int i = o * tile.destinations + d;
+                    m_matrix.set(tile.firstOrigin + o, tile.firstDestination + d,
+                                 travelTimes.at(i), distances.at(i));
+                }
+            }
+            if (--m_pendingTiles == 0) {
+                m_finished = true;
+                emit finished();
+            }
+        };
+    });
+}
+
+void QGeoRouteMatrixReplyTomTom::setError(QGeoRouteReply::Error error, const QString &errorString)
+{
+    if (m_finished)
+        return;
+    m_finished = true;
+    m_error = error;
+    m_errorString = errorString;
+    cancelTiles();
+    emit this->error(error, errorString);
+    emit finished();
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,111 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#ifndef QGEOROUTEMATRIXTOMTOM_H
+#define QGEOROUTEMATRIXTOMTOM_H
+
+#include <QtNetwork/QNetworkReply>
+#include <QtLocation/QGeoRouteReply>
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+
+QT_BEGIN_NAMESPACE
+
+/*
+    Travel times and distances from each origin to each destination, without geometry.
+    Stored densely, row major by origin. Cells without a route hold -1.
+*/
+class QGeoRouteMatrixTomTom
+{
+public:
+    QGeoRouteMatrixTomTom(int origins = 0, int destinations = 0);
+
+    int originCount() const;
+    int destinationCount() const;
+
+    bool isValid(int origin, int destination) const;
+    int travelTime(int origin, int destination) const;
+    int distance(int origin, int destination) const;
+
+    void set(int origin, int destination, int travelTime, int distance);
+
+private:
+    int m_origins;
+    int m_destinations;
+    QVector<qint32> m_travelTimes;
+    QVector<qint32> m_distances;
+};
+
+/*
+    A matrix computed through the asynchronous matrix routing service.
+    Matrices larger than the service allows are split into tiles of origins and
+    destinations, all submitted at once, and assembled as they complete.
+*/
+class QGeoRouteMatrixReplyTomTom : public QObject
+{
+    Q_OBJECT
+
+public:
+    QGeoRouteMatrixReplyTomTom(int origins, int destinations, QObject *parent = nullptr);
+    ~QGeoRouteMatrixReplyTomTom();
+
+    QGeoRouteMatrixTomTom matrix() const;
+    bool isFinished() const;
+    QGeoRouteReply::Error error() const;
+    QString errorString() const;
+
+    void addTile(QNetworkReply *reply, int firstOrigin, int origins, int firstDestination, int destinations);
+
+public Q_SLOTS:
+    void abort();
+
+Q_SIGNALS:
+    void finished();
+    void error(QGeoRouteReply::Error error, const QString &errorString);
+    void aborted();
+
+private Q_SLOTS:
+    void onNetworkReplyFinished();
+
+private:
+    struct Tile
+    {
+        int firstOrigin;
+        int origins;
+        int firstDestination;
+        int destinations;
+    };
+
+    void watch(QNetworkReply *reply, const Tile &tile);
+    void parseTile(const QByteArray &payload, const Tile &tile);
+    void setError(QGeoRouteReply::Error error, const QString &errorString);
+    void cancelTiles();
+
+    QGeoRouteMatrixTomTom m_matrix;
+    QHash<QNetworkReply *, Tile> m_tiles;
+    int m_pendingTiles = 0;
+    bool m_finished = false;
+    QGeoRouteReply::Error m_error = QGeoRouteReply::NoError;
+    QString m_errorString;
+};
+
+QT_END_NAMESPACE
+
+#endif // QGEOROUTEMATRIXTOMTOM_H
@@ -20,55 +20,18 @@
 
 #include "qgeoroutereplytomtom.h"
 #include "qgeoroutingmanagerenginetomtom.h"
+#include "qgeoroutetomtom.h"
+#include "qtomtomcommon.h"
 #include <QtLocation/private/qgeorouteparser_p.h>
-#include <QtLocation/private/qgeoroute_p.h>
+#include <QtLocation/private/qgeoroutesegment_p.h>
 #include <QtCore/QJsonDocument>
 #include <QtCore/QJsonObject>
 #include <QtCore/QJsonArray>
 #include <QtLocation/QGeoRouteSegment>
 #include <QtLocation/QGeoManeuver>
-
-namespace {
-
-class QGeoRouteTomTom : public QGeoRoute
-{
-public:
-    QGeoRouteTomTom(const QGeoRoute &other, const QVariantMap &metadata);
-};
-
-class QGeoRoutePrivateTomTom : public QGeoRoutePrivateDefault
-{
-public:
-    QGeoRoutePrivateTomTom(const QGeoRoutePrivateDefault &other, const QVariantMap &metadata);
-
-    virtual QString engineName() const override;
-    virtual QVariantMap metadata() const override;
-
-    QVariantMap m_metadata;
-};
-
-QGeoRouteTomTom::QGeoRouteTomTom(const QGeoRoute &other, const QVariantMap &metadata)
-    : QGeoRoute(QExplicitlySharedDataPointer<QGeoRoutePrivateTomTom>(new QGeoRoutePrivateTomTom(*static_cast<const QGeoRoutePrivateDefault *>(QGeoRoutePrivate::routePrivateData(other)), metadata)))
-{
-}
-
-QGeoRoutePrivateTomTom::QGeoRoutePrivateTomTom(const QGeoRoutePrivateDefault &other, const QVariantMap &metadata)
-    : QGeoRoutePrivateDefault(other)
-    , m_metadata(metadata)
-{
-}
-
-QString QGeoRoutePrivateTomTom::engineName() const
-{
-    return QLatin1String("tomtom");
-}
-
-QVariantMap QGeoRoutePrivateTomTom::metadata() const
-{
-    return m_metadata;
-}
-
-} // namespace
+#include <QtPositioning/QGeoPath>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
 
 QT_BEGIN_NAMESPACE
 
@@ -88,8 +51,72 @@ QGeoRouteReplyTomTom::QGeoRouteReplyTomTom(QNetworkReply *reply,
     connect(this, &QObject::destroyed, reply, &QObject::deleteLater);
 }
 
+/*
+    A reply completed from routes already in memory. It is finished on return,
+    as QGeoRoutingManager allows, so no signal reaches the caller.
+*/
+QGeoRouteReplyTomTom::QGeoRouteReplyTomTom(const QList<QGeoRoute> &routes,
+                                           const QGeoRouteRequest &request,
+                                           QObject *parent)
+:   QGeoRouteReply(request, parent)
+{
+    setRoutes(routes);
+    setFinished(true);
+}
+
+/*
+    A reply parsed from a reply previously stored on disk.
+*/
+QGeoRouteReplyTomTom::QGeoRouteReplyTomTom(const QString &cacheFile,
+                                           const QGeoRouteRequest &request,
+                                           QObject *parent)
+:   QGeoRouteReply(request, parent)
+{
+    parse(QByteArray(), cacheFile, QUrl());
+}
+
+/*
+    A reply for a request with more waypoints than a single calculateRoute accepts,
+    stitched from the replies of consecutive chunks of it. Chunks share their boundary
+    waypoint, and are all in flight at the same time.
+*/
+QGeoRouteReplyTomTom::QGeoRouteReplyTomTom(const QList<QGeoRouteReplyTomTom *> &parts,
+                                           const QGeoRouteRequest &request,
+                                           QObject *parent)
+:   QGeoRouteReply(request, parent)
+{
+    for (QGeoRouteReplyTomTom *part: parts) {
+        m_parts.append(part);
+        connect(part, &QGeoRouteReply::finished, this, &QGeoRouteReplyTomTom::onPartFinished);
+    }
+    connect(this, &QGeoRouteReply::aborted, this, &QGeoRouteReplyTomTom::abortParts);
+    // Parts served from the memory cache are finished already
+    onPartFinished();
+}
+
+/*
+    A reply for a route recalculated after a deviation from \a previous. Once the new
+    route is in, its segments from where it rejoins \a previous are replaced with those
+    of \a previous.
+*/
+QGeoRouteReplyTomTom::QGeoRouteReplyTomTom(QGeoRouteReplyTomTom *reroute,
+                                           const QGeoRoute &previous,
+                                           const QGeoRouteRequest &request,
+                                           QObject *parent)
+:   QGeoRouteReply(request, parent), m_previousRoute(previous), m_splice(true)
+{
+    m_parts.append(reroute);
+    connect(reroute, &QGeoRouteReply::finished, this, &QGeoRouteReplyTomTom::onPartFinished);
+    connect(this, &QGeoRouteReply::aborted, this, &QGeoRouteReplyTomTom::abortParts);
+    onPartFinished();
+}
+
 QGeoRouteReplyTomTom::~QGeoRouteReplyTomTom()
 {
+    for (const QPointer<QGeoRouteReplyTomTom> &part: qAsConst(m_parts)) {
+        if (part)
+            part->deleteLater();
+    }
 }
 
 void QGeoRouteReplyTomTom::onNetworkReplyFinished()
@@ -100,41 +127,322 @@ void QGeoRouteReplyTomTom::onNetworkReplyFinished()
     if (reply->error() != QNetworkReply::NoError)
         return;
 
+    parse(reply->readAll(), QString(), reply->url());
+}
+
+void QGeoRouteReplyTomTom::parse(const QByteArray &payload, const QString &cacheFile, const QUrl &queryUrl)
+{
     QGeoRoutingManagerEngineTomTom *engine = qobject_cast<QGeoRoutingManagerEngineTomTom *>(parent());
     const QGeoRouteParser *parser = engine->routeParser();
+    const QGeoRouteRequest routeRequest = request();
+    const bool includeJson = engine->m_includeJson;
+    const bool debugQuery = engine->m_debugQuery;
 
-    QList<QGeoRoute> routes;
-    QString errorString;
-
-    QByteArray routeReply = reply->readAll();
-    QGeoRouteReply::Error error = parser->parseReply(routes, errorString, routeReply, request());
-    // Setting the request into the result
-    for (QGeoRoute &route : routes) {
-        route.setRequest(request());
-        for (QGeoRoute &leg: route.routeLegs()) {
-            leg.setRequest(request());
+    // Routes can be large: parse them on the parser pool, and finish back on this thread.
+    QTomTomCommon::parseInBackground(this, [this, parser, payload, cacheFile, queryUrl, routeRequest,
+                                            includeJson, debugQuery]() -> std::function<void()> {
+        QByteArray routeReply = payload;
+        if (!cacheFile.isEmpty()) {
+            QFile file(cacheFile);
+            if (!file.open(QIODevice::ReadOnly)) {
+                const QString errorString = file.errorString();
+                return [this, errorString]() {
+                    setError(QGeoRouteReply::CommunicationError, errorString);
+                };
+            }
+            routeReply = file.readAll();
         }
-    }
 
-    QVariantMap metadata;
-    if (engine->m_includeJson)
-        metadata["tomtom.reply_json"] = routeReply;
-    if (engine->m_debugQuery)
-        metadata["tomtom.query_url"] = reply->url();
+        QVariantMap metadata;
+        if (includeJson)
+            metadata["tomtom.reply_json"] = routeReply;
+        if (debugQuery && !queryUrl.isEmpty())
+            metadata["tomtom.query_url"] = queryUrl;
+
+        QList<QGeoRoute> routes;
+        QString errorString;
+        QGeoRouteReply::Error error = parser->parseReply(routes, errorString, routeReply, routeRequest);
+        // Setting the request into the result
+        for (QGeoRoute &route : routes) {
+            route.setRequest(routeRequest);
+            for (QGeoRoute &leg: route.routeLegs()) {
+                leg.setRequest(routeRequest);
+            }
+        }
+
+        QList<QGeoRoute> georoutes;
+        for (const QGeoRoute &route : routes.mid(0, routeRequest.numberAlternativeRoutes() + 1)) {
+            QGeoRouteTomTom georoute(route, metadata);
+            georoutes.append(georoute);
+        }
 
-    QList<QGeoRoute> georoutes;
-    for (const QGeoRoute &route : routes.mid(0, request().numberAlternativeRoutes() + 1)) {
-        QGeoRouteTomTom georoute(route, metadata);
-        georoutes.append(georoute);
+        // Replies read from disk only go back into the memory cache
+        const QByteArray cachePayload = cacheFile.isEmpty() ? routeReply : QByteArray();
+        return [this, error, errorString, georoutes, cachePayload]() {
+            if (isFinished())
+                return;
+            if (error == QGeoRouteReply::NoError) {
+                if (QGeoRoutingManagerEngineTomTom *engine = qobject_cast<QGeoRoutingManagerEngineTomTom *>(parent()))
+                    engine->cacheRoutes(request(), georoutes, cachePayload);
+                setRoutes(georoutes);
+                // setError(QGeoRouteReply::NoError, status);  // can't do this, or NoError is emitted and does damages
+                setFinished(true);
+            } else {
+                setError(error, errorString);
+            }
+        };
+    });
+}
+
+/*
+    Aborting a part may make it emit finished() right away, so the parts are disconnected
+    first: whatever they report from now on is of no interest to this reply.
+*/
+void QGeoRouteReplyTomTom::abortParts()
+{
+    for (const QPointer<QGeoRouteReplyTomTom> &part: qAsConst(m_parts)) {
+        if (!part)
+            continue;
+        disconnect(part, nullptr, this, nullptr);
+        if (!part->isFinished())
+            part->abort();
     }
+}
+
+/*
+    Chunk routes may also be in the route cache, so the stitched route gets its own
+    legs and segments. The copies reference the same shared geometry.
+*/
+static QGeoRouteSegment copySegment(QGeoRouteSegment segment)
+{
+    QGeoRouteSegment copy;
+    const QGeoRouteSegmentPrivateTomTom *d =
+            dynamic_cast<const QGeoRouteSegmentPrivateTomTom *>(QGeoRouteSegmentPrivate::get(segment));
+    if (d && d->m_geometry)
+        copy = QGeoRouteSegmentTomTom(d->m_geometry, d->m_first, d->m_last);
+    else
+        copy.setPath(segment.path());
+    copy.setDistance(segment.distance());
+    copy.setTravelTime(segment.travelTime());
+    copy.setManeuver(segment.maneuver());
+    QGeoRouteSegmentPrivate::get(copy)->setLegLastSegment(segment.isLegLastSegment());
+    return copy;
+}
 
-    if (error == QGeoRouteReply::NoError) {
-        setRoutes(georoutes);
-        // setError(QGeoRouteReply::NoError, status);  // can't do this, or NoError is emitted and does damages
-        setFinished(true);
+static QGeoRouteLeg copyLeg(const QGeoRouteLeg &leg)
+{
+    QGeoRouteLeg copy;
+    const QGeoRoutePrivate *d = QGeoRoutePrivate::routePrivateData(leg);
+    if (d->engineName() == QLatin1String("tomtom")
+            && static_cast<const QGeoRoutePrivateTomTom *>(d)->m_geometry) {
+        const QGeoRoutePrivateTomTom *dt = static_cast<const QGeoRoutePrivateTomTom *>(d);
+        copy = QGeoRouteLegTomTom(dt->m_geometry, dt->m_first, dt->m_last);
     } else {
-        setError(error, errorString);
+        copy.setPath(leg.path());
+    }
+    copy.setDistance(leg.distance());
+    copy.setTravelTime(leg.travelTime());
+    copy.setTravelMode(leg.travelMode());
+    copy.setBounds(leg.bounds());
+    return copy;
+}
+
+/*
+    Chains copies of the legs and segments of the chunk routes into a single route,
+    and sums their travel times and distances. The route path is stored once more,
+    as its own geometry, which also gives the bounds.
+*/
+static QGeoRoute stitchRoutes(const QList<QGeoRoute> &parts, const QGeoRouteRequest &request)
+{
+    QList<QGeoCoordinate> path;
+    int travelTime = 0;
+    qreal distance = 0;
+    for (const QGeoRoute &part: parts) {
+        QList<QGeoCoordinate> partPath = part.path();
+        if (!path.isEmpty() && !partPath.isEmpty() && path.last() == partPath.first())
+            partPath.removeFirst();
+        path += partPath;
+        travelTime += part.travelTime();
+        distance += part.distance();
+    }
+
+    const QGeoRouteTomTom base(QGeoRouteGeometryPointerTomTom(new QGeoRouteGeometryTomTom(path)));
+    QGeoRouteTomTom route(base, parts.first().metadata());
+    route.setRequest(request);
+    route.setTravelMode(parts.first().travelMode());
+    route.setTravelTime(travelTime);
+    route.setDistance(distance);
+    route.setBounds(QGeoPath(path).boundingGeoRectangle());
+
+    QList<QGeoRouteLeg> legs;
+    QGeoRouteSegment last;
+    for (const QGeoRoute &part: parts) {
+        for (const QGeoRouteLeg &partLeg: part.routeLegs()) {
+            QGeoRouteLeg leg = copyLeg(partLeg);
+            leg.setLegIndex(legs.size());
+            leg.setOverallRoute(route); // QGeoRoute::d_ptr is explicitlySharedDataPointer. Modifiers below won't detach it.
+            leg.setRequest(request);
+
+            QGeoRouteSegment segment = partLeg.firstRouteSegment();
+            bool first = true;
+            while (segment.isValid()) {
+                QGeoRouteSegment copy = copySegment(segment);
+                if (first)
+                    leg.setFirstRouteSegment(copy);
+                if (last.isValid())
+                    last.setNextRouteSegment(copy);
+                else
+                    route.setFirstRouteSegment(copy);
+                last = copy;
+                first = false;
+                if (segment.isLegLastSegment())
+                    break;
+                segment = segment.nextRouteSegment();
+            }
+            legs.append(leg);
+        }
+    }
+    route.setRouteLegs(legs);
+    return route;
+}
+
+// The points of a route path, read through the geometry for routes of this plugin
+class RoutePoints
+{
+public:
+    explicit RoutePoints(const QGeoRoute &route)
+    {
+        const QGeoRoutePrivate *d = QGeoRoutePrivate::routePrivateData(route);
+        if (d->engineName() == QLatin1String("tomtom")
+                && static_cast<const QGeoRoutePrivateTomTom *>(d)->m_geometry) {
+            m_data = static_cast<const QGeoRoutePrivateTomTom *>(d);
+        } else {
+            m_path = route.path();
+        }
+    }
+    int size() const
+    {
+        return (m_data) ? m_data->m_last - m_data->m_first + 1 : m_path.size();
+    }
+    QGeoCoordinate at(int index) const
+    {
+        return (m_data) ? m_data->m_geometry->at(m_data->m_first + index) : m_path.at(index);
+    }
+
+private:
+    const QGeoRoutePrivateTomTom *m_data = nullptr;
+    QList<QGeoCoordinate> m_path;
+};
+
+/*
+    Replaces the segments of the recalculated route, from the first segment boundary that
+    both routes have where their paths have become identical, with the segments of the
+    previous route. Those are shared, not copied, so the guidance built on them stays valid.
+    Legs and totals are those of the recalculated route.
+*/
+static QGeoRoute spliceRoute(const QGeoRoute &rerouted, const QGeoRoute &previous)
+{
+    const RoutePoints newPath(rerouted);
+    const RoutePoints oldPath(previous);
+    int common = 0;
+    while (common < newPath.size() && common < oldPath.size()
+           && newPath.at(newPath.size() - 1 - common) == oldPath.at(oldPath.size() - 1 - common)) {
+        ++common;
+    }
+    if (common < 2)
+        return rerouted;
+    const int newTail = newPath.size() - common;
+    const int oldTail = oldPath.size() - common;
+
+    QHash<int, QGeoRouteSegment> oldStarts;
+    for (const QPair<int, QGeoRouteSegment> &s: QGeoRouteTomTom::segments(previous)) {
+        if (s.first >= oldTail)
+            oldStarts.insert(s.first - oldTail, s.second);
+    }
+    const QVector<QPair<int, QGeoRouteSegment>> newSegments = QGeoRouteTomTom::segments(rerouted);
+    int cut = -1;
+    for (int i = 1; i < newSegments.size(); ++i) {
+        const int start = newSegments.at(i).first;
+        if (start >= newTail && oldStarts.contains(start - newTail)) {
+            cut = i;
+            break;
+        }
+    }
+    if (cut < 0)
+        return rerouted;
+
+    // The new beginning is copied, as the recalculated route may be in the route cache
+    QVector<QGeoRouteSegment> chain;
+    for (int i = 0; i < cut; ++i)
+        chain.append(copySegment(newSegments.at(i).second));
+    for (int i = 0; i + 1 < chain.size(); ++i)
+        chain[i].setNextRouteSegment(chain.at(i + 1));
+    const QGeoRouteSegment tail = oldStarts.value(newSegments.at(cut).first - newTail);
+    chain.last().setNextRouteSegment(tail);
+
+    QGeoRouteTomTom route(rerouted, rerouted.metadata());
+    route.setFirstRouteSegment(chain.first());
+    QList<QGeoRouteLeg> legs;
+    QGeoRouteSegment segment = chain.first();
+    for (const QGeoRouteLeg &reroutedLeg: rerouted.routeLegs()) {
+        QGeoRouteLeg leg = copyLeg(reroutedLeg);
+        leg.setLegIndex(legs.size());
+        leg.setOverallRoute(route); // QGeoRoute::d_ptr is explicitlySharedDataPointer. Modifiers below won't detach it.
+        leg.setRequest(rerouted.request());
+        leg.setFirstRouteSegment(segment);
+        legs.append(leg);
+        while (segment.isValid() && !segment.isLegLastSegment())
+            segment = segment.nextRouteSegment();
+        if (segment.isValid())
+            segment = segment.nextRouteSegment();
+    }
+    route.setRouteLegs(legs);
+    return route;
+}
+
+void QGeoRouteReplyTomTom::onPartFinished()
+{
+    if (isFinished())
+        return;
+    for (const QPointer<QGeoRouteReplyTomTom> &part: qAsConst(m_parts)) {
+        if (!part) {
+            setError(QGeoRouteReply::UnknownError, QStringLiteral("Route chunk deleted"));
+            return;
+        }
+        if (part->isFinished() && part->error() != QGeoRouteReply::NoError) {
+            const QGeoRouteReply::Error error = part->error();
+            const QString errorString = part->errorString();
+            abortParts();
+            setError(error, errorString);
+            return;
+        }
+    }
+    for (const QPointer<QGeoRouteReplyTomTom> &part: qAsConst(m_parts)) {
+        if (!part->isFinished())
+            return;
+    }
+
+    QList<QGeoRoute> routes;
+    for (const QPointer<QGeoRouteReplyTomTom> &part: qAsConst(m_parts)) {
+        if (part->routes().isEmpty()) {
+            setError(QGeoRouteReply::ParseError, QStringLiteral("No route for a chunk of the request"));
+            return;
+        }
+        routes.append(part->routes().first());
     }
+    const QGeoRouteRequest routeRequest = request();
+    const QGeoRoute previousRoute = m_previousRoute;
+    const bool splice = m_splice;
+    QTomTomCommon::parseInBackground(this, [this, routes, routeRequest, previousRoute, splice]() -> std::function<void()> {
+        const QGeoRoute route = (splice) ? spliceRoute(routes.first(), previousRoute)
+                                         : stitchRoutes(routes, routeRequest);
+        return [this, route]() {
+            if (isFinished())
+                return;
+            setRoutes(QList<QGeoRoute>() << route);
+            setFinished(true);
+        };
+    });
 }
 
 void QGeoRouteReplyTomTom::onNetworkReplyError(QNetworkReply::NetworkError error)
@@ -23,6 +23,7 @@
 
 #include <QtNetwork/QNetworkReply>
 #include <QtLocation/QGeoRouteReply>
+#include <QtCore/QPointer>
 
 QT_BEGIN_NAMESPACE
 
@@ -33,11 +34,24 @@ class QGeoRouteReplyTomTom : public QGeoRouteReply
 public:
     explicit QGeoRouteReplyTomTom(QObject *parent = nullptr);
     QGeoRouteReplyTomTom(QNetworkReply *reply, const QGeoRouteRequest &request, QObject *parent = 0);
+    QGeoRouteReplyTomTom(const QList<QGeoRoute> &routes, const QGeoRouteRequest &request, QObject *parent = 0);
+    QGeoRouteReplyTomTom(const QString &cacheFile, const QGeoRouteRequest &request, QObject *parent = 0);
+    QGeoRouteReplyTomTom(const QList<QGeoRouteReplyTomTom *> &parts, const QGeoRouteRequest &request, QObject *parent = 0);
+    QGeoRouteReplyTomTom(QGeoRouteReplyTomTom *reroute, const QGeoRoute &previous, const QGeoRouteRequest &request, QObject *parent = 0);
     ~QGeoRouteReplyTomTom();
 
 private Q_SLOTS:
     void onNetworkReplyFinished();
     void onNetworkReplyError(QNetworkReply::NetworkError error);
+    void onPartFinished();
+
+private:
+    void parse(const QByteArray &payload, const QString &cacheFile, const QUrl &queryUrl);
+    void abortParts();
+
+    QList<QPointer<QGeoRouteReplyTomTom>> m_parts;
+    QGeoRoute m_previousRoute;
+    bool m_splice = false;
 };
 
 QT_END_NAMESPACE
@@ -0,0 +1,947 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#include "qgeoroutetomtom.h"
+#include <QtCore/QPair>
+#include <QtCore/QtMath>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+QT_BEGIN_NAMESPACE
+
+namespace {
+
+// 1e-7 degrees, TomTom returns 5 decimals anyway
+const double kFixedPointScale = 1e7;
+// Meters per fixed point unit of latitude
+const double kUnitMeters = 6378137.0 * M_PI / 180.0 / kFixedPointScale;
+// Tolerances, in meters, of the precomputed levels of detail
+const double kLevelTolerances[] = { 2.0, 10.0, 50.0, 250.0, 1000.0 };
+const int kLevelCount = sizeof(kLevelTolerances) / sizeof(kLevelTolerances[0]);
+// Shorter runs in common with the main route are stored again, rather than referenced
+const int kMinSharedRun = 8;
+// Grid cells span a few average edges, within these bounds, in meters
+const double kMinCellSize = 25.0;
+const double kMaxCellSize = 2000.0;
+// Rings of cells searched around a position before scanning all edges instead
+const int kMaxRings = 32;
+
+// Grid cells, or fixed point coordinates
+inline quint64 pairKey(qint32 x, qint32 y)
+{
+    return (quint64(quint32(x)) << 32) | quint32(y);
+}
+
+inline qint32 toFixed(double degrees)
+{
+    return qint32(qRound64(degrees * kFixedPointScale));
+}
+
+inline double segmentDistanceSquared(double px, double py,
+                                     double ax, double ay,
+                                     double bx, double by)
+{
+    const double dx = bx - ax;
+    const double dy = by - ay;
+    const double len2 = dx * dx + dy * dy;
+    double t = 0.0;
+    if (len2 > 0.0)
+        t = qBound(0.0, ((px - ax) * dx + (py - ay) * dy) / len2, 1.0);
+    const double ex = px - (ax + t * dx);
+    const double ey = py - (ay + t * dy);
+    return ex * ex + ey * ey;
+}
+
+/*
+    Calls f(x, y) for each grid cell crossed by the segment from a to b, walking from the cell of
+    a to the cell of b. Where the segment goes through a corner, both cells touching the corner
+    are taken too, so that every cell containing a point of the segment is visited.
+*/
+template <typename F>
+void forEachCrossedCell(double ax, double ay, double bx, double by, double cellSize, F f)
+{
+    int x = int(std::floor(ax / cellSize));
+    int y = int(std::floor(ay / cellSize));
+    const int x1 = int(std::floor(bx / cellSize));
+    const int y1 = int(std::floor(by / cellSize));
+    const int stepX = (x1 > x) ? 1 : -1;
+    const int stepY = (y1 > y) ? 1 : -1;
+    const double inf = std::numeric_limits<double>::infinity();
+    // Fractions of the segment up to the next cell boundary on each axis, and across a cell
+    double tMaxX = inf;
+    double tMaxY = inf;
+    double tDeltaX = inf;
+    double tDeltaY = inf;
+    if (x != x1) {
+        tMaxX = ((stepX > 0 ? x + 1 : x) * cellSize - ax) / (bx - ax);
+        tDeltaX = cellSize / qAbs(bx - ax);
+    }
+    if (y != y1) {
+        tMaxY = ((stepY > 0 ? y + 1 : y) * cellSize - ay) / (by - ay);
+        tDeltaY = cellSize / qAbs(by - ay);
+    }
+
+    f(x, y);
+    while (x != x1 || y != y1) {
+        if (tMaxX == tMaxY) {
+            f(x + stepX, y);
+            f(x, y + stepY);
+        }
+        const bool moveX = tMaxX <= tMaxY;
+        const bool moveY = tMaxY <= tMaxX;
+        if (moveX) {
+            x += stepX;
+            tMaxX = (x == x1) ? inf : tMaxX + tDeltaX;
+        }
+        if (moveY) {
+            y += stepY;
+            tMaxY = (y == y1) ? inf : tMaxY + tDeltaY;
+        }
+        f(x, y);
+    }
+}
+
+} // namespace
+
+QGeoRouteGeometryTomTom::QGeoRouteGeometryTomTom(const QList<QGeoCoordinate> &path)
+    : m_points(new Points)
+{
+    m_points->latitudes.reserve(path.size());
+    m_points->longitudes.reserve(path.size());
+    for (const QGeoCoordinate &c: path) {
+        m_points->latitudes.append(toFixed(c.latitude()));
+        m_points->longitudes.append(toFixed(c.longitude()));
+    }
+    appendRun(m_points, 0, path.size());
+    buildLevels();
+}
+
+/*
+    Runs of at least kMinSharedRun consecutive points that are also consecutive in \a shared
+    reference its points. Runs are found by looking up each point not yet in a run in
+    \a sharedIndex, the pointIndex() of \a shared, so the alternative can leave and rejoin
+    the main route any number of times.
+*/
+QGeoRouteGeometryTomTom::QGeoRouteGeometryTomTom(const QList<QGeoCoordinate> &path,
+                                                 const QGeoRouteGeometryTomTom &shared,
+                                                 const PointIndex &sharedIndex)
+    : m_points(new Points)
+{
+    const int n = path.size();
+    QVector<qint32> latitudes(n);
+    QVector<qint32> longitudes(n);
+    for (int i = 0; i < n; ++i) {
+        latitudes[i] = toFixed(path.at(i).latitude());
+        longitudes[i] = toFixed(path.at(i).longitude());
+    }
+
+    int ownFirst = -1;
+    auto flushOwn = [&](int end) {
+        if (ownFirst < 0)
+            return;
+        appendRun(m_points, m_points->latitudes.size(), end - ownFirst);
+        m_points->latitudes += latitudes.mid(ownFirst, end - ownFirst);
+        m_points->longitudes += longitudes.mid(ownFirst, end - ownFirst);
+        ownFirst = -1;
+    };
+    for (int i = 0; i < n;) {
+        const auto it = sharedIndex.constFind(pairKey(latitudes.at(i), longitudes.at(i)));
+        int length = 0;
+        if (it != sharedIndex.constEnd()) {
+            const int j = it.value();
+            while (i + length < n && j + length < shared.size()
+                   && latitudes.at(i + length) == shared.latitude(j + length)
+                   && longitudes.at(i + length) == shared.longitude(j + length)) {
+                ++length;
+            }
+        }
+        if (length < kMinSharedRun) {
+            if (ownFirst < 0)
+                ownFirst = i;
+            ++i;
+            continue;
+        }
+        flushOwn(i);
+        // The shared range may itself span several runs of the shared geometry
+        for (int j = it.value(), end = it.value() + length; j < end;) {
+            const Run &run = shared.runAt(j);
+            const int count = qMin(end, run.offset + run.count) - j;
+            appendRun(run.points, run.first + j - run.offset, count);
+            j += count;
+        }
+        i += length;
+    }
+    flushOwn(n);
+    buildLevels();
+}
+
+/*
+    The first position of each point, for the geometries sharing this one. The parser builds
+    it once per reply and passes it to the geometry of each alternative route.
+*/
+QGeoRouteGeometryTomTom::PointIndex QGeoRouteGeometryTomTom::pointIndex() const
+{
+    PointIndex res;
+    res.reserve(size());
+    for (int i = size() - 1; i >= 0; --i)
+        res.insert(pairKey(latitude(i), longitude(i)), i);
+    return res;
+}
+
+void QGeoRouteGeometryTomTom::appendRun(const PointsPointer &points, int first, int count)
+{
+    if (count <= 0)
+        return;
+    m_size += count;
+    if (!m_runs.isEmpty()) {
+        Run &last = m_runs.last();
+        if (last.points == points && last.first + last.count == first) {
+            last.count += count;
+            return;
+        }
+    }
+    m_runs.append(Run{m_size - count, count, points, first});
+}
+
+const QGeoRouteGeometryTomTom::Run &QGeoRouteGeometryTomTom::runAt(int index) const
+{
+    if (m_runs.size() == 1)
+        return m_runs.first();
+    const auto it = std::upper_bound(m_runs.cbegin(), m_runs.cend(), index,
+                                     [](int i, const Run &run) { return i < run.offset; });
+    return *(it - 1);
+}
+
+qint32 QGeoRouteGeometryTomTom::latitude(int index) const
+{
+    const Run &run = runAt(index);
+    return run.points->latitudes.at(run.first + index - run.offset);
+}
+
+qint32 QGeoRouteGeometryTomTom::longitude(int index) const
+{
+    const Run &run = runAt(index);
+    return run.points->longitudes.at(run.first + index - run.offset);
+}
+
+int QGeoRouteGeometryTomTom::size() const
+{
+    return m_size;
+}
+
+QGeoCoordinate QGeoRouteGeometryTomTom::at(int index) const
+{
+    return QGeoCoordinate(latitude(index) / kFixedPointScale,
+                          longitude(index) / kFixedPointScale);
+}
+
+QVector<QPair<int, int>> QGeoRouteGeometryTomTom::ownRuns(int first, int last) const
+{
+    QVector<QPair<int, int>> res;
+    for (const Run &run: m_runs) {
+        if (run.points != m_points)
+            continue;
+        const int a = qMax(first, run.offset);
+        const int b = qMin(last, run.offset + run.count - 1);
+        if (a <= b)
+            res.append(qMakePair(a, b));
+    }
+    return res;
+}
+
+QList<QGeoCoordinate> QGeoRouteGeometryTomTom::path(int first, int last) const
+{
+    QList<QGeoCoordinate> res;
+    first = qMax(first, 0);
+    last = qMin(last, size() - 1);
+    if (last < first)
+        return res;
+    res.reserve(last - first + 1);
+    for (int i = first; i <= last; ++i)
+        res.append(at(i));
+    return res;
+}
+
+/*
+    Returns the points in [first, last] of the coarsest level of detail whose tolerance does not
+    exceed \a tolerance (in meters). The range endpoints are always included, so that the
+    simplified paths of adjacent legs or segments still join.
+*/
+QList<QGeoCoordinate> QGeoRouteGeometryTomTom::simplifiedPath(int first, int last, double tolerance) const
+{
+    int level = -1;
+    while (level + 1 < m_levels.size() && kLevelTolerances[level + 1] <= tolerance)
+        ++level;
+    if (level < 0)
+        return path(first, last);
+
+    QList<QGeoCoordinate> res;
+    first = qMax(first, 0);
+    last = qMin(last, size() - 1);
+    if (last < first)
+        return res;
+
+    const QVector<int> &kept = m_levels.at(level);
+    res.append(at(first));
+    for (auto it = std::upper_bound(kept.cbegin(), kept.cend(), first);
+         it != kept.cend() && *it < last; ++it) {
+        res.append(at(*it));
+    }
+    if (last != first)
+        res.append(at(last));
+    return res;
+}
+
+double QGeoRouteGeometryTomTom::distanceAt(int index) const
+{
+    QMutexLocker locker(&m_indexMutex);
+    if (m_distances.size() != size())
+        buildIndex();
+    return m_distances.at(index);
+}
+
+/*
+    Finds the closest edge by searching the grid cells in rings of increasing size around the
+    position, until no edge in the next ring can be closer than the closest found. Positions on
+    or near the route so look at a handful of edges. Far away positions fall back to a scan.
+*/
+QGeoRouteGeometryTomTom::Projection QGeoRouteGeometryTomTom::project(const QGeoCoordinate &position,
+                                                                   int first, int last) const
+{
+    Projection res;
+    first = qMax(first, 0);
+    last = qMin(last, size() - 1);
+    if (last < first || !position.isValid())
+        return res;
+
+    QMutexLocker locker(&m_indexMutex);
+    if (m_distances.size() != size())
+        buildIndex();
+
+    const double x = position.longitude() * kFixedPointScale * m_lonScale * kUnitMeters;
+    const double y = position.latitude() * kFixedPointScale * kUnitMeters;
+    if (first == last) {
+        res.edge = first;
+        res.distance = std::hypot(x - longitude(first) * m_lonScale * kUnitMeters,
+                                  y - latitude(first) * kUnitMeters);
+        res.offset = m_distances.at(first);
+        return res;
+    }
+
+    double best = std::numeric_limits<double>::max();
+    auto visit = [&](int edge) {
+        if (edge < first || edge >= last)
+            return;
+        double fraction;
+        const double d = edgeDistance(edge, x, y, &fraction);
+        if (d < best) {
+            best = d;
+            res.edge = edge;
+            res.fraction = fraction;
+        }
+    };
+
+    const int cx = int(std::floor(x / m_cellSize));
+    const int cy = int(std::floor(y / m_cellSize));
+    // Rings past the farthest cell of the grid are empty
+    const int reach = qMax(qMax(qAbs(cx - m_minCellX), qAbs(cx - m_maxCellX)),
+                           qMax(qAbs(cy - m_minCellY), qAbs(cy - m_maxCellY)));
+    const int rings = qMin(reach, kMaxRings);
+    bool searched = false;
+    for (int r = 0; r <= rings && !searched; ++r) {
+        for (int i = cx - r; i <= cx + r; ++i) {
+            if (i < m_minCellX || i > m_maxCellX)
+                continue;
+            const int step = (i == cx - r || i == cx + r) ? 1 : qMax(1, 2 * r);
+            for (int j = cy - r; j <= cy + r; j += step) {
+                if (j < m_minCellY || j > m_maxCellY)
+                    continue;
+                const auto it = m_cells.constFind(pairKey(i, j));
+                if (it == m_cells.constEnd())
+                    continue;
+                for (int edge: it.value())
+                    visit(edge);
+            }
+        }
+        // Edges not seen yet lie in cells at least r cells away
+        searched = res.edge >= 0 && (r == reach || best <= r * m_cellSize);
+    }
+    if (!searched) {
+        for (int edge = first; edge < last; ++edge)
+            visit(edge);
+    }
+
+    res.distance = best;
+    res.offset = m_distances.at(res.edge)
+            + res.fraction * (m_distances.at(res.edge + 1) - m_distances.at(res.edge));
+    return res;
+}
+
+// Distance, in meters, from (x, y) to an edge, and where along it the closest point lies
+double QGeoRouteGeometryTomTom::edgeDistance(int edge, double x, double y, double *fraction) const
+{
+    const double scale = m_lonScale * kUnitMeters;
+    const double ax = longitude(edge) * scale;
+    const double ay = latitude(edge) * kUnitMeters;
+    const int next = qMin(edge + 1, size() - 1);
+    const double bx = longitude(next) * scale;
+    const double by = latitude(next) * kUnitMeters;
+    const double dx = bx - ax;
+    const double dy = by - ay;
+    const double len2 = dx * dx + dy * dy;
+    double t = 0.0;
+    if (len2 > 0.0)
+        t = qBound(0.0, ((x - ax) * dx + (y - ay) * dy) / len2, 1.0);
+    *fraction = t;
+    return std::hypot(x - (ax + t * dx), y - (ay + t * dy));
+}
+
+/*
+    Distances use the cosine of the latitude of each edge. The grid, like the levels of detail,
+    uses the one of the mean latitude. Each edge goes into the cells it crosses only.
+*/
+void QGeoRouteGeometryTomTom::buildIndex() const
+{
+    const int n = size();
+    m_distances.resize(n);
+    m_cells.clear();
+    if (!n)
+        return;
+
+    double meanLatitude = 0.0;
+    double total = 0.0;
+    m_distances[0] = 0.0;
+    for (int i = 1; i < n; ++i) {
+        const double cosine = qCos(qDegreesToRadians((latitude(i - 1) + latitude(i)) * 0.5 / kFixedPointScale));
+        const double dx = double(longitude(i) - longitude(i - 1)) * cosine;
+        const double dy = double(latitude(i) - latitude(i - 1));
+        total += std::hypot(dx, dy) * kUnitMeters;
+        m_distances[i] = total;
+    }
+    for (int i = 0; i < n; ++i)
+        meanLatitude += latitude(i);
+    meanLatitude /= n * kFixedPointScale;
+    m_lonScale = qCos(qDegreesToRadians(meanLatitude));
+    m_cellSize = qBound(kMinCellSize, 4.0 * total / qMax(1, n - 1), kMaxCellSize);
+
+    const double scale = m_lonScale * kUnitMeters;
+    m_minCellX = m_minCellY = std::numeric_limits<int>::max();
+    m_maxCellX = m_maxCellY = std::numeric_limits<int>::min();
+    for (int i = 0; i < qMax(1, n - 1); ++i) {
+        const int j = qMin(i + 1, n - 1);
+        const double ax = longitude(i) * scale;
+        const double ay = latitude(i) * kUnitMeters;
+        const double bx = longitude(j) * scale;
+        const double by = latitude(j) * kUnitMeters;
+        forEachCrossedCell(ax, ay, bx, by, m_cellSize, [this, i](int x, int y) {
+            m_cells[pairKey(x, y)].append(i);
+        });
+        const int x0 = int(std::floor(qMin(ax, bx) / m_cellSize));
+        const int x1 = int(std::floor(qMax(ax, bx) / m_cellSize));
+        const int y0 = int(std::floor(qMin(ay, by) / m_cellSize));
+        const int y1 = int(std::floor(qMax(ay, by) / m_cellSize));
+        m_minCellX = qMin(m_minCellX, x0);
+        m_maxCellX = qMax(m_maxCellX, x1);
+        m_minCellY = qMin(m_minCellY, y0);
+        m_maxCellY = qMax(m_maxCellY, y1);
+    }
+}
+
+/*
+    Each level is simplified from the previous, finer one, so the total cost stays close to a
+    single Douglas-Peucker pass over the full geometry. Longitudes are scaled by the cosine of
+    the mean latitude, which is accurate enough for route-sized extents.
+*/
+void QGeoRouteGeometryTomTom::buildLevels()
+{
+    const int n = size();
+    if (n < 3)
+        return;
+
+    double meanLatitude = 0.0;
+    for (int i = 0; i < n; ++i)
+        meanLatitude += latitude(i);
+    meanLatitude /= n * kFixedPointScale;
+    const double lonScale = qCos(qDegreesToRadians(meanLatitude));
+
+    QVector<int> source(n);
+    for (int i = 0; i < n; ++i)
+        source[i] = i;
+
+    QVector<QPair<int, int>> stack;
+    for (int l = 0; l < kLevelCount; ++l) {
+        const double tolerance = kLevelTolerances[l] / kUnitMeters;
+        const double tolerance2 = tolerance * tolerance;
+        QVector<bool> keep(source.size(), false);
+        keep.first() = keep.last() = true;
+
+        stack.clear();
+        stack.append(qMakePair(0, source.size() - 1));
+        while (!stack.isEmpty()) {
+            const QPair<int, int> range = stack.takeLast();
+            const int a = source.at(range.first);
+            const int b = source.at(range.second);
+            const double ax = longitude(a) * lonScale, ay = latitude(a);
+            const double bx = longitude(b) * lonScale, by = latitude(b);
+            double maxDistance2 = -1.0;
+            int farthest = -1;
+            for (int i = range.first + 1; i < range.second; ++i) {
+                const int p = source.at(i);
+                const double d2 = segmentDistanceSquared(longitude(p) * lonScale, latitude(p),
+                                                         ax, ay, bx, by);
+                if (d2 > maxDistance2) {
+                    maxDistance2 = d2;
+                    farthest = i;
+                }
+            }
+            if (farthest < 0 || maxDistance2 <= tolerance2)
+                continue;
+            keep[farthest] = true;
+            stack.append(qMakePair(range.first, farthest));
+            stack.append(qMakePair(farthest, range.second));
+        }
+
+        QVector<int> kept;
+        for (int i = 0; i < source.size(); ++i) {
+            if (keep.at(i))
+                kept.append(source.at(i));
+        }
+        m_levels.append(kept);
+        if (kept.size() <= 2)
+            break;
+        source = kept;
+    }
+}
+
+void QGeoRouteSegmentsTomTom::setBuilder(const Builder &builder)
+{
+    QMutexLocker locker(&m_mutex);
+    m_builder = builder;
+    m_legFirstSegments.clear();
+}
+
+QGeoRouteSegment QGeoRouteSegmentsTomTom::firstSegment(int leg)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_builder) {
+        m_legFirstSegments = m_builder();
+        m_builder = nullptr; // release the parsed data
+    }
+    leg = qMax(leg, 0);
+    if (leg >= m_legFirstSegments.size())
+        return QGeoRouteSegment();
+    return m_legFirstSegments.at(leg);
+}
+
+QGeoRoutePrivateTomTom::QGeoRoutePrivateTomTom()
+    : m_progress(new QGeoRouteProgressTomTom)
+{
+}
+
+QGeoRoutePrivateTomTom::QGeoRoutePrivateTomTom(const QGeoRoutePrivateDefault &other)
+    : QGeoRoutePrivateDefault(other)
+    , m_progress(new QGeoRouteProgressTomTom)
+{
+}
+
+QGeoRoutePrivateTomTom::QGeoRoutePrivateTomTom(const QGeoRoutePrivateTomTom &other)
+    : QGeoRoutePrivateDefault(other)
+    , m_metadata(other.m_metadata)
+    , m_geometry(other.m_geometry)
+    , m_first(other.m_first)
+    , m_last(other.m_last)
+    , m_segments(other.m_segments)
+    , m_segmentsLeg(other.m_segmentsLeg)
+    , m_progress(other.m_progress)
+{
+}
+
+QGeoRoutePrivate *QGeoRoutePrivateTomTom::clone()
+{
+    return new QGeoRoutePrivateTomTom(*this);
+}
+
+QString QGeoRoutePrivateTomTom::engineName() const
+{
+    return QLatin1String("tomtom");
+}
+
+QVariantMap QGeoRoutePrivateTomTom::metadata() const
+{
+    return m_metadata;
+}
+
+void QGeoRoutePrivateTomTom::setPath(const QList<QGeoCoordinate> &path)
+{
+    m_geometry.reset();
+    m_progress.reset(new QGeoRouteProgressTomTom);
+    QGeoRoutePrivateDefault::setPath(path);
+}
+
+QList<QGeoCoordinate> QGeoRoutePrivateTomTom::path() const
+{
+    if (m_geometry)
+        return m_geometry->path(m_first, m_last);
+    return QGeoRoutePrivateDefault::path();
+}
+
+/*
+    Segments set explicitly take precedence over those built on demand.
+*/
+QGeoRouteSegment QGeoRoutePrivateTomTom::firstSegment() const
+{
+    const QGeoRouteSegment segment = QGeoRoutePrivateDefault::firstSegment();
+    if (segment.isValid() || !m_segments)
+        return segment;
+    return m_segments->firstSegment(m_segmentsLeg);
+}
+
+void QGeoRoutePrivateTomTom::setFirstSegment(const QGeoRouteSegment &firstSegment)
+{
+    m_progress.reset(new QGeoRouteProgressTomTom);
+    QGeoRoutePrivateDefault::setFirstSegment(firstSegment);
+}
+
+int QGeoRoutePrivateTomTom::segmentsCount() const
+{
+    if (!m_segments || QGeoRoutePrivateDefault::firstSegment().isValid())
+        return QGeoRoutePrivateDefault::segmentsCount();
+    int count = 0;
+    for (QGeoRouteSegment segment = firstSegment(); segment.isValid(); segment = segment.nextRouteSegment()) {
+        ++count;
+        if (m_segmentsLeg >= 0 && segment.isLegLastSegment())
+            break;
+    }
+    return count;
+}
+
+QGeoRouteSegmentPrivateTomTom::QGeoRouteSegmentPrivateTomTom(const QGeoRouteGeometryPointerTomTom &geometry,
+                                                             int first, int last)
+    : m_geometry(geometry)
+    , m_first(first)
+    , m_last(last)
+{
+}
+
+QGeoRouteSegmentPrivateTomTom::QGeoRouteSegmentPrivateTomTom(const QGeoRouteSegmentPrivateTomTom &other)
+    : QGeoRouteSegmentPrivateDefault(other)
+    , m_geometry(other.m_geometry)
+    , m_first(other.m_first)
+    , m_last(other.m_last)
+{
+}
+
+QGeoRouteSegmentPrivate *QGeoRouteSegmentPrivateTomTom::clone()
+{
+    return new QGeoRouteSegmentPrivateTomTom(*this);
+}
+
+void QGeoRouteSegmentPrivateTomTom::setPath(const QList<QGeoCoordinate> &path)
+{
+    m_geometry.reset();
+    QGeoRouteSegmentPrivateDefault::setPath(path);
+}
+
+QList<QGeoCoordinate> QGeoRouteSegmentPrivateTomTom::path() const
+{
+    if (m_geometry)
+        return m_geometry->path(m_first, m_last);
+    return QGeoRouteSegmentPrivateDefault::path();
+}
+
+static QGeoRoutePrivateTomTom *createRoutePrivate(const QGeoRouteGeometryPointerTomTom &geometry,
+                                                  int first, int last,
+                                                  const QGeoRouteSegmentsPointerTomTom &segments, int leg)
+{
+    QGeoRoutePrivateTomTom *d = new QGeoRoutePrivateTomTom;
+    d->m_geometry = geometry;
+    d->m_first = first;
+    d->m_last = last;
+    d->m_segments = segments;
+    d->m_segmentsLeg = leg;
+    return d;
+}
+
+QGeoRouteTomTom::QGeoRouteTomTom(const QGeoRouteGeometryPointerTomTom &geometry,
+                                 const QGeoRouteSegmentsPointerTomTom &segments)
+    : QGeoRoute(QExplicitlySharedDataPointer<QGeoRoutePrivate>(createRoutePrivate(geometry, 0, geometry->size() - 1,
+                                                                                  segments, -1)))
+{
+}
+
+static QGeoRoutePrivateTomTom *copyRoutePrivate(const QGeoRoute &other, const QVariantMap &metadata)
+{
+    const QGeoRoutePrivate *od = QGeoRoutePrivate::routePrivateData(other);
+    QGeoRoutePrivateTomTom *d;
+    if (od->engineName() == QLatin1String("tomtom"))
+        d = new QGeoRoutePrivateTomTom(*static_cast<const QGeoRoutePrivateTomTom *>(od));
+    else
+        d = new QGeoRoutePrivateTomTom(*static_cast<const QGeoRoutePrivateDefault *>(od));
+    d->m_metadata = metadata;
+    return d;
+}
+
+QGeoRouteTomTom::QGeoRouteTomTom(const QGeoRoute &other, const QVariantMap &metadata)
+    : QGeoRoute(QExplicitlySharedDataPointer<QGeoRoutePrivate>(copyRoutePrivate(other, metadata)))
+{
+}
+
+/*
+    Simplified path of a route or route leg, for drawing at low zoom levels, starting
+    at index \a from of its path. Routes not produced by this plugin are returned unsimplified.
+*/
+QList<QGeoCoordinate> QGeoRouteTomTom::simplifiedPath(const QGeoRoute &route, double toleranceMeters, int from)
+{
+    const QGeoRoutePrivate *d = QGeoRoutePrivate::routePrivateData(route);
+    if (d->engineName() != QLatin1String("tomtom"))
+        return route.path().mid(from);
+    const QGeoRoutePrivateTomTom *dt = static_cast<const QGeoRoutePrivateTomTom *>(d);
+    if (!dt->m_geometry)
+        return route.path().mid(from);
+    if (dt->m_first + from > dt->m_last)
+        return QList<QGeoCoordinate>();
+    return dt->m_geometry->simplifiedPath(dt->m_first + from, dt->m_last, toleranceMeters);
+}
+
+/*
+    The parts of the path of a route or route leg that are not shared with the main route
+    of the same reply, each extended by a point on both sides so that they join it.
+    Drawing the main route and these parts of the alternatives draws shared runs once.
+    The main route, and routes not produced by this plugin, return their whole path.
+*/
+QList<QList<QGeoCoordinate>> QGeoRouteTomTom::ownPaths(const QGeoRoute &route)
+{
+    const QGeoRoutePrivate *d = QGeoRoutePrivate::routePrivateData(route);
+    const QGeoRoutePrivateTomTom *dt = (d->engineName() == QLatin1String("tomtom"))
+            ? static_cast<const QGeoRoutePrivateTomTom *>(d) : nullptr;
+    if (!dt || !dt->m_geometry)
+        return QList<QList<QGeoCoordinate>>() << route.path();
+
+    QList<QList<QGeoCoordinate>> res;
+    for (const QPair<int, int> &run: dt->m_geometry->ownRuns(dt->m_first, dt->m_last))
+        res.append(dt->m_geometry->path(qMax(dt->m_first, run.first - 1), qMin(dt->m_last, run.second + 1)));
+    return res;
+}
+
+// First or last point of a segment, without building its path for segments of this plugin
+static QGeoCoordinate segmentPoint(QGeoRouteSegment segment, bool last)
+{
+    const QGeoRouteSegmentPrivateTomTom *d =
+            dynamic_cast<const QGeoRouteSegmentPrivateTomTom *>(QGeoRouteSegmentPrivate::get(segment));
+    if (d && d->m_geometry)
+        return d->m_geometry->at(last ? d->m_last : d->m_first);
+    const QList<QGeoCoordinate> path = segment.path();
+    if (path.isEmpty())
+        return QGeoCoordinate();
+    return last ? path.last() : path.first();
+}
+
+static int segmentPointCount(QGeoRouteSegment segment)
+{
+    const QGeoRouteSegmentPrivateTomTom *d =
+            dynamic_cast<const QGeoRouteSegmentPrivateTomTom *>(QGeoRouteSegmentPrivate::get(segment));
+    if (d && d->m_geometry)
+        return d->m_last - d->m_first + 1;
+    return segment.path().size();
+}
+
+/*
+    The segments of a route with the index of their first point in the route path.
+    Consecutive segments share their boundary point, except across legs of a single reply.
+*/
+QVector<QPair<int, QGeoRouteSegment>> QGeoRouteTomTom::segments(const QGeoRoute &route)
+{
+    QVector<QPair<int, QGeoRouteSegment>> res;
+    int start = 0;
+    QGeoCoordinate end;
+    for (QGeoRouteSegment segment = route.firstRouteSegment(); segment.isValid(); segment = segment.nextRouteSegment()) {
+        if (!res.isEmpty()) {
+            start += segmentPointCount(res.last().second) - 1;
+            if (segmentPoint(segment, false) != end)
+                ++start;
+        }
+        res.append(qMakePair(start, segment));
+        end = segmentPoint(segment, true);
+    }
+    return res;
+}
+
+// The data of a route or route leg of this plugin backed by a geometry, or nullptr
+static const QGeoRoutePrivateTomTom *geometryRoutePrivate(const QGeoRoute &route)
+{
+    const QGeoRoutePrivate *d = QGeoRoutePrivate::routePrivateData(route);
+    if (d->engineName() != QLatin1String("tomtom"))
+        return nullptr;
+    const QGeoRoutePrivateTomTom *dt = static_cast<const QGeoRoutePrivateTomTom *>(d);
+    return (dt->m_geometry) ? dt : nullptr;
+}
+
+/*
+    The leg of \a route holding point \a pathIndex of the route path, or the last leg. Legs on
+    the geometry of the route, or on the one of the previous leg, are located by their range,
+    without building their paths. Other legs, such as those of stitched chunks, follow the
+    previous one and share its last point if they start there, as stitching drops it.
+*/
+int QGeoRouteTomTom::legIndex(const QGeoRoute &route, int pathIndex)
+{
+    const QGeoRoutePrivateTomTom *dr = geometryRoutePrivate(route);
+    const QList<QGeoRouteLeg> legs = route.routeLegs();
+    const QGeoRoutePrivateTomTom *previous = nullptr;
+    QGeoCoordinate previousLast;
+    int start = 0;
+    int end = -1;
+    for (int i = 0; i < legs.size(); ++i) {
+        const QGeoRoutePrivateTomTom *dl = geometryRoutePrivate(legs.at(i));
+        QList<QGeoCoordinate> path;
+        if (!dl)
+            path = legs.at(i).path();
+        const int count = (dl) ? dl->m_last - dl->m_first + 1 : path.size();
+        const QGeoCoordinate first = (dl) ? dl->m_geometry->at(dl->m_first) : path.value(0);
+
+        if (dl && dr && dl->m_geometry == dr->m_geometry)
+            start = dl->m_first - dr->m_first;
+        else if (dl && previous && dl->m_geometry == previous->m_geometry)
+            start += dl->m_first - previous->m_first;
+        else if (i > 0)
+            start = (count && first == previousLast) ? end : end + 1;
+        end = start + count - 1;
+        if (pathIndex <= end)
+            return i;
+
+        previous = dl;
+        previousLast = (dl) ? dl->m_geometry->at(dl->m_last) : path.value(path.size() - 1);
+    }
+    return legs.size() - 1;
+}
+
+/*
+    Where \a position lies along \a route or route leg: the closest point of its path, the
+    segment it is in, and the distance and time left, from the segments if the route has them.
+    The first call builds an index of the route, so the following ones take constant time,
+    on average, for positions on or near the route. Routes not produced by this plugin are
+    indexed again at each call.
+*/
+QGeoRouteProjectionTomTom QGeoRouteTomTom::project(const QGeoRoute &route, const QGeoCoordinate &position)
+{
+    const QGeoRoutePrivate *d = QGeoRoutePrivate::routePrivateData(route);
+    if (d->engineName() == QLatin1String("tomtom")) {
+        const QGeoRoutePrivateTomTom *dt = static_cast<const QGeoRoutePrivateTomTom *>(d);
+        if (dt->m_progress)
+            return dt->m_progress->project(route, position);
+    }
+    QGeoRouteProgressTomTom progress;
+    return progress.project(route, position);
+}
+
+void QGeoRouteProgressTomTom::build(const QGeoRoute &route)
+{
+    m_built = true;
+    const QGeoRoutePrivate *d = QGeoRoutePrivate::routePrivateData(route);
+    const QGeoRoutePrivateTomTom *dt = (d->engineName() == QLatin1String("tomtom"))
+            ? static_cast<const QGeoRoutePrivateTomTom *>(d) : nullptr;
+    if (dt && dt->m_geometry) {
+        m_geometry = dt->m_geometry;
+        m_first = dt->m_first;
+        m_last = dt->m_last;
+    } else {
+        m_geometry = new QGeoRouteGeometryTomTom(route.path());
+        m_first = 0;
+        m_last = m_geometry->size() - 1;
+    }
+
+    // The chain goes on past the end of a leg
+    const int pathSize = m_last - m_first + 1;
+    for (const QPair<int, QGeoRouteSegment> &s: QGeoRouteTomTom::segments(route)) {
+        if (s.first >= pathSize)
+            break;
+        m_segments.append(s.second);
+        m_segmentStarts.append(s.first);
+        m_segmentEnds.append(qMin(s.first + segmentPointCount(s.second) - 1, pathSize - 1));
+    }
+    m_distanceAfter.resize(m_segments.size());
+    m_timeAfter.resize(m_segments.size());
+    double distance = 0.0;
+    double time = 0.0;
+    for (int i = m_segments.size() - 1; i >= 0; --i) {
+        m_distanceAfter[i] = distance;
+        m_timeAfter[i] = time;
+        distance += m_segments.at(i).distance();
+        time += m_segments.at(i).travelTime();
+    }
+}
+
+QGeoRouteProjectionTomTom QGeoRouteProgressTomTom::project(const QGeoRoute &route, const QGeoCoordinate &position)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_built)
+        build(route);
+
+    QGeoRouteProjectionTomTom res;
+    const QGeoRouteGeometryTomTom::Projection p = m_geometry->project(position, m_first, m_last);
+    if (p.edge < 0)
+        return res;
+
+    res.isValid = true;
+    res.pathIndex = p.edge - m_first;
+    const QGeoCoordinate a = m_geometry->at(p.edge);
+    const QGeoCoordinate b = m_geometry->at(qMin(p.edge + 1, m_last));
+    res.position = QGeoCoordinate(a.latitude() + p.fraction * (b.latitude() - a.latitude()),
+                                  a.longitude() + p.fraction * (b.longitude() - a.longitude()));
+    res.distanceFromRoute = p.distance;
+    const double start = m_geometry->distanceAt(m_first);
+    res.offset = p.offset - start;
+
+    if (m_segments.isEmpty()) {
+        // No guidance, e.g. summary only routes: spread the totals along the path
+        const double length = m_geometry->distanceAt(m_last) - start;
+        const double left = (length > 0.0) ? qBound(0.0, 1.0 - res.offset / length, 1.0) : 0.0;
+        res.remainingDistance = route.distance() * left;
+        res.remainingTime = route.travelTime() * left;
+        return res;
+    }
+
+    int s = int(std::upper_bound(m_segmentStarts.cbegin(), m_segmentStarts.cend(), res.pathIndex)
+                - m_segmentStarts.cbegin()) - 1;
+    s = qBound(0, s, m_segments.size() - 1);
+    const double segmentStart = m_geometry->distanceAt(m_first + m_segmentStarts.at(s)) - start;
+    const double segmentEnd = m_geometry->distanceAt(m_first + m_segmentEnds.at(s)) - start;
+    const double left = (segmentEnd > segmentStart)
+            ? qBound(0.0, (segmentEnd - res.offset) / (segmentEnd - segmentStart), 1.0) : 0.0;
+    res.segment = m_segments.at(s);
+    res.segmentIndex = s;
+    res.remainingDistance = res.segment.distance() * left + m_distanceAfter.at(s);
+    res.remainingTime = res.segment.travelTime() * left + m_timeAfter.at(s);
+    return res;
+}
+
+QGeoRouteLegTomTom::QGeoRouteLegTomTom(const QGeoRouteGeometryPointerTomTom &geometry, int first, int last,
+                                       const QGeoRouteSegmentsPointerTomTom &segments, int leg)
+    : QGeoRouteLeg(QExplicitlySharedDataPointer<QGeoRoutePrivate>(createRoutePrivate(geometry, first, last,
+                                                                                     segments, leg)))
+{
+}
+
+QGeoRouteSegmentTomTom::QGeoRouteSegmentTomTom(const QGeoRouteGeometryPointerTomTom &geometry, int first, int last)
+    : QGeoRouteSegment(QExplicitlySharedDataPointer<QGeoRouteSegmentPrivate>(new QGeoRouteSegmentPrivateTomTom(geometry, first, last)))
+{
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,261 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#ifndef QGEOROUTETOMTOM_H
+#define QGEOROUTETOMTOM_H
+
+#include <QtLocation/QGeoRoute>
+#include <QtLocation/QGeoRouteLeg>
+#include <QtLocation/QGeoRouteSegment>
+#include <QtLocation/private/qgeoroute_p.h>
+#include <QtLocation/private/qgeoroutesegment_p.h>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
+#include <QtCore/QSharedData>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QVector>
+#include <functional>
+
+QT_BEGIN_NAMESPACE
+
+/*
+    The geometry of a route, stored once and shared by the route, its legs and its segments,
+    which reference it by index ranges. Coordinates are kept as fixed point integers
+    (1e-7 degrees, about 1cm) in two separate arrays.
+
+    The path is a sequence of runs of stored points. An alternative route keeps the runs it
+    has in common with the main route as references to the points of the main route, and
+    stores only the points where it differs.
+
+    A few simplified levels of detail are precomputed with Douglas-Peucker, so that drawing
+    the route at low zoom levels does not have to walk every point.
+*/
+class QGeoRouteGeometryTomTom : public QSharedData
+{
+public:
+    // First position of each point of a geometry, see pointIndex()
+    typedef QHash<quint64, int> PointIndex;
+
+    explicit QGeoRouteGeometryTomTom(const QList<QGeoCoordinate> &path);
+    QGeoRouteGeometryTomTom(const QList<QGeoCoordinate> &path, const QGeoRouteGeometryTomTom &shared,
+                            const PointIndex &sharedIndex);
+
+    PointIndex pointIndex() const;
+
+    int size() const;
+    QGeoCoordinate at(int index) const;
+    QList<QGeoCoordinate> path(int first, int last) const;
+    QList<QGeoCoordinate> simplifiedPath(int first, int last, double tolerance) const;
+
+    // The point of the path in [first, last] closest to a position
+    struct Projection
+    {
+        int edge = -1;          // from point edge to point edge + 1
+        double fraction = 0.0;  // along the edge
+        double distance = 0.0;  // from the position, in meters
+        double offset = 0.0;    // from the first point of the geometry, in meters
+    };
+    Projection project(const QGeoCoordinate &position, int first, int last) const;
+    double distanceAt(int index) const;
+
+    // The ranges, within [first, last], of the points stored by this geometry only
+    QVector<QPair<int, int>> ownRuns(int first, int last) const;
+
+private:
+    struct Points : public QSharedData
+    {
+        QVector<qint32> latitudes;
+        QVector<qint32> longitudes;
+    };
+    typedef QExplicitlySharedDataPointer<Points> PointsPointer;
+    // count points of the path from offset, stored in points from first
+    struct Run
+    {
+        int offset;
+        int count;
+        PointsPointer points;
+        int first;
+    };
+
+    void appendRun(const PointsPointer &points, int first, int count);
+    const Run &runAt(int index) const;
+    qint32 latitude(int index) const;
+    qint32 longitude(int index) const;
+    void buildLevels();
+    void buildIndex() const;
+    double edgeDistance(int edge, double x, double y, double *fraction) const;
+
+    QVector<Run> m_runs;
+    PointsPointer m_points; // those stored by this geometry
+    int m_size = 0;
+    // Indices of the points kept at each level of detail, from the finest to the coarsest.
+    QVector<QVector<int>> m_levels;
+
+    // Built on the first projection: distances along the path, in meters, and a grid of
+    // the edges crossing each cell, in meters from the equator and prime meridian.
+    mutable QMutex m_indexMutex;
+    mutable QVector<double> m_distances;
+    mutable QHash<quint64, QVector<int>> m_cells;
+    mutable double m_lonScale = 1.0;
+    mutable double m_cellSize = 0.0;
+    mutable int m_minCellX = 0;
+    mutable int m_maxCellX = -1;
+    mutable int m_minCellY = 0;
+    mutable int m_maxCellY = -1;
+};
+
+typedef QExplicitlySharedDataPointer<QGeoRouteGeometryTomTom> QGeoRouteGeometryPointerTomTom;
+
+/*
+    The segments of a route and of its legs, built on first access by a function set by the
+    parser, which keeps what it needs in compact form until then. Shared by the route, its
+    legs and all their copies, which may be accessed from the parser pool, hence the lock.
+*/
+class QGeoRouteSegmentsTomTom
+{
+public:
+    // Returns the first segment of each leg, the segments of all legs chained together
+    typedef std::function<QVector<QGeoRouteSegment>()> Builder;
+
+    void setBuilder(const Builder &builder);
+    QGeoRouteSegment firstSegment(int leg);
+
+private:
+    QMutex m_mutex;
+    Builder m_builder;
+    QVector<QGeoRouteSegment> m_legFirstSegments;
+};
+
+typedef QSharedPointer<QGeoRouteSegmentsTomTom> QGeoRouteSegmentsPointerTomTom;
+
+// Where a position lies along a route, see QGeoRouteTomTom::project()
+struct QGeoRouteProjectionTomTom
+{
+    bool isValid = false;
+    QGeoCoordinate position;         // closest point of the route
+    double distanceFromRoute = 0.0;  // meters
+    int pathIndex = -1;              // the position is between this point of the path and the next
+    double offset = 0.0;             // meters along the path from its start
+    QGeoRouteSegment segment;        // holding the position, if the route has segments
+    int segmentIndex = -1;
+    double remainingDistance = 0.0;  // meters to the end of the route
+    double remainingTime = 0.0;      // seconds to the end of the route
+};
+
+/*
+    The segments of a route with their range of its path, and the distance and time left
+    after each of them, built on the first projection onto the route.
+*/
+class QGeoRouteProgressTomTom
+{
+public:
+    QGeoRouteProjectionTomTom project(const QGeoRoute &route, const QGeoCoordinate &position);
+
+private:
+    void build(const QGeoRoute &route);
+
+    QMutex m_mutex;
+    bool m_built = false;
+    QGeoRouteGeometryPointerTomTom m_geometry;
+    int m_first = 0;
+    int m_last = -1;
+    QVector<QGeoRouteSegment> m_segments;
+    QVector<int> m_segmentStarts;
+    QVector<int> m_segmentEnds;
+    QVector<double> m_distanceAfter;
+    QVector<double> m_timeAfter;
+};
+
+typedef QSharedPointer<QGeoRouteProgressTomTom> QGeoRouteProgressPointerTomTom;
+
+class QGeoRoutePrivateTomTom : public QGeoRoutePrivateDefault
+{
+public:
+    QGeoRoutePrivateTomTom();
+    QGeoRoutePrivateTomTom(const QGeoRoutePrivateDefault &other);
+    QGeoRoutePrivateTomTom(const QGeoRoutePrivateTomTom &other);
+
+    QGeoRoutePrivate *clone() override;
+    QString engineName() const override;
+    QVariantMap metadata() const override;
+    void setPath(const QList<QGeoCoordinate> &path) override;
+    QList<QGeoCoordinate> path() const override;
+    QGeoRouteSegment firstSegment() const override;
+    void setFirstSegment(const QGeoRouteSegment &firstSegment) override;
+    int segmentsCount() const override;
+
+    QVariantMap m_metadata;
+    QGeoRouteGeometryPointerTomTom m_geometry;
+    int m_first = 0;
+    int m_last = -1;
+    // Segments built on first access, if set: those of leg m_segmentsLeg, or of the route if -1
+    QGeoRouteSegmentsPointerTomTom m_segments;
+    int m_segmentsLeg = -1;
+    // Reset whenever the path or the segments change
+    QGeoRouteProgressPointerTomTom m_progress;
+};
+
+class QGeoRouteSegmentPrivateTomTom : public QGeoRouteSegmentPrivateDefault
+{
+public:
+    QGeoRouteSegmentPrivateTomTom(const QGeoRouteGeometryPointerTomTom &geometry, int first, int last);
+    QGeoRouteSegmentPrivateTomTom(const QGeoRouteSegmentPrivateTomTom &other);
+
+    QGeoRouteSegmentPrivate *clone() override;
+    void setPath(const QList<QGeoCoordinate> &path) override;
+    QList<QGeoCoordinate> path() const override;
+
+    QGeoRouteGeometryPointerTomTom m_geometry;
+    int m_first;
+    int m_last;
+};
+
+class QGeoRouteTomTom : public QGeoRoute
+{
+public:
+    QGeoRouteTomTom(const QGeoRouteGeometryPointerTomTom &geometry,
+                    const QGeoRouteSegmentsPointerTomTom &segments = QGeoRouteSegmentsPointerTomTom());
+    QGeoRouteTomTom(const QGeoRoute &other, const QVariantMap &metadata);
+
+    static QList<QGeoCoordinate> simplifiedPath(const QGeoRoute &route, double toleranceMeters, int from = 0);
+    static QGeoRouteProjectionTomTom project(const QGeoRoute &route, const QGeoCoordinate &position);
+    static QList<QList<QGeoCoordinate>> ownPaths(const QGeoRoute &route);
+    static QVector<QPair<int, QGeoRouteSegment>> segments(const QGeoRoute &route);
+    static int legIndex(const QGeoRoute &route, int pathIndex);
+};
+
+class QGeoRouteLegTomTom : public QGeoRouteLeg
+{
+public:
+    QGeoRouteLegTomTom(const QGeoRouteGeometryPointerTomTom &geometry, int first, int last,
+                       const QGeoRouteSegmentsPointerTomTom &segments = QGeoRouteSegmentsPointerTomTom(),
+                       int leg = -1);
+};
+
+class QGeoRouteSegmentTomTom : public QGeoRouteSegment
+{
+public:
+    QGeoRouteSegmentTomTom(const QGeoRouteGeometryPointerTomTom &geometry, int first, int last);
+};
+
+QT_END_NAMESPACE
+
+#endif // QGEOROUTETOMTOM_H
@@ -21,17 +21,23 @@
 #include "qgeoroutingmanagerenginetomtom.h"
 #include "qgeoroutereplytomtom.h"
 #include "qtomtomcommon.h"
+#include "qtomtomjsonreader.h"
+#include "qgeoroutetomtom.h"
+#include "qgeoroutecachetomtom.h"
+#include "qgeoroutebatchreplytomtom.h"
+#include "qgeoroutematrixtomtom.h"
 #include <QtLocation/private/qgeorouteparser_p.h>
 #include <QtLocation/private/qgeorouteparser_p_p.h>
 #include <QtLocation/qgeoroutesegment.h>
 #include <QtLocation/private/qgeoroutesegment_p.h>
 #include <QtLocation/qgeomaneuver.h>
+#include <QtLocation/private/qabstractgeotilecache_p.h>
 
-#include <QtCore/QJsonDocument>
-#include <QtCore/QJsonObject>
-#include <QtCore/QJsonArray>
 #include <QtCore/QUrlQuery>
 #include <QtCore/QDebug>
+#include <QtCore/QHash>
+#include <QtCore/QVarLengthArray>
+#include <limits>
 
 QT_BEGIN_NAMESPACE
 
@@ -42,20 +48,76 @@ static const QSet<QByteArray> acceptedLanguages {
 class CompareGeoCoordinate
 {
 public:
-    bool operator()( const QGeoCoordinate &c1, const QGeoCoordinate &c2 ) const
-    {
-        return c1.latitude() < c2.latitude() ||
-                (c1.latitude() == c2.latitude() && c1.longitude() < c2.longitude());
-    }
     static bool equal(const QGeoCoordinate &c1, const QGeoCoordinate &c2 )
     {
         return c1.latitude() == c2.latitude() && c1.longitude() == c2.longitude();
     }
 };
-typedef std::map< QGeoCoordinate, QVector<int>, CompareGeoCoordinate > CoordinateMap;
-static QByteArray toString(const QGeoCoordinate &crd)
+
+/*
+    Positions of each coordinate in a route path, in ascending order. Most coordinates
+    appear once, the junctions between legs twice, so lookups are constant time.
+*/
+class CoordinateIndex
 {
-    return QString::number(crd.latitude(), 'f', 10).toLatin1() + ',' + QString::number(crd.longitude(), 'f', 10).toLatin1();
+public:
+    void insert(const QGeoCoordinate &c, int position)
+    {
+        m_positions[key(c)].append(position);
+    }
+    bool contains(const QGeoCoordinate &c) const
+    {
+        return m_positions.contains(key(c));
+    }
+    // First position of c in [from, to), or -1
+    int find(const QGeoCoordinate &c, int from, int to = std::numeric_limits<int>::max()) const
+    {
+        const auto it = m_positions.constFind(key(c));
+        if (it == m_positions.constEnd())
+            return -1;
+        for (int position : it.value()) {
+            if (position >= from && position < to)
+                return position;
+        }
+        return -1;
+    }
+
+private:
+    static QPair<double, double> key(const QGeoCoordinate &c)
+    {
+        return qMakePair(c.latitude(), c.longitude());
+    }
+
+    QHash<QPair<double, double>, QVarLengthArray<int, 2>> m_positions;
+};
+static QByteArray toString(const QGeoCoordinate &crd, int decimals = 10)
+{
+    return QByteArray::number(crd.latitude(), 'f', decimals) + ',' + QByteArray::number(crd.longitude(), 'f', decimals);
+}
+
+// Supporting points accept QGeoCoordinate values, or maps with "latitude" and "longitude" (from QML)
+static QList<QGeoCoordinate> supportingPoints(const QGeoRouteRequest &request)
+{
+    QList<QGeoCoordinate> res;
+    const QVariantList points = request.extraParameters().value(QStringLiteral("tomtom")).toMap()
+            .value(QStringLiteral("supportingPoints")).toList();
+    for (const QVariant &p: points) {
+        if (p.canConvert<QGeoCoordinate>()) {
+            res.append(p.value<QGeoCoordinate>());
+        } else {
+            const QVariantMap m = p.toMap();
+            res.append(QGeoCoordinate(m.value(QStringLiteral("latitude")).toDouble(),
+                                      m.value(QStringLiteral("longitude")).toDouble()));
+        }
+    }
+    return res;
+}
+
+// Routes with travel time and distance only, for ETA queries: no geometry, no guidance
+static bool isSummaryOnly(const QGeoRouteRequest &request)
+{
+    return request.extraParameters().value(QStringLiteral("tomtom")).toMap()
+            .value(QStringLiteral("summaryOnly")).toBool();
 }
 class QGeoRouteParserTomTomPrivate;
 class QGeoRouteParserTomTom : public QGeoRouteParser
@@ -65,6 +127,10 @@ class QGeoRouteParserTomTom : public QGeoRouteParser
 public:
     QGeoRouteParserTomTom(QGeoRoutingManagerEngineTomTom *parent, const QByteArray &token);
     ~QGeoRouteParserTomTom() override {}
+
+    QUrl compactRequestUrl(const QGeoRouteRequest &request) const;
+    QByteArray requestBody(const QGeoRouteRequest &request) const;
+    QByteArray batchItem(const QGeoRouteRequest &request) const;
 };
 
 class QGeoRouteParserTomTomPrivate :  public QGeoRouteParserPrivate
@@ -94,12 +160,17 @@ public:
         return res;
     }
     virtual QUrl requestUrl(const QGeoRouteRequest &request, const QString &/*prefix*/) const override
+    {
+        return requestUrl(request, 10);
+    }
+
+    QUrl requestUrl(const QGeoRouteRequest &request, int decimals) const
     {
         QByteArray url = QTomTomCommon::baseUrlRouting;
         // Parse waypoints
         QByteArray wpts;
         for (const QGeoCoordinate &w: request.waypoints())
-            wpts += ':' + toString(w);
+            wpts += ':' + toString(w, decimals);
         url += wpts.right(wpts.size() - 1) + QByteArrayLiteral("/json");
         QUrl routingUrl(url);
         QUrlQuery query;
@@ -107,8 +178,12 @@ public:
         query.addQueryItem(QLatin1String("maxAlternatives"), QString::number(request.numberAlternativeRoutes()));
         query.addQueryItem(QLatin1String("travelMode"),
                            travelModes.value(travelModesToList(request.travelModes()).first()));
-        query.addQueryItem(QLatin1String("instructionsType"), QLatin1String("text"));
-        query.addQueryItem(QLatin1String("language"), m_language);
+        if (isSummaryOnly(request)) {
+            query.addQueryItem(QLatin1String("routeRepresentation"), QLatin1String("summaryOnly"));
+        } else {
+            query.addQueryItem(QLatin1String("instructionsType"), QLatin1String("text"));
+            query.addQueryItem(QLatin1String("language"), m_language);
+        }
 
         // ToDo: support all extras described in
         // - https://developer.tomtom.com/routing-api/routing-api-documentation-routing/common-routing-parameters
@@ -121,155 +196,513 @@ public:
         routingUrl.setQuery(query);
         return routingUrl;
     }
-    static QGeoCoordinate coordinateFromMap(const QVariant &c) {
-        const QVariantMap crd = c.toMap();
-        const double lati = crd["latitude"].toDouble();
-        const double longi = crd["longitude"].toDouble();
-        return QGeoCoordinate(lati, longi);
+
+    // Body of the POST variant of calculateRoute. Only supporting points for now.
+    QByteArray requestBody(const QGeoRouteRequest &request) const
+    {
+        const QList<QGeoCoordinate> points = supportingPoints(request);
+        if (points.isEmpty())
+            return QByteArray();
+        QByteArray body = QByteArrayLiteral("{\"supportingPoints\":[");
+        body.reserve(body.size() + points.size() * 48 + 2);
+        for (int i = 0; i < points.size(); ++i) {
+            if (i)
+                body += ',';
+            body += QByteArrayLiteral("{\"latitude\":") + QByteArray::number(points.at(i).latitude(), 'f', 7)
+                  + QByteArrayLiteral(",\"longitude\":") + QByteArray::number(points.at(i).longitude(), 'f', 7) + '}';
+        }
+        body += QByteArrayLiteral("]}");
+        return body;
+    }
+
+    // The parts of a calculateRoute reply that are used, read in a single pass.
+    struct Instruction
+    {
+        QGeoCoordinate point;
+        int routeOffsetInMeters = 0;
+        int travelTimeInSeconds = 0;
+        QString message;
+        QByteArray maneuver;
+        QByteArray drivingSide;
+        QByteArray instructionType;
+    };
+    struct Leg
+    {
+        int lengthInMeters = 0;
+        int travelTimeInSeconds = 0;
+        QVector<QGeoCoordinate> points;
+    };
+    struct Route
+    {
+        bool hasSummary = false;
+        bool hasLength = false;
+        bool hasTravelTime = false;
+        int lengthInMeters = 0;
+        int travelTimeInSeconds = 0;
+        QVector<Leg> legs;
+        QVector<Instruction> instructions;
+    };
+
+    // Reads the next value, skipping it unless it is of the expected type.
+    static bool enter(QTomTomJsonReader &json, QTomTomJsonReader::Token type)
+    {
+        if (json.next() == type)
+            return true;
+        json.skipCurrent();
+        return false;
     }
-    virtual QGeoRouteReply::Error parseReply(QList<QGeoRoute> &routes,
-                                             QString &errorString,
-                                             const QByteArray &reply,
-                                             const QGeoRouteRequest &request) const override
+    // Moves to the next object in the current array, skipping elements of any other type.
+    static bool nextObject(QTomTomJsonReader &json)
     {
-        struct LegFinder
-        {
-            static int leg(const QGeoCoordinate &c, const QVector<CoordinateMap> &coordinateMaps)
-            {
-                for (int l = 0; l < coordinateMaps.size(); l++) {
-                    const CoordinateMap &cm = coordinateMaps.at(l);
-                    if (cm.find(c) != cm.end())
-                        return l;
+        for (;;) {
+            switch (json.next()) {
+            case QTomTomJsonReader::BeginObject:
+                return true;
+            case QTomTomJsonReader::BeginArray:
+                json.skipCurrent();
+                break;
+            case QTomTomJsonReader::String:
+            case QTomTomJsonReader::Number:
+            case QTomTomJsonReader::Bool:
+            case QTomTomJsonReader::Null:
+                break;
+            default:
+                return false; // end of the array, or an error
+            }
+        }
+    }
+    static void readCoordinate(QTomTomJsonReader &json, QGeoCoordinate &coordinate)
+    {
+        if (json.token() != QTomTomJsonReader::BeginObject) {
+            json.skipCurrent();
+            return;
+        }
+        double latitude = 0.0;
+        double longitude = 0.0;
+        while (json.next() == QTomTomJsonReader::Name) {
+            if (json.isName("latitude")) {
+                if (enter(json, QTomTomJsonReader::Number))
+                    latitude = json.number();
+            } else if (json.isName("longitude")) {
+                if (enter(json, QTomTomJsonReader::Number))
+                    longitude = json.number();
+            } else {
+                json.skipValue();
+            }
+        }
+        coordinate = QGeoCoordinate(latitude, longitude);
+    }
+    static void readSummary(QTomTomJsonReader &json, int &lengthInMeters, int &travelTimeInSeconds,
+                            bool *hasLength = nullptr, bool *hasTravelTime = nullptr)
+    {
+        if (!enter(json, QTomTomJsonReader::BeginObject))
+            return;
+        while (json.next() == QTomTomJsonReader::Name) {
+            if (json.isName("lengthInMeters")) {
+                if (enter(json, QTomTomJsonReader::Number)) {
+                    lengthInMeters = json.toInt();
+                    if (hasLength)
+                        *hasLength = true;
                 }
-                return -1;
+            } else if (json.isName("travelTimeInSeconds")) {
+                if (enter(json, QTomTomJsonReader::Number)) {
+                    travelTimeInSeconds = json.toInt();
+                    if (hasTravelTime)
+                        *hasTravelTime = true;
+                }
+            } else {
+                json.skipValue();
             }
+        }
+    }
+    static void readLeg(QTomTomJsonReader &json, Leg &leg)
+    {
+        while (json.next() == QTomTomJsonReader::Name) {
+            if (json.isName("summary")) {
+                readSummary(json, leg.lengthInMeters, leg.travelTimeInSeconds);
+            } else if (json.isName("points")) {
+                if (!enter(json, QTomTomJsonReader::BeginArray))
+                    continue;
+                while (nextObject(json)) {
+                    leg.points.append(QGeoCoordinate());
+                    readCoordinate(json, leg.points.last());
+                }
+            } else {
+                json.skipValue();
+            }
+        }
+    }
+    static void readInstruction(QTomTomJsonReader &json, Instruction &instruction)
+    {
+        while (json.next() == QTomTomJsonReader::Name) {
+            if (json.isName("point")) {
+                json.next();
+                readCoordinate(json, instruction.point);
+            } else if (json.isName("routeOffsetInMeters")) {
+                if (enter(json, QTomTomJsonReader::Number))
+                    instruction.routeOffsetInMeters = json.toInt();
+            } else if (json.isName("travelTimeInSeconds")) {
+                if (enter(json, QTomTomJsonReader::Number))
+                    instruction.travelTimeInSeconds = json.toInt();
+            } else if (json.isName("message")) {
+                if (enter(json, QTomTomJsonReader::String))
+                    instruction.message = json.string();
+            } else if (json.isName("maneuver")) {
+                if (enter(json, QTomTomJsonReader::String))
+                    instruction.maneuver = json.bytes();
+            } else if (json.isName("drivingSide")) {
+                if (enter(json, QTomTomJsonReader::String))
+                    instruction.drivingSide = json.bytes();
+            } else if (json.isName("instructionType")) {
+                if (enter(json, QTomTomJsonReader::String))
+                    instruction.instructionType = json.bytes();
+            } else {
+                json.skipValue();
+            }
+        }
+    }
+    static void readRoute(QTomTomJsonReader &json, Route &route)
+    {
+        while (json.next() == QTomTomJsonReader::Name) {
+            if (json.isName("summary")) {
+                route.hasSummary = true;
+                readSummary(json, route.lengthInMeters, route.travelTimeInSeconds,
+                            &route.hasLength, &route.hasTravelTime);
+            } else if (json.isName("legs")) {
+                if (!enter(json, QTomTomJsonReader::BeginArray))
+                    continue;
+                while (nextObject(json)) {
+                    route.legs.append(Leg());
+                    readLeg(json, route.legs.last());
+                }
+            } else if (json.isName("guidance")) {
+                if (!enter(json, QTomTomJsonReader::BeginObject))
+                    continue;
+                while (json.next() == QTomTomJsonReader::Name) {
+                    if (!json.isName("instructions") || !enter(json, QTomTomJsonReader::BeginArray)) {
+                        if (json.token() == QTomTomJsonReader::Name)
+                            json.skipValue();
+                        continue;
+                    }
+                    while (nextObject(json)) {
+                        route.instructions.append(Instruction());
+                        readInstruction(json, route.instructions.last());
+                    }
+                }
+            } else {
+                json.skipValue();
+            }
+        }
+    }
+    // A route with only the summaries of the route and of its legs
+    static QGeoRoute summaryRoute(const Route &r, const QGeoRouteRequest &request)
+    {
+        QGeoRoute route;
+        route.setTravelTime(r.travelTimeInSeconds);
+        route.setDistance(r.lengthInMeters);
+        route.setTravelMode(travelModesToList(request.travelModes()).first());
 
-            static bool exists(const QGeoCoordinate &c, const QVector<QGeoCoordinate> &legGeometry)
-            {
-                for (int i = 0; i < legGeometry.size(); ++i)
-                    if (CompareGeoCoordinate::equal(legGeometry.at(i), c))
-                        return true;
-                return false;
+        QList<QGeoRouteLeg> routeLegs;
+        for (int i = 0; i < r.legs.size(); ++i) {
+            QGeoRouteLeg routeLeg;
+            routeLeg.setLegIndex(i);
+            routeLeg.setOverallRoute(route); // QGeoRoute::d_ptr is explicitlySharedDataPointer. Modifiers below won't detach it.
+            routeLeg.setDistance(r.legs.at(i).lengthInMeters);
+            routeLeg.setTravelTime(r.legs.at(i).travelTimeInSeconds);
+            routeLegs << routeLeg;
+        }
+        route.setRouteLegs(routeLegs);
+        return route;
+    }
+    // Returns false if the reply is not valid JSON. hasRoutes tells whether it had a routes member.
+    static bool readRoutes(const QByteArray &reply, QVector<Route> &routes, bool &hasRoutes, QString &errorString)
+    {
+        QTomTomJsonReader json(reply);
+        hasRoutes = false;
+        if (json.next() != QTomTomJsonReader::BeginObject) {
+            errorString = QLatin1String("Couldn't parse json.");
+            return false;
+        }
+        while (json.next() == QTomTomJsonReader::Name) {
+            if (json.isName("routes")) {
+                hasRoutes = true;
+                if (!enter(json, QTomTomJsonReader::BeginArray))
+                    continue;
+                while (nextObject(json)) {
+                    routes.append(Route());
+                    readRoute(json, routes.last());
+                }
+            } else {
+                json.skipValue();
             }
+        }
+        if (json.hasError()) {
+            errorString = QLatin1String("Couldn't parse json: ") + json.errorString();
+            return false;
+        }
+        return true;
+    }
+    /*
+        Builds the chain of segments and maneuvers of a route, returning the first segment
+        of each leg. Segments reference ranges of the route geometry. instructionPositions
+        holds the position of each instruction in the route path, as resolved while parsing.
+    */
+    static QVector<QGeoRouteSegment> buildSegments(const QGeoRouteGeometryPointerTomTom &geometry,
+                                                   const QVector<int> &legStart,
+                                                   const QVector<Instruction> &instructions,
+                                                   const QVector<int> &instructionPositions)
+    {
+        QVector<QVector<QGeoRouteSegment>> legSegments;
+        legSegments << QVector<QGeoRouteSegment>();
+        QGeoRouteSegment segment;
+        QGeoRouteSegment lastSegment;
+        int currentLeg = 0;
+        int totalTime = 0;
+        int totalDistance = 0;
+        // Start of the next segment in the current leg. Segments are consumed front to back,
+        // so matching all the instructions is linear in the size of the route.
+        int legCursor = 0;
+        int legSize = legStart.at(1);
 
-            static int findInPath(const QGeoCoordinate &c, const QList<QGeoCoordinate> &routePath, unsigned int initialIdx = 0)
-            {
-                if (!routePath.size())
-                    return -1;
-                for (int i = qMin(int(initialIdx), routePath.size() -1); i < routePath.size(); ++i)
-                    if (CompareGeoCoordinate::equal(routePath.at(i), c))
-                        return i;
-                return -1;
+        for (int idx = 0; idx < instructions.size(); ++idx) {
+            lastSegment = segment;
+            Instruction i = instructions.at(idx);
+            QGeoCoordinate c = i.point;
+            bool switchLeg = false;
+            bool legHeadInjected = false;
+
+            if (idx == 0) {
+                Q_ASSERT(CompareGeoCoordinate::equal(c, geometry->at(0)));
+                Q_ASSERT(i.instructionType == "LOCATION_DEPARTURE");
+            } else {
+                // Cheating: Verify that the instruction matches the coordinate.
+                // If not, inject a "Depart" instruction.
+                const QGeoCoordinate legHead = geometry->at(legStart.at(currentLeg) + legCursor);
+                if (!CompareGeoCoordinate::equal(c, legHead)) {
+                    legHeadInjected = true;
+                    c = legHead;
+                    i = Instruction();
+                    i.maneuver = QByteArrayLiteral("DEPART");
+                    i.routeOffsetInMeters = instructions.at(idx-1).routeOffsetInMeters; // Use last (waypoint reached)
+                    i.travelTimeInSeconds = instructions.at(idx-1).travelTimeInSeconds; // Use last (waypoint reached)
+                    i.message = QGeoRouteParserTomTom::tr("Depart from waypoint");
+                }
             }
 
-            static QList<QGeoCoordinate> popFrontSegment(QList<QGeoCoordinate> &coords, int nextPos)
-            {
-                QList<QGeoCoordinate> res = coords.mid(0, nextPos + 1);
-                coords = coords.mid(nextPos, coords.size() - nextPos);
-                return res;
+            int nextId = legSize - 1;
+            // Find next
+            if (idx < instructions.size() - 1) {
+                int nextCur = (legHeadInjected) ? idx : idx+1;
+                const QGeoCoordinate &nextPos = instructions.at(nextCur).point;
+                // For simplicity, let's assume one leg can't have less than 2 instructions.
+                const int from = legStart.at(currentLeg) + legCursor;
+                const int to = legStart.at(currentLeg + 1);
+                nextId = instructionPositions.at(nextCur);
+                if (nextId < from) {
+                    // Resolved before the current leg, e.g. at the end of the previous one: look again from here
+                    nextId = -1;
+                    for (int p = from; p < to; ++p) {
+                        if (CompareGeoCoordinate::equal(nextPos, geometry->at(p))) {
+                            nextId = p;
+                            break;
+                        }
+                    }
+                }
+                if (nextId < 0 || nextId >= to) { // switch
+                    switchLeg = true;
+                    nextId = legSize - 1;
+                } else {
+                    nextId -= legStart.at(currentLeg);
+                }
+            } else // last instruction, go to end
+                nextId = legSize - 1;
+
+            // The segment only references its range of the route geometry
+            segment = QGeoRouteSegmentTomTom(geometry,
+                                             legStart.at(currentLeg) + legCursor,
+                                             legStart.at(currentLeg) + nextId);
+            legCursor = nextId;
+
+            const int routeOffset = i.routeOffsetInMeters;
+            const int travelTimeInSeconds = i.travelTimeInSeconds;
+            segment.setDistance(routeOffset  -  totalDistance); // This is incorrect. this is the offset from the start. fixed below.
+            segment.setTravelTime(travelTimeInSeconds - totalTime); // This is incorrect too. it is related to the previous seg. fixed below.
+            totalTime = travelTimeInSeconds;
+            totalDistance = routeOffset;
+            QGeoManeuver maneuver;
+            maneuver.setInstructionText(i.message);
+            maneuver.setPosition(c);
+            maneuver.setWaypoint(c);
+            maneuver.setDistanceToNextInstruction(segment.distance());
+            maneuver.setTimeToNextInstruction(segment.travelTime());
+            maneuver.setDirection(maneuverDirections.value(i.maneuver, QGeoManeuver::NoDirection));
+            // use  <drivingSide> to flip the U-turn side, if necessary.
+            const QByteArray &drivingSide = i.drivingSide;
+            if (maneuver.direction() == QGeoManeuver::DirectionUTurnLeft
+                    && drivingSide == QByteArrayLiteral("LEFT"))
+                maneuver.setDirection(QGeoManeuver::DirectionUTurnRight);
+
+//                maneuver.setExtendedAttributes(i);
+            segment.setManeuver(maneuver);
+
+            if (idx > 0)
+                lastSegment.setNextRouteSegment(segment);
+
+            if (switchLeg || idx == instructions.size() - 1) {
+                // Note: this is needed in order to terminate the leg!
+                QGeoRouteSegmentPrivate *segmentPrivate = QGeoRouteSegmentPrivate::get(segment);
+                segmentPrivate->setLegLastSegment(true);
             }
-        };
+            legSegments.last().append(segment);
 
-        QJsonDocument document = QJsonDocument::fromJson(reply);
-        if (Q_UNLIKELY(!document.isObject())) {
-            errorString = QLatin1String("Couldn't parse json.");
-            return QGeoRouteReply::ParseError;
+            if (switchLeg) {
+                currentLeg++;
+                legSize = legStart.at(currentLeg + 1) - legStart.at(currentLeg);
+                legCursor = 0;
+                legSegments << QVector<QGeoRouteSegment>();
+            }
+
+            if (legHeadInjected)
+                idx--;
         }
 
-        QJsonObject object = document.object();
-//        qDebug().noquote()  << document.toJson(QJsonDocument::Indented);
-//        QFile file("/tmp/tommy.json");
-//        file.open(QIODevice::WriteOnly);
-//        file.write(document.toJson(QJsonDocument::Indented));
-//        file.close();
+        // Then split segments into legs
+        QVector<QGeoRouteSegment> legFirstSegments;
+        for (int legIndex = 0; legIndex < legStart.size() - 1; ++legIndex) {
+            QVector<QGeoRouteSegment> segments = legSegments.at(legIndex);
+            legFirstSegments.append(segments.first());
+            // and fix the distances and traveltimes, specified for maneuvers at the END of a segment, not at the beginning.
+            for (int segmentIndex = 0; segmentIndex < segments.size(); segmentIndex++) {
+                QGeoRouteSegment &current = segments[segmentIndex];
+                if (segmentIndex == segments.size() - 1) {
+                    current.setTravelTime(0);
+                    current.setDistance(0);
+                    QGeoManeuver currentManeuver = current.maneuver();
+                    currentManeuver.setTimeToNextInstruction(0);
+                    currentManeuver.setDistanceToNextInstruction(0);
+                    current.setManeuver(currentManeuver);
+                } else {
+                    QGeoRouteSegment &next = segments[segmentIndex + 1];
+                    current.setTravelTime(next.travelTime());
+                    current.setDistance(next.distance());
+                    QGeoManeuver currentManeuver = current.maneuver();
+                    currentManeuver.setTimeToNextInstruction(next.maneuver().timeToNextInstruction());
+                    currentManeuver.setDistanceToNextInstruction(next.maneuver().distanceToNextInstruction());
+                    current.setManeuver(currentManeuver);
+                }
+            }
+        }
+        return legFirstSegments;
+    }
+    virtual QGeoRouteReply::Error parseReply(QList<QGeoRoute> &routes,
+                                             QString &errorString,
+                                             const QByteArray &reply,
+                                             const QGeoRouteRequest &request) const override
+    {
+        QVector<Route> parsedRoutes;
+        bool hasRoutes = false;
+        if (Q_UNLIKELY(!readRoutes(reply, parsedRoutes, hasRoutes, errorString)))
+            return QGeoRouteReply::ParseError;
 
-        if (Q_UNLIKELY(!object.contains(QLatin1String("routes")))) {
+        if (Q_UNLIKELY(!hasRoutes)) {
             qWarning() << "No routes in reply!";
             return QGeoRouteReply::UnknownError;
         }
 
-        QVariantList routesJson = object.value(QLatin1String("routes")).toArray().toVariantList();
-        for (const QVariant &r: routesJson) {
-            const QVariantMap routeMap = r.toMap();
-
-            if (Q_UNLIKELY(!routeMap.contains(QLatin1String("summary")))) {
+        const bool summaryOnly = isSummaryOnly(request);
+        QGeoRouteGeometryPointerTomTom mainGeometry;
+        QGeoRouteGeometryTomTom::PointIndex mainIndex; // of mainGeometry, once there are alternatives
+        for (const Route &r: qAsConst(parsedRoutes)) {
+            if (Q_UNLIKELY(!r.hasSummary)) {
                 qWarning() << "Empty summary!";
                 return QGeoRouteReply::UnknownError;
             }
-            const QVariantMap summary = routeMap.value(QLatin1String("summary")).toMap();
-
-
-            if (Q_UNLIKELY(!summary.contains(QLatin1String("travelTimeInSeconds")))) {
+            if (Q_UNLIKELY(!r.hasTravelTime)) {
                 qWarning() << "No travel time!";
                 return QGeoRouteReply::UnknownError;
             }
-            if (Q_UNLIKELY(!summary.contains(QLatin1String("lengthInMeters")))) {
+            if (Q_UNLIKELY(!r.hasLength)) {
                 qWarning() << "No length!";
                 return QGeoRouteReply::UnknownError;
             }
-            const int travelTime = summary.value(QLatin1String("travelTimeInSeconds")).toInt();
-            const int lengthInMeters = summary.value(QLatin1String("lengthInMeters")).toInt();
+            const int travelTime = r.travelTimeInSeconds;
+            const int lengthInMeters = r.lengthInMeters;
 
-            const QVariantMap guidance = routeMap.value(QLatin1String("guidance")).toMap();
-            const QVariantList instructionGroups = guidance.value(QLatin1String("instructionGroups")).toList();
-            QVariantList instructions = guidance.value("instructions").toList();
+            if (summaryOnly) {
+                routes.append(summaryRoute(r, request));
+                continue;
+            }
 
-            QGeoRoute route;
-            route.setTravelTime(travelTime);
-            route.setDistance(lengthInMeters);
-            route.setTravelMode(travelModesToList(request.travelModes()).first());
+            QVector<Instruction> instructions = r.instructions;
+            if (Q_UNLIKELY(instructions.size() < 2 || r.legs.isEmpty())) {
+                qWarning() << "Not enough instructions";
+                errorString = QLatin1String("Not enough instructions");
+                return QGeoRouteReply::ParseError;
+            }
 
-            QVector<CoordinateMap> coordinateMaps;
-            QList<QList<QGeoCoordinate>> legsGeometry;
-            const QVariantList &legs = routeMap.value(QLatin1String("legs")).toList();
-            QList<QGeoRouteLeg> routeLegs;
+            CoordinateIndex coordinateIndex;
+            const QVector<Leg> &legs = r.legs;
             QList<QGeoCoordinate> routePath;
+            // Where each leg starts in the route path, plus the end of the last one
+            QVector<int> legStart;
             int count = 0;
             for (int i = 0; i < legs.size(); ++i) {
-                QList<QGeoCoordinate> legGeometry;
-                CoordinateMap coordinateMap;
-                const QVariantMap l = legs.at(i).toMap();
-                const QVariantList geom = l["points"].toList();
+                legStart.append(count);
+                const QVector<QGeoCoordinate> &geom = legs.at(i).points;
                 for (int j = 0; j < geom.size(); ++j) {
-                    QGeoCoordinate crd(coordinateFromMap(geom.at(j)));
+                    const QGeoCoordinate &crd = geom.at(j);
                     if (j == 0 && i == 0) {
                         // Cheating: prepend first instruction coordinate if != first coordinate. Thanks, TomTom..
-                        const QGeoCoordinate &firstInstructionPoint = coordinateFromMap(instructions.first().toMap().value("point"));
+                        const QGeoCoordinate &firstInstructionPoint = instructions.first().point;
                         if (!CompareGeoCoordinate::equal(firstInstructionPoint, crd)) {
-                            legGeometry.append(firstInstructionPoint);
                             routePath.append(firstInstructionPoint);
-                            coordinateMap[firstInstructionPoint].append(count);
+                            coordinateIndex.insert(firstInstructionPoint, count);
                             count += 1;
                         }
                     }
 
-                    legGeometry.append(crd);
                     routePath.append(crd);
-                    coordinateMap[crd].append(count);
+                    coordinateIndex.insert(crd, count);
                     count += 1;
                 }
-
-                legsGeometry.append(legGeometry);
-                coordinateMaps.append(coordinateMap);
-                const QVariantMap summary = l["summary"].toMap();
-                const int lengthInMeters = summary["lengthInMeters"].toInt();
-                const int travelTimeInSeconds = summary["travelTimeInSeconds"].toInt();
-                QGeoRouteLeg routeLeg;
-                routeLeg.setPath(legGeometry);
-                routeLeg.setLegIndex(i);
-                routeLeg.setOverallRoute(route); // QGeoRoute::d_ptr is explicitlySharedDataPointer. Modifiers below won't detach it.
-                routeLeg.setDistance(lengthInMeters);
-                routeLeg.setTravelTime(travelTimeInSeconds);
-                routeLegs << routeLeg;
             }
             // Cheating: append last instruction coordinate if != last coordinate. Thanks, TomTom..
-            const QGeoCoordinate &lastInstructionPoint = coordinateFromMap(instructions.last().toMap().value("point"));
+            const QGeoCoordinate &lastInstructionPoint = instructions.last().point;
             if (!CompareGeoCoordinate::equal(lastInstructionPoint, routePath.last())) {
-                legsGeometry.last().append(lastInstructionPoint);
                 routePath.append(lastInstructionPoint);
+                coordinateIndex.insert(lastInstructionPoint, routePath.size() - 1);
             }
+            legStart.append(routePath.size());
+
+            // The route, its legs and its segments all reference ranges of this one geometry.
+            // Alternatives reference the runs they have in common with the main route.
+            if (mainGeometry && mainIndex.isEmpty())
+                mainIndex = mainGeometry->pointIndex();
+            QGeoRouteGeometryPointerTomTom geometry((mainGeometry)
+                                                    ? new QGeoRouteGeometryTomTom(routePath, *mainGeometry, mainIndex)
+                                                    : new QGeoRouteGeometryTomTom(routePath));
+            if (!mainGeometry)
+                mainGeometry = geometry;
+            routePath.clear();
 
-            route.setPath(routePath);
+            QGeoRouteSegmentsPointerTomTom segments;
+            if (!routes.isEmpty())
+                segments.reset(new QGeoRouteSegmentsTomTom);
+            QGeoRouteTomTom route(geometry, segments);
+            route.setTravelTime(travelTime);
+            route.setDistance(lengthInMeters);
+            route.setTravelMode(travelModesToList(request.travelModes()).first());
+
+            QList<QGeoRouteLeg> routeLegs;
+            for (int i = 0; i < legs.size(); ++i) {
+                const Leg &l = legs.at(i);
+                QGeoRouteLegTomTom routeLeg(geometry, legStart.at(i), legStart.at(i + 1) - 1, segments, i);
+                routeLeg.setLegIndex(i);
+                routeLeg.setOverallRoute(route); // QGeoRoute::d_ptr is explicitlySharedDataPointer. Modifiers below won't detach it.
+                routeLeg.setDistance(l.lengthInMeters);
+                routeLeg.setTravelTime(l.travelTimeInSeconds);
+                routeLegs << routeLeg;
+            }
 
             QVector<int> toRemove;
             QMap<int, int> instructionLeg;
@@ -280,13 +713,13 @@ public:
             // the above polyline, and inject it.
             // Temporary solution: Drop the instruction.
             for (int i = 0; i < instructions.size() - 1; ++i) { // do not remove the last instruction. it might not match the last position.
-                const QGeoCoordinate ic = coordinateFromMap(instructions.at(i).toMap().value("point"));
-                bool found = LegFinder::leg(ic, coordinateMaps) >= 0;
+                const QGeoCoordinate &ic = instructions.at(i).point;
+                bool found = coordinateIndex.contains(ic);
                 if (found)
                     continue;
                 // CLearly there are more cases like these
-//                Q_ASSERT(instructions.at(i).toMap().value("instructionType").toString() == QLatin1String("DIRECTION_INFO")
-//                      || instructions.at(i).toMap().value("maneuver").toString() == QLatin1String("TRY_MAKE_UTURN"));
+//                Q_ASSERT(instructions.at(i).instructionType == "DIRECTION_INFO"
+//                      || instructions.at(i).maneuver == "TRY_MAKE_UTURN");
                 toRemove.append(i);
             }
 
@@ -299,147 +732,40 @@ public:
                 return QGeoRouteReply::ParseError;
             }
 
-            // validate sequentiality
+            // validate sequentiality, resolving each instruction to its position in the route path
+            QVector<int> instructionPositions(instructions.size());
+            instructionPositions[0] = coordinateIndex.find(instructions.first().point, 0);
             int cur = 0;
             for (int i = 1; i < instructions.size(); ++i) {
-                const QGeoCoordinate ic0 = coordinateFromMap(instructions.at(i-1).toMap().value("point"));
-                const QGeoCoordinate ic1 = coordinateFromMap(instructions.at(i).toMap().value("point"));
-                const int ic0idx = LegFinder::findInPath(ic0, route.path(), cur);
-                const int ic1idx = LegFinder::findInPath(ic1, route.path(), cur);
+                const QGeoCoordinate &ic0 = instructions.at(i-1).point;
+                const QGeoCoordinate &ic1 = instructions.at(i).point;
+                const int ic0idx = coordinateIndex.find(ic0, cur);
+                const int ic1idx = coordinateIndex.find(ic1, cur);
                 if (Q_UNLIKELY( ic0idx > ic1idx )) {
                     qWarning() << "Instructions out of geographical order "<<ic0idx<< " " << ic1idx;
-                    qWarning() << "Next ic1idx: " << LegFinder::findInPath(ic1, route.path(), ic0idx + 1);
+                    qWarning() << "Next ic1idx: " << coordinateIndex.find(ic1, ic0idx + 1);
                     errorString = QLatin1String("Instructions out of geographical order");
                     return QGeoRouteReply::ParseError;
                 }
+                instructionPositions[i] = ic1idx;
                 cur = ic1idx;
             }
 
-            QVector<QVector<QGeoRouteSegment>> legSegments;
-            legSegments << QVector<QGeoRouteSegment>();
-            QGeoRouteSegment segment;
-            QGeoRouteSegment lastSegment;
-            int currentLeg = 0;
-            int totalTime = 0;
-            int totalDistance = 0;
-            int legCursor = 0;
-            QList<QGeoCoordinate> legGeometry = legsGeometry.first();
-
-            for (int idx = 0; idx < instructions.size(); ++idx) {
-                lastSegment = segment;
-                segment = QGeoRouteSegment();
-                QVariantMap i = instructions.at(idx).toMap();
-                QGeoCoordinate c = coordinateFromMap(i["point"]);
-                bool switchLeg = false;
-                bool legHeadInjected = false;
-
-                if (idx == 0) {
-                    const QGeoCoordinate crd = legsGeometry.first().first();
-                    Q_ASSERT(CompareGeoCoordinate::equal(c, legsGeometry.first().first()));
-                    Q_ASSERT(i["instructionType"] == QLatin1String("LOCATION_DEPARTURE"));
-                } else if (legCursor == 0) { // Beginning of leg
-                    // Cheating: Verify that the first instruction matches the coordinate.
-                    // If not, inject a "Depart" instruction.
-                    if (!CompareGeoCoordinate::equal(c, legGeometry.first())) {
-                        legHeadInjected = true;
-                        c = legGeometry.first();
-                        i = {
-                            {"maneuver", "DEPART"},
-                            {"routeOffsetInMeters", instructions.at(idx-1).toMap().value("routeOffsetInMeters")}, // Use last (waypoint reached)
-                            {"travelTimeInSeconds", instructions.at(idx-1).toMap().value("travelTimeInSeconds")}, // Use last (waypoint reached)
-                            {"message", QGeoRouteParserTomTom::tr("Depart from waypoint")}
-                        };
-                    }
-                }
-
-                int nextId = legGeometry.size() -1;
-                // Find next
-                if (idx < instructions.size() - 1) {
-                    int nextCur = (legHeadInjected) ? idx : idx+1;
-                    const QGeoCoordinate &nextPos = coordinateFromMap(instructions.at(nextCur).toMap()["point"]);
-                    // For simplicity, let's assume one leg can't have less than 2 instructions.
-                    nextId = LegFinder::findInPath(nextPos, legGeometry, legCursor);
-                    if (nextId < 0) { // switch
-                        switchLeg = true;
-                        nextId = legGeometry.size() -1;
-                    }
-                } else // last instruction, go to end
-                    nextId = legGeometry.size() -1;
-
-                // Extract geometry from legGeometry
-                QList<QGeoCoordinate> segmentGeometry = LegFinder::popFrontSegment(legGeometry, nextId);
-
-                const int routeOffset = i["routeOffsetInMeters"].toInt();
-                const int travelTimeInSeconds = i["travelTimeInSeconds"].toInt();
-                segment.setDistance(routeOffset  -  totalDistance); // This is incorrect. this is the offset from the start. fixed below.
-                segment.setTravelTime(travelTimeInSeconds - totalTime); // This is incorrect too. it is related to the previous seg. fixed below.
-                totalTime = travelTimeInSeconds;
-                totalDistance = routeOffset;
-                QGeoManeuver maneuver;
-                maneuver.setInstructionText(i["message"].toString());
-                maneuver.setPosition(c);
-                maneuver.setWaypoint(c);
-                maneuver.setDistanceToNextInstruction(segment.distance());
-                maneuver.setTimeToNextInstruction(segment.travelTime());
-                maneuver.setDirection(maneuverDirections.value(i["maneuver"].toString().toLatin1(),
-                                                                QGeoManeuver::NoDirection));
-                // use  <drivingSide> to flip the U-turn side, if necessary.
-                const QByteArray drivingSide = i["drivingSide"].toString().toLatin1();
-                if (maneuver.direction() == QGeoManeuver::DirectionUTurnLeft
-                        && drivingSide == QByteArrayLiteral("LEFT"))
-                    maneuver.setDirection(QGeoManeuver::DirectionUTurnRight);
-
-//                maneuver.setExtendedAttributes(i);
-                segment.setManeuver(maneuver);
-                segment.setPath(segmentGeometry);
-
-                if (idx > 0)
-                    lastSegment.setNextRouteSegment(segment);
-
-                if (switchLeg || idx == instructions.size() - 1) {
-                    // Note: this is needed in order to terminate the leg!
-                    QGeoRouteSegmentPrivate *segmentPrivate = QGeoRouteSegmentPrivate::get(segment);
-                    segmentPrivate->setLegLastSegment(true);
-                }
-                legSegments.last().append(segment);
-
-                if (switchLeg) {
-                    currentLeg++;
-                    legGeometry = legsGeometry.at(currentLeg);
-                    legSegments << QVector<QGeoRouteSegment>();
-                }
-
-                if (legHeadInjected)
-                    idx--;
-            }
-
-            // Then split segments into legs
-            for (int legIndex = 0; legIndex < routeLegs.size(); ++legIndex) {
-                QGeoRouteLeg &routeLeg = const_cast<QGeoRouteLeg &>(routeLegs.at(legIndex)); // do not detach
-                QVector<QGeoRouteSegment> segments = legSegments.at(legIndex);
-                routeLeg.setFirstRouteSegment(segments.first());
-                // and fix the distances and traveltimes, specified for maneuvers at the END of a segment, not at the beginning.
-                for (int segmentIndex = 0; segmentIndex < segments.size(); segmentIndex++) {
-                    QGeoRouteSegment &current = segments[segmentIndex];
-                    if (segmentIndex == segments.size() - 1) {
-                        current.setTravelTime(0);
-                        current.setDistance(0);
-                        QGeoManeuver currentManeuver = current.maneuver();
-                        currentManeuver.setTimeToNextInstruction(0);
-                        currentManeuver.setDistanceToNextInstruction(0);
-                        current.setManeuver(currentManeuver);
-                    } else {
-                        QGeoRouteSegment &next = segments[segmentIndex + 1];
-                        current.setTravelTime(next.travelTime());
-                        current.setDistance(next.distance());
-                        QGeoManeuver currentManeuver = current.maneuver();
-                        currentManeuver.setTimeToNextInstruction(next.maneuver().timeToNextInstruction());
-                        currentManeuver.setDistanceToNextInstruction(next.maneuver().distanceToNextInstruction());
-                        current.setManeuver(currentManeuver);
-                    }
+            // Alternatives get their segments and maneuvers built only when first accessed.
+            // The coordinate index is not needed past this point and goes with this iteration.
+            if (segments) {
+                segments->setBuilder([geometry, legStart, instructions, instructionPositions]() {
+                    return buildSegments(geometry, legStart, instructions, instructionPositions);
+                });
+            } else {
+                const QVector<QGeoRouteSegment> legFirstSegments = buildSegments(geometry, legStart,
+                                                                                 instructions, instructionPositions);
+                for (int legIndex = 0; legIndex < routeLegs.size(); ++legIndex) {
+                    QGeoRouteLeg &routeLeg = const_cast<QGeoRouteLeg &>(routeLegs.at(legIndex)); // do not detach
+                    routeLeg.setFirstRouteSegment(legFirstSegments.at(legIndex));
                 }
+                route.setFirstRouteSegment(legFirstSegments.first());
             }
-            route.setFirstRouteSegment(legSegments.first().first());
             route.setRouteLegs(routeLegs);
             routes.append(route);
         }
@@ -499,6 +825,46 @@ QGeoRouteParserTomTom::QGeoRouteParserTomTom(QGeoRoutingManagerEngineTomTom *par
 {
 }
 
+/*
+    Waypoints with 6 decimals (about 10cm), instead of 10, to keep long waypoint lists
+    within URL length limits. The locations have to stay in the path, also for POST requests.
+*/
+QUrl QGeoRouteParserTomTom::compactRequestUrl(const QGeoRouteRequest &request) const
+{
+    Q_D(const QGeoRouteParserTomTom);
+    return d->requestUrl(request, 6);
+}
+
+QByteArray QGeoRouteParserTomTom::requestBody(const QGeoRouteRequest &request) const
+{
+    Q_D(const QGeoRouteParserTomTom);
+    return d->requestBody(request);
+}
+
+/*
+    The request as an item of a batch routing body: the calculateRoute path and query,
+    relative to the routing service and without the key, plus the POST body if any.
+*/
+QByteArray QGeoRouteParserTomTom::batchItem(const QGeoRouteRequest &request) const
+{
+    Q_D(const QGeoRouteParserTomTom);
+    const QUrl url = d->requestUrl(request, 6);
+    QUrlQuery query(url);
+    query.removeAllQueryItems(QStringLiteral("key"));
+    QByteArray path = url.path(QUrl::FullyEncoded).toLatin1();
+    const QByteArray service = QByteArrayLiteral("/routing/") + QTomTomCommon::versionNumberRouting;
+    if (path.startsWith(service))
+        path.remove(0, service.size());
+
+    QByteArray item = QByteArrayLiteral("{\"query\":\"") + path + '?'
+            + query.toString(QUrl::FullyEncoded).toLatin1() + '"';
+    const QByteArray body = d->requestBody(request);
+    if (!body.isEmpty())
+        item += QByteArrayLiteral(",\"post\":") + body;
+    item += '}';
+    return item;
+}
+
 QGeoRoutingManagerEngineTomTom::QGeoRoutingManagerEngineTomTom(const QVariantMap &parameters,
                                                          QGeoServiceProvider::Error *error,
                                                          QString *errorString)
@@ -515,6 +881,81 @@ QGeoRoutingManagerEngineTomTom::QGeoRoutingManagerEngineTomTom(const QVariantMap
 
     QGeoRouteParserTomTom *parser = new QGeoRouteParserTomTom(this, accessToken);
     m_routeParser = parser;
+    m_accessToken = accessToken;
+
+    // Batch routing. The service URL can point to a local stand-in server.
+    m_batchUrl = QUrl(QString::fromLatin1(QTomTomCommon::baseUrlBatchRouting));
+    if (parameters.contains(QStringLiteral("tomtom.routing.batch.url")))
+        m_batchUrl = QUrl(parameters.value(QStringLiteral("tomtom.routing.batch.url")).toString());
+    if (parameters.contains(QStringLiteral("tomtom.routing.batch.size"))) {
+        bool ok = false;
+        const int size = parameters.value(QStringLiteral("tomtom.routing.batch.size")).toString().toInt(&ok);
+        if (ok)
+            m_batchSize = qBound(1, size, 700); // async batch limit
+    }
+
+    // Matrix routing. Larger matrices are split into tiles of at most max_cells cells.
+    m_matrixUrl = QUrl(QString::fromLatin1(QTomTomCommon::baseUrlMatrixRouting));
+    if (parameters.contains(QStringLiteral("tomtom.routing.matrix.url")))
+        m_matrixUrl = QUrl(parameters.value(QStringLiteral("tomtom.routing.matrix.url")).toString());
+    if (parameters.contains(QStringLiteral("tomtom.routing.matrix.max_cells"))) {
+        bool ok = false;
+        const int cells = parameters.value(QStringLiteral("tomtom.routing.matrix.max_cells")).toString().toInt(&ok);
+        if (ok)
+            m_matrixCells = qBound(1, cells, 700); // async matrix limit
+    }
+
+    // Reachable range
+    m_rangeUrl = QUrl(QString::fromLatin1(QTomTomCommon::baseUrlReachableRange));
+    if (parameters.contains(QStringLiteral("tomtom.routing.range.url")))
+        m_rangeUrl = QUrl(parameters.value(QStringLiteral("tomtom.routing.range.url")).toString());
+
+    // Waypoints per calculateRoute. Longer requests are split into chunks and stitched.
+    if (parameters.contains(QStringLiteral("tomtom.routing.max_waypoints"))) {
+        bool ok = false;
+        const int waypoints = parameters.value(QStringLiteral("tomtom.routing.max_waypoints")).toString().toInt(&ok);
+        if (ok)
+            m_maxWaypoints = qMax(2, waypoints);
+    }
+    // URL length above which calculateRoute prints waypoints with 6 decimals instead of 10.
+    // This only switches the precision, about 30% shorter per stop: from about 100 waypoints
+    // the URL still exceeds 2048 characters. POST is used for supporting points only.
+    if (parameters.contains(QStringLiteral("tomtom.routing.post_threshold"))) {
+        bool ok = false;
+        const int threshold = parameters.value(QStringLiteral("tomtom.routing.post_threshold")).toString().toInt(&ok);
+        if (ok)
+            m_postThreshold = threshold;
+    }
+
+    // Route cache. Results are kept for tomtom.routing.cache.ttl seconds, or
+    // tomtom.routing.cache.traffic_ttl if they depend on live traffic. A ttl of 0 disables it.
+    QString cacheDirectory;
+    if (parameters.contains(QStringLiteral("tomtom.routing.cache.directory")))
+        cacheDirectory = parameters.value(QStringLiteral("tomtom.routing.cache.directory")).toString();
+    else
+        cacheDirectory = QAbstractGeoTileCache::baseLocationCacheDirectory() + QLatin1String("tomtom/routes");
+    if (parameters.value(QStringLiteral("tomtom.routing.cache.disk")).toString().toLower() == QLatin1String("false"))
+        cacheDirectory.clear();
+    m_routeCache.reset(new QGeoRouteCacheTomTom(cacheDirectory));
+    if (parameters.contains(QStringLiteral("tomtom.routing.cache.ttl"))) {
+        bool ok = false;
+        const int ttl = parameters.value(QStringLiteral("tomtom.routing.cache.ttl")).toString().toInt(&ok);
+        if (ok)
+            m_routeCache->setTimeToLive(ttl);
+    }
+    if (parameters.contains(QStringLiteral("tomtom.routing.cache.traffic_ttl"))) {
+        bool ok = false;
+        const int ttl = parameters.value(QStringLiteral("tomtom.routing.cache.traffic_ttl")).toString().toInt(&ok);
+        if (ok)
+            m_routeCache->setTrafficTimeToLive(ttl);
+    }
+    if (parameters.contains(QStringLiteral("tomtom.routing.cache.memory_size"))) {
+        bool ok = false;
+        const int entries = parameters.value(QStringLiteral("tomtom.routing.cache.memory_size")).toString().toInt(&ok);
+        if (ok)
+            m_routeCache->setMaxMemoryEntries(entries);
+    }
+    m_routeCache->prune();
 
     *error = QGeoServiceProvider::NoError;
     errorString->clear();
@@ -522,6 +963,8 @@ QGeoRoutingManagerEngineTomTom::QGeoRoutingManagerEngineTomTom(const QVariantMap
 
 QGeoRoutingManagerEngineTomTom::~QGeoRoutingManagerEngineTomTom()
 {
+    // Replies may still be parsing with m_routeParser on the parser pool
+    QTomTomCommon::parserPool()->waitForDone();
 }
 
 QGeoRouteReply* QGeoRoutingManagerEngineTomTom::calculateRoute(const QGeoRouteRequest &request)
@@ -531,23 +974,311 @@ QGeoRouteReply* QGeoRoutingManagerEngineTomTom::calculateRoute(const QGeoRouteRe
         qWarning() << "At least 2 waypoints are required";
         return nullptr;
     }
-    QNetworkRequest req;
-    req.setHeader(QNetworkRequest::UserAgentHeader, m_userAgent);
-    req.setUrl(routeParser()->requestUrl(request, QString()));
-    qDebug() << "QGeoRoutingManagerEngineTomTom::calculateRoute "<< req.url();
-    QNetworkReply *reply = m_networkManager->get(req);
-    QGeoRouteReplyTomTom *routeReply = new QGeoRouteReplyTomTom(reply, request, this);
+
+    QGeoRouteReplyTomTom *routeReply = nullptr;
+    if (waypoints.size() > m_maxWaypoints) {
+        // Consecutive chunks sharing their boundary waypoint, all computed at once and stitched
+        QList<QGeoRouteReplyTomTom *> parts;
+        for (int first = 0; first < waypoints.size() - 1; first += m_maxWaypoints - 1) {
+            const int count = qMin(m_maxWaypoints, waypoints.size() - first);
+            QGeoRouteRequest chunk(request);
+            chunk.setWaypoints(waypoints.mid(first, count));
+            if (!request.waypointsMetadata().isEmpty())
+                chunk.setWaypointsMetadata(request.waypointsMetadata().mid(first, count));
+            chunk.setNumberAlternativeRoutes(0);
+            // Supporting points describe the whole route
+            QVariantMap extra = chunk.extraParameters();
+            QVariantMap tomtom = extra.value(QStringLiteral("tomtom")).toMap();
+            if (tomtom.remove(QStringLiteral("supportingPoints"))) {
+                extra.insert(QStringLiteral("tomtom"), tomtom);
+                chunk.setExtraParameters(extra);
+            }
+            parts.append(createReply(chunk));
+        }
+        routeReply = new QGeoRouteReplyTomTom(parts, request, this);
+    } else {
+        routeReply = createReply(request);
+    }
+
+    connect(routeReply, SIGNAL(finished()), this, SLOT(replyFinished()));
+    connect(routeReply, SIGNAL(error(QGeoRouteReply::Error,QString)),
+            this, SLOT(replyError(QGeoRouteReply::Error,QString)));
+    return routeReply;
+}
+
+/*
+    Recalculates \a route from \a position, after a deviation. The route from the closest point
+    of the path onwards is sent as supporting points, together with the waypoints not yet reached,
+    so that the new route rejoins it. The returned route keeps the segments of \a route from where
+    the two routes coincide, so only the new beginning of the route is new.
+*/
+QGeoRouteReply *QGeoRoutingManagerEngineTomTom::reroute(const QGeoRoute &route, const QGeoCoordinate &position)
+{
+    const QGeoRouteRequest &request = route.request();
+    const QGeoRouteProjectionTomTom projection = QGeoRouteTomTom::project(route, position);
+    if (Q_UNLIKELY(request.waypoints().size() < 2 || !projection.isValid)) {
+        qWarning() << "Cannot reroute a route without path or waypoints";
+        return nullptr;
+    }
+
+    // The waypoints still ahead are those ending the legs after the closest point
+    const int nearest = projection.pathIndex;
+    const int leg = qBound(0, QGeoRouteTomTom::legIndex(route, nearest), request.waypoints().size() - 2);
+
+    QGeoRouteRequest rerouteRequest(request);
+    rerouteRequest.setWaypoints(QList<QGeoCoordinate>() << position << request.waypoints().mid(leg + 1));
+    if (!request.waypointsMetadata().isEmpty()) {
+        rerouteRequest.setWaypointsMetadata(QList<QVariantMap>() << QVariantMap()
+                                            << request.waypointsMetadata().mid(leg + 1));
+    }
+    rerouteRequest.setNumberAlternativeRoutes(0);
+
+    QVariantList points;
+    for (const QGeoCoordinate &c: QGeoRouteTomTom::simplifiedPath(route, 10.0, nearest))
+        points.append(QVariant::fromValue(c));
+    QVariantMap extra = rerouteRequest.extraParameters();
+    QVariantMap tomtom = extra.value(QStringLiteral("tomtom")).toMap();
+    tomtom.insert(QStringLiteral("supportingPoints"), points);
+    extra.insert(QStringLiteral("tomtom"), tomtom);
+    rerouteRequest.setExtraParameters(extra);
+
+    QGeoRouteReplyTomTom *routeReply = new QGeoRouteReplyTomTom(createReply(rerouteRequest), route, rerouteRequest, this);
     connect(routeReply, SIGNAL(finished()), this, SLOT(replyFinished()));
     connect(routeReply, SIGNAL(error(QGeoRouteReply::Error,QString)),
             this, SLOT(replyError(QGeoRouteReply::Error,QString)));
     return routeReply;
 }
 
+/*
+    Creates the reply for a request that fits a single calculateRoute, served from
+    the route cache when possible. Its signals are not connected to the engine.
+*/
+QGeoRouteReplyTomTom *QGeoRoutingManagerEngineTomTom::createReply(const QGeoRouteRequest &request)
+{
+    const QByteArray cacheKey = QGeoRouteCacheTomTom::key(request, locale().name().toLatin1());
+    const bool traffic = QGeoRouteCacheTomTom::isTrafficSensitive(request);
+    QList<QGeoRoute> cachedRoutes;
+    QGeoRouteReplyTomTom *cachedReply = nullptr;
+    if (m_routeCache->routes(cacheKey, traffic, &cachedRoutes)) {
+        cachedReply = new QGeoRouteReplyTomTom(cachedRoutes, request, this);
+    } else {
+        const QString cacheFile = m_routeCache->file(cacheKey, traffic);
+        if (!cacheFile.isEmpty())
+            cachedReply = new QGeoRouteReplyTomTom(cacheFile, request, this);
+    }
+    if (cachedReply)
+        return cachedReply;
+
+    const QGeoRouteParserTomTom *parser = static_cast<const QGeoRouteParserTomTom *>(m_routeParser);
+    QNetworkRequest req;
+    req.setHeader(QNetworkRequest::UserAgentHeader, m_userAgent);
+    req.setUrl(parser->requestUrl(request, QString()));
+    // Supporting points go through the POST variant, in the body. The waypoints stay in
+    // the URL either way, with fewer decimals for long lists or alongside a body.
+    const QByteArray body = parser->requestBody(request);
+    const bool post = !body.isEmpty();
+    if (post || req.url().toEncoded().size() > m_postThreshold)
+        req.setUrl(parser->compactRequestUrl(request));
+    if (post)
+        req.setHeader(QNetworkRequest::ContentTypeHeader, QByteArrayLiteral("application/json"));
+    qDebug() << "QGeoRoutingManagerEngineTomTom::calculateRoute "<< req.url();
+    QNetworkReply *reply = (post) ? m_networkManager->post(req, body)
+                                  : m_networkManager->get(req);
+    return new QGeoRouteReplyTomTom(reply, request, this);
+}
+
+/*
+    Computes many independent routes through the asynchronous batch routing service.
+    The requests are submitted in batches of tomtom.routing.batch.size, all at once,
+    and each request's routes are reported by the returned object as they are parsed.
+*/
+QGeoRouteBatchReplyTomTom *QGeoRoutingManagerEngineTomTom::calculateRoutes(const QList<QGeoRouteRequest> &requests)
+{
+    const QGeoRouteParserTomTom *parser = static_cast<const QGeoRouteParserTomTom *>(m_routeParser);
+    QGeoRouteBatchReplyTomTom *batchReply = new QGeoRouteBatchReplyTomTom(requests, parser, this);
+
+    QUrl url = m_batchUrl;
+    QUrlQuery query(url);
+    query.addQueryItem(QLatin1String("key"), QString::fromLatin1(m_accessToken));
+    url.setQuery(query);
+
+    for (int first = 0; first < requests.size(); first += m_batchSize) {
+        const int count = qMin(m_batchSize, requests.size() - first);
+        QByteArray body = QByteArrayLiteral("{\"batchItems\":[");
+        for (int i = first; i < first + count; ++i) {
+            if (i > first)
+                body += ',';
+            body += parser->batchItem(requests.at(i));
+        }
+        body += QByteArrayLiteral("]}");
+
+        QNetworkRequest req(url);
+        req.setHeader(QNetworkRequest::UserAgentHeader, m_userAgent);
+        req.setHeader(QNetworkRequest::ContentTypeHeader, QByteArrayLiteral("application/json"));
+        batchReply->addBatch(m_networkManager->post(req, body), first, count);
+    }
+    if (requests.isEmpty())
+        QMetaObject::invokeMethod(batchReply, "finished", Qt::QueuedConnection);
+    return batchReply;
+}
+
+static QByteArray matrixPoints(const QList<QGeoCoordinate> &points, int first, int count)
+{
+    QByteArray res = "[";
+    for (int i = first; i < first + count; ++i) {
+        if (i > first)
+            res += ',';
+        res += QByteArrayLiteral("{\"point\":{\"latitude\":") + QByteArray::number(points.at(i).latitude(), 'f', 7)
+             + QByteArrayLiteral(",\"longitude\":") + QByteArray::number(points.at(i).longitude(), 'f', 7)
+             + QByteArrayLiteral("}}");
+    }
+    res += ']';
+    return res;
+}
+
+/*
+    Travel times and distances between all origins and destinations, through the matrix
+    routing service. Only the travel mode of \a options is used. The matrix is split into
+    tiles spanning as many destinations as possible, all submitted at once.
+*/
+QGeoRouteMatrixReplyTomTom *QGeoRoutingManagerEngineTomTom::calculateMatrix(const QList<QGeoCoordinate> &origins,
+                                                                            const QList<QGeoCoordinate> &destinations,
+                                                                            const QGeoRouteRequest &options)
+{
+    QGeoRouteMatrixReplyTomTom *matrixReply = new QGeoRouteMatrixReplyTomTom(origins.size(), destinations.size(), this);
+    if (origins.isEmpty() || destinations.isEmpty())
+        return matrixReply; // finished already
+
+    QUrl url = m_matrixUrl;
+    QUrlQuery query(url);
+    query.addQueryItem(QLatin1String("key"), QString::fromLatin1(m_accessToken));
+    const QVector<QGeoRouteRequest::TravelMode> modes = QGeoRouteParserTomTomPrivate::travelModesToList(options.travelModes());
+    if (!modes.isEmpty())
+        query.addQueryItem(QLatin1String("travelMode"), QString::fromLatin1(QGeoRouteParserTomTomPrivate::travelModes.value(modes.first())));
+    url.setQuery(query);
+
+    const int tileDestinations = qMin(destinations.size(), m_matrixCells);
+    const int tileOrigins = qMax(1, m_matrixCells / tileDestinations);
+    for (int o = 0; o < origins.size(); o += tileOrigins) {
+        const int originCount = qMin(tileOrigins, origins.size() - o);
+        for (int d = 0; d < destinations.size(); d += tileDestinations) {
+            const int destinationCount = qMin(tileDestinations, destinations.size() - d);
+            const QByteArray body = QByteArrayLiteral("{\"origins\":") + matrixPoints(origins, o, originCount)
+                    + QByteArrayLiteral(",\"destinations\":") + matrixPoints(destinations, d, destinationCount) + '}';
+
+            QNetworkRequest req(url);
+            req.setHeader(QNetworkRequest::UserAgentHeader, m_userAgent);
+            req.setHeader(QNetworkRequest::ContentTypeHeader, QByteArrayLiteral("application/json"));
+            matrixReply->addTile(m_networkManager->post(req, body), o, originCount, d, destinationCount);
+        }
+    }
+    return matrixReply;
+}
+
+static QByteArray rangeBudget(qreal budget, QGeoReachableRangeReplyTomTom::BudgetType type)
+{
+    switch (type) {
+    case QGeoReachableRangeReplyTomTom::TimeBudget:
+        return QByteArrayLiteral("timeBudgetInSec=") + QByteArray::number(qRound(budget));
+    case QGeoReachableRangeReplyTomTom::DistanceBudget:
+        return QByteArrayLiteral("distanceBudgetInMeters=") + QByteArray::number(qRound(budget));
+    case QGeoReachableRangeReplyTomTom::EnergyBudget:
+        return QByteArrayLiteral("energyBudgetInkWh=") + QByteArray::number(budget, 'g', 10);
+    case QGeoReachableRangeReplyTomTom::FuelBudget:
+        return QByteArrayLiteral("fuelBudgetInLiters=") + QByteArray::number(budget, 'g', 10);
+    }
+    return QByteArray();
+}
+
+/*
+    The area reachable from each origin within each budget, through the reachable range
+    service, one request per origin and budget, all submitted at once.
+    Travel mode, optimization and traffic avoidance are taken from \a options. Further query
+    items, such as the consumption model that energy and fuel budgets require, can be passed
+    as a map in the "reachableRange" entry of the "tomtom" extra parameter.
+    Ranges are cached by origin cell and budget, and cache hits are reported without a request.
+*/
+QGeoReachableRangeReplyTomTom *QGeoRoutingManagerEngineTomTom::calculateReachableRange(const QList<QGeoCoordinate> &origins,
+                                                                                      const QList<qreal> &budgets,
+                                                                                      QGeoReachableRangeReplyTomTom::BudgetType type,
+                                                                                      const QGeoRouteRequest &options)
+{
+    QGeoReachableRangeReplyTomTom *rangeReply = new QGeoReachableRangeReplyTomTom(origins.size(), budgets.size(), this);
+
+    QUrlQuery query;
+    query.addQueryItem(QLatin1String("key"), QString::fromLatin1(m_accessToken));
+    const QVector<QGeoRouteRequest::TravelMode> modes = QGeoRouteParserTomTomPrivate::travelModesToList(options.travelModes());
+    if (!modes.isEmpty())
+        query.addQueryItem(QLatin1String("travelMode"), QString::fromLatin1(QGeoRouteParserTomTomPrivate::travelModes.value(modes.first())));
+    if (options.routeOptimization() & QGeoRouteRequest::ShortestRoute)
+        query.addQueryItem(QLatin1String("routeType"), QLatin1String("shortest"));
+    else if (options.routeOptimization() & QGeoRouteRequest::MostEconomicRoute)
+        query.addQueryItem(QLatin1String("routeType"), QLatin1String("eco"));
+    else if (options.routeOptimization() & QGeoRouteRequest::MostScenicRoute)
+        query.addQueryItem(QLatin1String("routeType"), QLatin1String("thrilling"));
+    if (options.featureWeight(QGeoRouteRequest::TrafficFeature) == QGeoRouteRequest::AvoidFeatureWeight)
+        query.addQueryItem(QLatin1String("traffic"), QLatin1String("false"));
+    const QVariantMap extra = options.extraParameters().value(QStringLiteral("tomtom")).toMap()
+            .value(QStringLiteral("reachableRange")).toMap();
+    for (auto it = extra.cbegin(); it != extra.cend(); ++it)
+        query.addQueryItem(it.key(), it.value().toString());
+
+    // Only distance budgets give the same range regardless of live traffic
+    const bool traffic = type != QGeoReachableRangeReplyTomTom::DistanceBudget
+            && QGeoRouteCacheTomTom::isTrafficSensitive(options);
+    QVector<QByteArray> cacheKeys(origins.size() * budgets.size());
+    for (int o = 0; o < origins.size(); ++o) {
+        for (int b = 0; b < budgets.size(); ++b) {
+            const QByteArray budget = rangeBudget(budgets.at(b), type);
+            const QByteArray cacheKey = QGeoRouteCacheTomTom::rangeKey(origins.at(o), budget, options);
+            QGeoPolygon cached;
+            if (m_routeCache->range(cacheKey, traffic, &cached)) {
+                rangeReply->addRange(o, b, cached);
+                continue;
+            }
+            cacheKeys[o * budgets.size() + b] = cacheKey;
+
+            QUrl url = m_rangeUrl;
+            url.setPath(url.path() + QString::fromLatin1(toString(origins.at(o), 7)) + QLatin1String("/json"));
+            QUrlQuery rangeQuery(query);
+            const int separator = budget.indexOf('=');
+            rangeQuery.addQueryItem(QString::fromLatin1(budget.left(separator)), QString::fromLatin1(budget.mid(separator + 1)));
+            url.setQuery(rangeQuery);
+
+            QNetworkRequest req(url);
+            req.setHeader(QNetworkRequest::UserAgentHeader, m_userAgent);
+            rangeReply->addRequest(m_networkManager->get(req), o, b);
+        }
+    }
+
+    const int budgetCount = budgets.size();
+    connect(rangeReply, &QGeoReachableRangeReplyTomTom::rangeCalculated, this,
+            [this, cacheKeys, budgetCount, traffic](int origin, int budget, const QGeoPolygon &range) {
+        const QByteArray &cacheKey = cacheKeys.at(origin * budgetCount + budget);
+        if (!cacheKey.isEmpty())
+            m_routeCache->insertRange(cacheKey, traffic, range);
+    });
+    return rangeReply;
+}
+
 const QGeoRouteParser *QGeoRoutingManagerEngineTomTom::routeParser() const
 {
     return m_routeParser;
 }
 
+/*
+    Called by the replies with the routes they parsed. payload is the reply as received,
+    empty when it was already read from the disk cache.
+*/
+void QGeoRoutingManagerEngineTomTom::cacheRoutes(const QGeoRouteRequest &request,
+                                                 const QList<QGeoRoute> &routes,
+                                                 const QByteArray &payload)
+{
+    m_routeCache->insert(QGeoRouteCacheTomTom::key(request, locale().name().toLatin1()),
+                         QGeoRouteCacheTomTom::isTrafficSensitive(request),
+                         routes, payload);
+}
+
 void QGeoRoutingManagerEngineTomTom::replyFinished()
 {
     QGeoRouteReply *reply = qobject_cast<QGeoRouteReply *>(sender());
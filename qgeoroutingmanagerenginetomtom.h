@@ -23,11 +23,18 @@
 
 #include <QtLocation/QGeoServiceProvider>
 #include <QtLocation/QGeoRoutingManagerEngine>
+#include "qgeoreachablerangereplytomtom.h"
+#include <QtCore/QScopedPointer>
+#include <QtCore/QUrl>
 
 QT_BEGIN_NAMESPACE
 
 class QNetworkAccessManager;
 class QGeoRouteParser;
+class QGeoRouteCacheTomTom;
+class QGeoRouteReplyTomTom;
+class QGeoRouteBatchReplyTomTom;
+class QGeoRouteMatrixReplyTomTom;
 
 class QGeoRoutingManagerEngineTomTom : public QGeoRoutingManagerEngine
 {
@@ -40,7 +47,17 @@ public:
     ~QGeoRoutingManagerEngineTomTom();
 
     QGeoRouteReply *calculateRoute(const QGeoRouteRequest &request);
+    QGeoRouteReply *reroute(const QGeoRoute &route, const QGeoCoordinate &position);
+    QGeoRouteBatchReplyTomTom *calculateRoutes(const QList<QGeoRouteRequest> &requests);
+    QGeoRouteMatrixReplyTomTom *calculateMatrix(const QList<QGeoCoordinate> &origins,
+                                                const QList<QGeoCoordinate> &destinations,
+                                                const QGeoRouteRequest &options = QGeoRouteRequest());
+    QGeoReachableRangeReplyTomTom *calculateReachableRange(const QList<QGeoCoordinate> &origins,
+                                                           const QList<qreal> &budgets,
+                                                           QGeoReachableRangeReplyTomTom::BudgetType type,
+                                                           const QGeoRouteRequest &options = QGeoRouteRequest());
     const QGeoRouteParser *routeParser() const;
+    void cacheRoutes(const QGeoRouteRequest &request, const QList<QGeoRoute> &routes, const QByteArray &payload);
 
     bool m_includeJson = false;
     bool m_debugQuery = false;
@@ -50,9 +67,20 @@ private Q_SLOTS:
     void replyError(QGeoRouteReply::Error errorCode, const QString &errorString);
 
 private:
+    QGeoRouteReplyTomTom *createReply(const QGeoRouteRequest &request);
+
     QNetworkAccessManager *m_networkManager;
     QByteArray m_userAgent;
     QGeoRouteParser *m_routeParser = nullptr;
+    QScopedPointer<QGeoRouteCacheTomTom> m_routeCache;
+    int m_postThreshold = 2048;
+    int m_maxWaypoints = 150;
+    QByteArray m_accessToken;
+    QUrl m_batchUrl;
+    int m_batchSize = 100;
+    QUrl m_matrixUrl;
+    int m_matrixCells = 700;
+    QUrl m_rangeUrl;
 };
 
 QT_END_NAMESPACE
@@ -0,0 +1,249 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#include "qgeotilearchivetomtom.h"
+#include <QDataStream>
+#include <QDebug>
+
+QT_BEGIN_NAMESPACE
+
+static const quint32 archiveMagic = 0x54544341; // "TTCA"
+static const quint32 archiveFormat = 1;
+static const int headerSize = 28;
+
+static quint32 crc32(const uchar *data, qint64 size)
+{
+    static const QVector<quint32> table = [] {
+        QVector<quint32> t(256);
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    quint32 crc = 0xffffffffu;
+    for (qint64 i = 0; i < size; ++i)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffu;
+}
+
+static quint32 crc32(const QByteArray &data)
+{
+    return crc32(reinterpret_cast<const uchar *>(data.constData()), data.size());
+}
+
+QGeoTileArchiveTomTom::QGeoTileArchiveTomTom(const QString &path)
+    : m_file(path)
+{
+}
+
+QGeoTileArchiveTomTom::~QGeoTileArchiveTomTom()
+{
+}
+
+QString QGeoTileArchiveTomTom::path() const
+{
+    return m_file.fileName();
+}
+
+QString QGeoTileArchiveTomTom::errorString() const
+{
+    return m_errorString;
+}
+
+int QGeoTileArchiveTomTom::scaleFactor() const
+{
+    return m_scaleFactor;
+}
+
+bool QGeoTileArchiveTomTom::open()
+{
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_errorString = m_file.errorString();
+        return false;
+    }
+    const qint64 size = m_file.size();
+    if (size < headerSize || !(m_data = m_file.map(0, size))) {
+        m_errorString = QStringLiteral("Not a tile archive");
+        return false;
+    }
+
+    QDataStream header(QByteArray::fromRawData(reinterpret_cast<const char *>(m_data), headerSize));
+    quint32 magic, format, indexSize, indexCrc;
+    qint32 scaleFactor;
+    quint64 indexOffset;
+    header >> magic >> format >> scaleFactor >> indexOffset >> indexSize >> indexCrc;
+    if (magic != archiveMagic || format != archiveFormat) {
+        m_errorString = QStringLiteral("Not a tile archive, or unsupported format");
+        return false;
+    }
+    if (indexOffset < quint64(headerSize) || indexOffset + indexSize > quint64(size)) {
+        m_errorString = QStringLiteral("Truncated tile archive");
+        return false;
+    }
+    if (crc32(m_data + indexOffset, indexSize) != indexCrc) {
+        m_errorString = QStringLiteral("Corrupted tile archive index");
+        return false;
+    }
+    m_scaleFactor = scaleFactor;
+
+    const QByteArray index = qUncompress(m_data + indexOffset, int(indexSize));
+    QDataStream in(index);
+    QString plugin;
+    quint32 count;
+    in >> plugin >> count;
+    if (in.status() != QDataStream::Ok) {
+        m_errorString = QStringLiteral("Corrupted tile archive index");
+        return false;
+    }
+
+    m_entries.reserve(int(count));
+    for (quint32 i = 0; i < count; ++i) {
+        qint32 mapId, zoom, x, y, version;
+        Entry entry;
+        in >> mapId >> zoom >> x >> y >> version >> entry.offset >> entry.size >> entry.crc;
+        if (in.status() != QDataStream::Ok
+                || entry.offset < quint64(headerSize) || entry.offset + entry.size > indexOffset) {
+            m_errorString = QStringLiteral("Corrupted tile archive index");
+            m_entries.clear();
+            return false;
+        }
+        entry.index = int(i);
+        m_entries.insert(QGeoTileSpec(plugin, mapId, zoom, x, y, version), entry);
+    }
+    m_verified.reset(new QAtomicInt[count]);
+    return true;
+}
+
+int QGeoTileArchiveTomTom::count() const
+{
+    return m_entries.size();
+}
+
+bool QGeoTileArchiveTomTom::contains(const QGeoTileSpec &spec) const
+{
+    return m_entries.contains(spec);
+}
+
+QList<QGeoTileSpec> QGeoTileArchiveTomTom::tiles() const
+{
+    return m_entries.keys();
+}
+
+/*
+    Returns the data of the tile, or an empty array if the tile is missing or corrupted.
+    Safe to call from multiple threads.
+*/
+QByteArray QGeoTileArchiveTomTom::tile(const QGeoTileSpec &spec) const
+{
+    const auto it = m_entries.constFind(spec);
+    if (it == m_entries.constEnd())
+        return QByteArray();
+
+    const Entry &entry = it.value();
+    QAtomicInt &verified = m_verified[entry.index];
+    const uchar *data = m_data + entry.offset;
+    int state = verified.loadAcquire();
+    if (state == 0) {
+        state = crc32(data, entry.size) == entry.crc ? 1 : -1;
+        if (state < 0)
+            qWarning() << "QGeoTileArchiveTomTom: corrupted tile" << spec << "in" << path();
+        verified.storeRelease(state);
+    }
+    if (state < 0)
+        return QByteArray();
+    return QByteArray(reinterpret_cast<const char *>(data), int(entry.size));
+}
+
+/*
+    Packs the given tile files into a new archive at path. The archive is written
+    to a temporary file first, and moved in place once complete.
+*/
+bool QGeoTileArchiveTomTom::write(const QString &path, int scaleFactor, const QVector<Tile> &tiles, QString *errorString)
+{
+    const QString partial = path + QLatin1String(".part");
+    QFile out(partial);
+    if (!out.open(QIODevice::WriteOnly)) {
+        if (errorString)
+            *errorString = out.errorString();
+        return false;
+    }
+    out.write(QByteArray(headerSize, '\0'));
+
+    QByteArray entries;
+    QDataStream entryStream(&entries, QIODevice::WriteOnly);
+    quint32 count = 0;
+    for (const Tile &t : tiles) {
+        QFile file(t.filename);
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+        const QByteArray bytes = file.readAll();
+        if (bytes.isEmpty())
+            continue;
+        const quint64 offset = quint64(out.pos());
+        if (out.write(bytes) != bytes.size()) {
+            if (errorString)
+                *errorString = out.errorString();
+            out.remove();
+            return false;
+        }
+        entryStream << qint32(t.spec.mapId()) << qint32(t.spec.zoom()) << qint32(t.spec.x())
+                    << qint32(t.spec.y()) << qint32(t.spec.version())
+                    << offset << quint32(bytes.size()) << crc32(bytes);
+        ++count;
+    }
+
+    QByteArray index;
+    QDataStream indexStream(&index, QIODevice::WriteOnly);
+    indexStream << (tiles.isEmpty() ? QString() : tiles.first().spec.plugin()) << count;
+    index += entries;
+
+    const QByteArray compressed = qCompress(index, 9);
+    const quint64 indexOffset = quint64(out.pos());
+    out.write(compressed);
+
+    QByteArray header;
+    QDataStream headerStream(&header, QIODevice::WriteOnly);
+    headerStream << archiveMagic << archiveFormat << qint32(scaleFactor) << indexOffset
+                 << quint32(compressed.size()) << crc32(compressed);
+    out.seek(0);
+    out.write(header);
+    if (!out.flush()) {
+        if (errorString)
+            *errorString = out.errorString();
+        out.remove();
+        return false;
+    }
+    out.close();
+
+    QFile::remove(path);
+    if (!QFile::rename(partial, path)) {
+        if (errorString)
+            *errorString = QStringLiteral("Unable to move the archive in place");
+        QFile::remove(partial);
+        return false;
+    }
+    return true;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,87 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#ifndef QGEOTILEARCHIVETOMTOM_H
+#define QGEOTILEARCHIVETOMTOM_H
+
+#include <QtLocation/private/qgeotilespec_p.h>
+#include <QAtomicInt>
+#include <QFile>
+#include <QHash>
+#include <QScopedArrayPointer>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+
+/*
+    A read only set of tiles packed in a single file, used to provision the tile cache.
+
+    The file starts with a fixed size header, followed by the tile data and by a compressed
+    index. The index is checksummed and verified on open, while each tile has its own
+    checksum, verified the first time the tile is read. Archives are mapped in memory, so
+    opening one only costs reading its index.
+*/
+class QGeoTileArchiveTomTom
+{
+public:
+    struct Tile
+    {
+        QGeoTileSpec spec;
+        QString filename;
+    };
+
+    explicit QGeoTileArchiveTomTom(const QString &path);
+    ~QGeoTileArchiveTomTom();
+
+    bool open();
+    QString path() const;
+    QString errorString() const;
+    int scaleFactor() const;
+
+    int count() const;
+    bool contains(const QGeoTileSpec &spec) const;
+    QList<QGeoTileSpec> tiles() const;
+    QByteArray tile(const QGeoTileSpec &spec) const;
+
+    static bool write(const QString &path, int scaleFactor, const QVector<Tile> &tiles, QString *errorString = nullptr);
+
+private:
+    struct Entry
+    {
+        quint64 offset = 0;
+        quint32 size = 0;
+        quint32 crc = 0;
+        int index = 0;
+    };
+
+    QFile m_file;
+    const uchar *m_data = nullptr;
+    int m_scaleFactor = 1;
+    QString m_errorString;
+    QHash<QGeoTileSpec, Entry> m_entries;
+    // Per tile verification state: 0 not verified yet, 1 valid, -1 corrupted
+    QScopedArrayPointer<QAtomicInt> m_verified;
+
+    Q_DISABLE_COPY(QGeoTileArchiveTomTom)
+};
+
+QT_END_NAMESPACE
+
+#endif // QGEOTILEARCHIVETOMTOM_H
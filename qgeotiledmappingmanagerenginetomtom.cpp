@@ -26,14 +26,24 @@
 #include "qtomtomcommon.h"
 #include "qgeotilefetchertomtom.h"
 #include "qgeofiletilecachetomtom.h"
+#include "qgeotileevictionpolicytomtom.h"
 #include "qgeotiledmaptomtom.h"
 #include <QtCore/QJsonDocument>
 #include <QtCore/QJsonObject>
 #include <QtCore/QJsonArray>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QRandomGenerator>
 
 
 QT_BEGIN_NAMESPACE
 
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+static const Qt::SplitBehavior skipEmptyParts = Qt::SkipEmptyParts;
+#else
+static const QString::SplitBehavior skipEmptyParts = QString::SkipEmptyParts;
+#endif
+
 
 QGeoTiledMappingManagerEngineTomTom::QGeoTiledMappingManagerEngineTomTom(const QVariantMap &parameters,
                                                                          QGeoServiceProvider::Error *error,
@@ -99,6 +109,20 @@ QGeoTiledMappingManagerEngineTomTom::QGeoTiledMappingManagerEngineTomTom(const Q
         const QString token = parameters.value(QStringLiteral("tomtom.access_token")).toString();
         tileFetcher->setAccessToken(token);
     }
+    // Upper bound of the adaptive number of concurrent tile downloads
+    if (parameters.contains(QStringLiteral("tomtom.mapping.fetch.max_concurrency"))) {
+        bool ok = false;
+        const int replies = parameters.value(QStringLiteral("tomtom.mapping.fetch.max_concurrency")).toString().toInt(&ok);
+        if (ok)
+            tileFetcher->setMaxConcurrency(replies);
+    }
+    // Bandwidth, in bytes/s, below which high-dpi tiles are fetched at low resolution. 0 disables it.
+    if (parameters.contains(QStringLiteral("tomtom.mapping.fetch.low_bandwidth"))) {
+        bool ok = false;
+        const int bandwidth = parameters.value(QStringLiteral("tomtom.mapping.fetch.low_bandwidth")).toString().toInt(&ok);
+        if (ok)
+            tileFetcher->setLowBandwidthThreshold(bandwidth);
+    }
 
     setTileFetcher(tileFetcher);
 
@@ -112,7 +136,7 @@ QGeoTiledMappingManagerEngineTomTom::QGeoTiledMappingManagerEngineTomTom(const Q
         m_cacheDirectory = QAbstractGeoTileCache::baseLocationCacheDirectory() + QLatin1String(pluginName);
     }
 
-    QGeoFileTileCache *tileCache = new QGeoFileTileCacheTomTom(mapTypes, scaleFactor, m_cacheDirectory);
+    QGeoFileTileCacheTomTom *tileCache = new QGeoFileTileCacheTomTom(mapTypes, scaleFactor, m_cacheDirectory);
 
     /*
      * Disk cache setup -- defaults to Unitary since:
@@ -135,10 +159,94 @@ QGeoTiledMappingManagerEngineTomTom::QGeoTiledMappingManagerEngineTomTom(const Q
         if (tileCache->costStrategyDisk() == QGeoFileTileCache::Unitary)
             tileCache->setMaxDiskUsage(20000); // The maximum allowed with the free tier
     }
+    // Disk hits are read on a worker pool and delivered like network replies
+    if (parameters.contains(QStringLiteral("tomtom.mapping.cache.disk.async_reads"))) {
+        const QString param = parameters.value(QStringLiteral("tomtom.mapping.cache.disk.async_reads")).toString().toLower();
+        tileCache->setAsyncDiskReads(param != QLatin1String("false"));
+    }
+    if (parameters.contains(QStringLiteral("tomtom.mapping.cache.disk.io_threads"))) {
+        bool ok = false;
+        int threads = parameters.value(QStringLiteral("tomtom.mapping.cache.disk.io_threads")).toString().toInt(&ok);
+        if (ok)
+            tileCache->setMaxIoThreads(threads);
+    }
+    // Disk inserts are written behind, in batches
+    if (parameters.contains(QStringLiteral("tomtom.mapping.cache.disk.write_batch"))) {
+        bool ok = false;
+        int batch = parameters.value(QStringLiteral("tomtom.mapping.cache.disk.write_batch")).toString().toInt(&ok);
+        if (ok)
+            tileCache->setWriteBatchSize(batch);
+    }
+    if (parameters.contains(QStringLiteral("tomtom.mapping.cache.disk.write_delay"))) {
+        bool ok = false;
+        int delay = parameters.value(QStringLiteral("tomtom.mapping.cache.disk.write_delay")).toString().toInt(&ok);
+        if (ok)
+            tileCache->setWriteDelay(delay);
+    }
+    if (parameters.contains(QStringLiteral("tomtom.mapping.cache.disk.crash_safe"))) {
+        const QString param = parameters.value(QStringLiteral("tomtom.mapping.cache.disk.crash_safe")).toString().toLower();
+        tileCache->setCrashSafeWrites(param == QLatin1String("true"));
+    }
+    // Several processes sharing the same cache directory
+    if (parameters.contains(QStringLiteral("tomtom.mapping.cache.disk.shared"))) {
+        const QString param = parameters.value(QStringLiteral("tomtom.mapping.cache.disk.shared")).toString().toLower();
+        tileCache->setSharedCache(param == QLatin1String("true"));
+    }
+    // Idle time recompression of cached tiles: "lossless" or "lossy", off by default.
+    // Lossy only applies to the hybrid maps, or to those listed in
+    // tomtom.mapping.cache.disk.recompress.lossy_maps, e.g. "tomtom.hybrid,tomtom.hybrid-dark".
+    if (parameters.contains(QStringLiteral("tomtom.mapping.cache.disk.recompress"))) {
+        const QString param = parameters.value(QStringLiteral("tomtom.mapping.cache.disk.recompress")).toString().toLower();
+        if (param == QLatin1String("lossless"))
+            tileCache->setRecompressionMode(QGeoFileTileCacheTomTom::LosslessRecompression);
+        else if (param == QLatin1String("lossy"))
+            tileCache->setRecompressionMode(QGeoFileTileCacheTomTom::LossyRecompression);
+
+        QSet<int> lossyMapIds;
+        if (parameters.contains(QStringLiteral("tomtom.mapping.cache.disk.recompress.lossy_maps"))) {
+            const QStringList names = parameters.value(QStringLiteral("tomtom.mapping.cache.disk.recompress.lossy_maps"))
+                    .toString().split(QLatin1Char(','), skipEmptyParts);
+            for (const QString &name : names) {
+                const int index = mapIds.indexOf(name.trimmed());
+                if (index < 0)
+                    qWarning() << "Unknown map in tomtom.mapping.cache.disk.recompress.lossy_maps" << name;
+                else
+                    lossyMapIds.insert(index + 1);
+            }
+        } else {
+            for (int i = 0; i < mapTypes.size(); ++i) {
+                if (mapTypes.at(i).style() == QGeoMapType::HybridMap)
+                    lossyMapIds.insert(i + 1);
+            }
+        }
+        tileCache->setLossyMapIds(lossyMapIds);
+    }
+    // Disk eviction: "lru", or "lfu" protecting frequently revisited and low zoom tiles.
+    // Defaults to the eviction of QGeoFileTileCache.
+    if (parameters.contains(QStringLiteral("tomtom.mapping.cache.disk.eviction_policy"))) {
+        const QString param = parameters.value(QStringLiteral("tomtom.mapping.cache.disk.eviction_policy")).toString().toLower();
+        QGeoTileEvictionPolicyTomTom *policy = QGeoTileEvictionPolicyTomTom::create(param);
+        if (!policy && param != QLatin1String("default"))
+            qWarning() << "Unknown tomtom.mapping.cache.disk.eviction_policy" << param;
+        auto frequency = dynamic_cast<QGeoTileEvictionPolicyFrequencyTomTom *>(policy);
+        if (frequency && parameters.contains(QStringLiteral("tomtom.mapping.cache.disk.eviction_protected_zoom"))) {
+            bool ok = false;
+            int zoom = parameters.value(QStringLiteral("tomtom.mapping.cache.disk.eviction_protected_zoom")).toString().toInt(&ok);
+            if (ok)
+                frequency->setProtectedZoom(zoom);
+        }
+        tileCache->setEvictionPolicy(policy);
+    }
 
     /*
-     * Memory cache setup -- defaults to ByteSize (old behavior)
+     * Memory cache setup -- two tiers, each with its own budget:
+     * - compressed: tile bytes as fetched, a few tens of KB each (memory cache)
+     * - decoded: the most recently used tiles as images, 256KB or 1MB each (texture cache)
+     * Decoding a compressed tile promotes it to the decoded tier. Tiles evicted from the
+     * decoded tier remain in the compressed one, so revisits still avoid disk I/O.
      */
+    const bool oldStyleMemory = !parameters.contains(QStringLiteral("tomtom.mapping.cache.memory.compressed_size"))
+            && parameters.contains(QStringLiteral("tomtom.mapping.cache.memory.size"));
     if (parameters.contains(QStringLiteral("tomtom.mapping.cache.memory.cost_strategy"))) {
         QString cacheStrategy = parameters.value(QStringLiteral("tomtom.mapping.cache.memory.cost_strategy")).toString().toLower();
         if (cacheStrategy == QLatin1String("bytesize"))
@@ -146,34 +254,48 @@ QGeoTiledMappingManagerEngineTomTom::QGeoTiledMappingManagerEngineTomTom(const Q
         else
             tileCache->setCostStrategyMemory(QGeoFileTileCache::Unitary);
     } else {
-        tileCache->setCostStrategyMemory(QGeoFileTileCache::Unitary);
+        // The old style setup defaults to Unitary
+        tileCache->setCostStrategyMemory(oldStyleMemory ? QGeoFileTileCache::Unitary : QGeoFileTileCache::ByteSize);
     }
-    tileCache->setMaxMemoryUsage(0);
-    if (parameters.contains(QStringLiteral("tomtom.mapping.cache.memory.size"))) {
+    tileCache->setMaxMemoryUsage(16 * 1024 * 1024);
+    if (parameters.contains(QStringLiteral("tomtom.mapping.cache.memory.compressed_size"))) {
+        bool ok = false;
+        int cacheSize = parameters.value(QStringLiteral("tomtom.mapping.cache.memory.compressed_size")).toString().toInt(&ok);
+        if (ok)
+            tileCache->setMaxMemoryUsage(cacheSize);
+    } else if (oldStyleMemory) {
         bool ok = false;
         int cacheSize = parameters.value(QStringLiteral("tomtom.mapping.cache.memory.size")).toString().toInt(&ok);
         if (ok)
             tileCache->setMaxMemoryUsage(cacheSize);
     }
 
-    /*
-     * Texture cache setup -- defaults to ByteSize (old behavior)
-     */
-    if (parameters.contains(QStringLiteral("tomtom.mapping.cache.texture.cost_strategy"))) {
-        QString cacheStrategy = parameters.value(QStringLiteral("tomtom.mapping.cache.texture.cost_strategy")).toString().toLower();
-        if (cacheStrategy == QLatin1String("bytesize"))
-            tileCache->setCostStrategyTexture(QGeoFileTileCache::ByteSize);
-        else
-            tileCache->setCostStrategyTexture(QGeoFileTileCache::Unitary);
-    } else {
-        tileCache->setCostStrategyTexture(QGeoFileTileCache::Unitary);
-    }
-    tileCache->setExtraTextureUsage(30);
-    if (parameters.contains(QStringLiteral("tomtom.mapping.cache.texture.size"))) {
+    if (parameters.contains(QStringLiteral("tomtom.mapping.cache.memory.decoded_size"))) {
+        tileCache->setCostStrategyTexture(QGeoFileTileCache::ByteSize);
         bool ok = false;
-        int cacheSize = parameters.value(QStringLiteral("tomtom.mapping.cache.texture.size")).toString().toInt(&ok);
+        int cacheSize = parameters.value(QStringLiteral("tomtom.mapping.cache.memory.decoded_size")).toString().toInt(&ok);
         if (ok)
             tileCache->setExtraTextureUsage(cacheSize);
+    } else {
+        /*
+         * Texture cache setup -- defaults to Unitary
+         */
+        if (parameters.contains(QStringLiteral("tomtom.mapping.cache.texture.cost_strategy"))) {
+            QString cacheStrategy = parameters.value(QStringLiteral("tomtom.mapping.cache.texture.cost_strategy")).toString().toLower();
+            if (cacheStrategy == QLatin1String("bytesize"))
+                tileCache->setCostStrategyTexture(QGeoFileTileCache::ByteSize);
+            else
+                tileCache->setCostStrategyTexture(QGeoFileTileCache::Unitary);
+        } else {
+            tileCache->setCostStrategyTexture(QGeoFileTileCache::Unitary);
+        }
+        tileCache->setExtraTextureUsage(30);
+        if (parameters.contains(QStringLiteral("tomtom.mapping.cache.texture.size"))) {
+            bool ok = false;
+            int cacheSize = parameters.value(QStringLiteral("tomtom.mapping.cache.texture.size")).toString().toInt(&ok);
+            if (ok)
+                tileCache->setExtraTextureUsage(cacheSize);
+        }
     }
 
     /* PREFETCHING */
@@ -189,6 +311,78 @@ QGeoTiledMappingManagerEngineTomTom::QGeoTiledMappingManagerEngineTomTom(const Q
 
     setTileCache(tileCache);
 
+    /* ARCHIVES */
+    // Provisioning: archives to mount read only, or to unpack into the disk cache,
+    // separated by ';', and an archive to export the disk cache to on exit.
+    if (parameters.contains(QStringLiteral("tomtom.mapping.cache.archives"))) {
+        const QString archives = parameters.value(QStringLiteral("tomtom.mapping.cache.archives")).toString();
+        for (const QString &archive : archives.split(QLatin1Char(';'), skipEmptyParts))
+            tileCache->mountArchive(archive);
+    }
+    if (parameters.contains(QStringLiteral("tomtom.mapping.cache.import"))) {
+        const QString archives = parameters.value(QStringLiteral("tomtom.mapping.cache.import")).toString();
+        for (const QString &archive : archives.split(QLatin1Char(';'), skipEmptyParts))
+            tileCache->importArchive(archive);
+    }
+    if (parameters.contains(QStringLiteral("tomtom.mapping.cache.export"))) {
+        m_exportArchive = parameters.value(QStringLiteral("tomtom.mapping.cache.export")).toString();
+        // top left and bottom right corners, as "lat,lon,lat,lon"
+        if (parameters.contains(QStringLiteral("tomtom.mapping.cache.export.region"))) {
+            const QStringList corners = parameters.value(QStringLiteral("tomtom.mapping.cache.export.region")).toString().split(QLatin1Char(','));
+            if (corners.size() == 4) {
+                m_exportRegion = QGeoRectangle(QGeoCoordinate(corners.at(0).toDouble(), corners.at(1).toDouble()),
+                                               QGeoCoordinate(corners.at(2).toDouble(), corners.at(3).toDouble()));
+            } else {
+                qWarning() << "Invalid tomtom.mapping.cache.export.region";
+            }
+        }
+        if (parameters.contains(QStringLiteral("tomtom.mapping.cache.export.min_zoom"))) {
+            bool ok = false;
+            const int zoom = parameters.value(QStringLiteral("tomtom.mapping.cache.export.min_zoom")).toString().toInt(&ok);
+            if (ok)
+                m_exportMinZoom = zoom;
+        }
+        if (parameters.contains(QStringLiteral("tomtom.mapping.cache.export.max_zoom"))) {
+            bool ok = false;
+            const int zoom = parameters.value(QStringLiteral("tomtom.mapping.cache.export.max_zoom")).toString().toInt(&ok);
+            if (ok)
+                m_exportMaxZoom = zoom;
+        }
+    }
+
+    /* MAP VERSION */
+    // Tiles are stamped with the map version, so that a data release lands in new cache files
+    // and the tiles of the previous release get lazily evicted.
+    loadMapVersion();
+    if (parameters.contains(QStringLiteral("tomtom.mapping.version"))) {
+        bool ok = false;
+        const int version = parameters.value(QStringLiteral("tomtom.mapping.version")).toString().toInt(&ok);
+        if (ok)
+            updateVersion(version, true);
+    }
+    if (parameters.contains(QStringLiteral("tomtom.mapping.version.rollout_window"))) {
+        bool ok = false;
+        const int window = parameters.value(QStringLiteral("tomtom.mapping.version.rollout_window")).toString().toInt(&ok);
+        if (ok)
+            m_versionRolloutWindow = qMax(0, window);
+    }
+    m_versionRolloutTimer.setSingleShot(true);
+    connect(&m_versionRolloutTimer, &QTimer::timeout, this, &QGeoTiledMappingManagerEngineTomTom::adoptPendingVersion);
+    if (parameters.contains(QStringLiteral("tomtom.mapping.version.url"))) {
+        tileFetcher->setVersionUrl(QUrl(parameters.value(QStringLiteral("tomtom.mapping.version.url")).toString()));
+        int pollInterval = 24 * 60 * 60;
+        if (parameters.contains(QStringLiteral("tomtom.mapping.version.poll_interval"))) {
+            bool ok = false;
+            const int interval = parameters.value(QStringLiteral("tomtom.mapping.version.poll_interval")).toString().toInt(&ok);
+            if (ok && interval > 0)
+                pollInterval = interval;
+        }
+        m_versionPollTimer.setInterval(pollInterval * 1000);
+        connect(&m_versionPollTimer, SIGNAL(timeout()), tileFetcher, SLOT(fetchVersionData()));
+        m_versionPollTimer.start();
+        QMetaObject::invokeMethod(tileFetcher, "fetchVersionData", Qt::QueuedConnection);
+    }
+
     *error = QGeoServiceProvider::NoError;
     errorString->clear();
     QMetaObject::invokeMethod(tileFetcher, "fetchCopyrightsData", Qt::QueuedConnection); // for simplicity, because it has a qnam.
@@ -196,6 +390,12 @@ QGeoTiledMappingManagerEngineTomTom::QGeoTiledMappingManagerEngineTomTom(const Q
 
 QGeoTiledMappingManagerEngineTomTom::~QGeoTiledMappingManagerEngineTomTom()
 {
+    // Only the pending tile writes and the listing of the tiles block here. The archive itself
+    // is written on the global thread pool, which the application waits for when quitting.
+    if (!m_exportArchive.isEmpty() && tileCache()) {
+        static_cast<QGeoFileTileCacheTomTom *>(tileCache())->exportArchiveInBackground(m_exportArchive, m_exportRegion,
+                                                                                         m_exportMinZoom, m_exportMaxZoom);
+    }
 }
 
 QGeoMap *QGeoTiledMappingManagerEngineTomTom::createMap()
@@ -205,12 +405,112 @@ QGeoMap *QGeoTiledMappingManagerEngineTomTom::createMap()
     return map;
 }
 
+QGeoTiledMappingManagerEngineTomTom::TilePriority QGeoTiledMappingManagerEngineTomTom::tilePriority(const QGeoTileSpec &spec) const
+{
+    for (const QSet<QGeoTileSpec> &tiles : m_visibleTiles) {
+        if (tiles.contains(spec))
+            return VisibleTilePriority;
+    }
+    return PrefetchTilePriority;
+}
+
+void QGeoTiledMappingManagerEngineTomTom::setVisibleTiles(QGeoTiledMapTomTom *map, const QSet<QGeoTileSpec> &tiles)
+{
+    if (tiles.isEmpty())
+        m_visibleTiles.remove(map);
+    else
+        m_visibleTiles.insert(map, tiles);
+}
+
 void QGeoTiledMappingManagerEngineTomTom::onCopyrightsFetched(const QByteArray &data)
 {
     QJsonDocument document = QJsonDocument::fromJson(data);
     qDebug() << document;
 }
 
+void QGeoTiledMappingManagerEngineTomTom::onVersionFetched(const QByteArray &data)
+{
+    // Accept either {"version": N} or a bare number.
+    bool ok = false;
+    int version = -1;
+    const QJsonDocument document = QJsonDocument::fromJson(data);
+    if (document.isObject()) {
+        const QJsonValue value = document.object().value(QLatin1String("version"));
+        version = value.isString() ? value.toString().toInt(&ok) : value.toInt(-1);
+        ok = ok || version >= 0;
+    } else {
+        version = data.trimmed().toInt(&ok);
+    }
+    if (!ok || version < 0) {
+        qWarning() << "QGeoTiledMappingManagerEngineTomTom: unable to parse map version" << data;
+        return;
+    }
+    updateVersion(version, false);
+}
+
+/*
+    A new version discovered by polling is adopted after a random delay within the
+    rollout window, so that a fleet of devices spreads the resulting refetches over time
+    instead of re-downloading all at once.
+*/
+void QGeoTiledMappingManagerEngineTomTom::updateVersion(int version, bool immediate)
+{
+    if (version == tileVersion()) {
+        m_versionRolloutTimer.stop();
+        m_pendingVersion = -1;
+        return;
+    }
+    if (version == m_pendingVersion && m_versionRolloutTimer.isActive())
+        return;
+
+    m_pendingVersion = version;
+    if (immediate || tileVersion() < 0 || m_versionRolloutWindow <= 0) {
+        adoptPendingVersion();
+    } else {
+        const int delay = QRandomGenerator::global()->bounded(m_versionRolloutWindow);
+        m_versionRolloutTimer.start(delay * 1000);
+    }
+}
+
+void QGeoTiledMappingManagerEngineTomTom::adoptPendingVersion()
+{
+    if (m_pendingVersion < 0)
+        return;
+    const int version = m_pendingVersion;
+    m_pendingVersion = -1;
+
+    static_cast<QGeoFileTileCacheTomTom *>(tileCache())->setTileVersion(version);
+    setTileVersion(version);
+    saveMapVersion();
+}
+
+void QGeoTiledMappingManagerEngineTomTom::loadMapVersion()
+{
+    QDir saveDir(m_cacheDirectory);
+    QFile saveFile(saveDir.filePath(QLatin1String("tomtom_version")));
+    if (!saveFile.open(QIODevice::ReadOnly))
+        return;
+
+    const QJsonObject object = QJsonDocument::fromJson(saveFile.readAll()).object();
+    const int version = object.value(QLatin1String("version")).toInt(-1);
+    if (version >= 0)
+        updateVersion(version, true);
+}
+
+void QGeoTiledMappingManagerEngineTomTom::saveMapVersion()
+{
+    QDir saveDir(m_cacheDirectory);
+    QFile saveFile(saveDir.filePath(QLatin1String("tomtom_version")));
+    if (!saveFile.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to write tile version to disk";
+        return;
+    }
+
+    QJsonObject object;
+    object.insert(QLatin1String("version"), tileVersion());
+    saveFile.write(QJsonDocument(object).toJson());
+}
+
 QT_END_NAMESPACE
 
 
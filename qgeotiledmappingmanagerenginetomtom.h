@@ -22,28 +22,59 @@
 #define QGEOTILEDMAPPINGMANAGERENGINETOMTOM_H
 
 #include <QtLocation/QGeoServiceProvider>
+#include <QtCore/QTimer>
+#include <QtPositioning/QGeoRectangle>
 
 #include <QtLocation/private/qgeotiledmappingmanagerengine_p.h>
+#include <QtLocation/private/qgeotilespec_p.h>
 
 QT_BEGIN_NAMESPACE
 
+class QGeoTiledMapTomTom;
+
 class QGeoTiledMappingManagerEngineTomTom : public QGeoTiledMappingManagerEngine
 {
     Q_OBJECT
 
 public:
+    // Shared by network fetches and disk cache reads. Higher values are served first.
+    enum TilePriority {
+        PrefetchTilePriority = 0,
+        VisibleTilePriority = 1
+    };
+
     QGeoTiledMappingManagerEngineTomTom(const QVariantMap &parameters,
                                         QGeoServiceProvider::Error *error, QString *errorString);
     ~QGeoTiledMappingManagerEngineTomTom();
 
     QGeoMap *createMap();
 
+    TilePriority tilePriority(const QGeoTileSpec &spec) const;
+    void setVisibleTiles(QGeoTiledMapTomTom *map, const QSet<QGeoTileSpec> &tiles);
+
 public Q_SLOTS:
     void onCopyrightsFetched(const QByteArray &data);
+    void onVersionFetched(const QByteArray &data);
+
+private Q_SLOTS:
+    void adoptPendingVersion();
 
 private:
+    void updateVersion(int version, bool immediate);
+    void loadMapVersion();
+    void saveMapVersion();
+
     QString m_cacheDirectory;
     QImage m_copyrightsImage;
+    QHash<QGeoTiledMapTomTom *, QSet<QGeoTileSpec>> m_visibleTiles;
+    int m_pendingVersion = -1;
+    int m_versionRolloutWindow = 6 * 60 * 60; // seconds
+    QTimer m_versionPollTimer;
+    QTimer m_versionRolloutTimer;
+    QString m_exportArchive;
+    QGeoRectangle m_exportRegion;
+    int m_exportMinZoom = 0;
+    int m_exportMaxZoom = 30;
 };
 
 QT_END_NAMESPACE
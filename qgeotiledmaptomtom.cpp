@@ -31,11 +31,16 @@ QGeoTiledMapTomTom::QGeoTiledMapTomTom(QGeoTiledMappingManagerEngineTomTom *engi
 
 QGeoTiledMapTomTom::~QGeoTiledMapTomTom()
 {
-
+    if (m_engine)
+        m_engine->setVisibleTiles(this, QSet<QGeoTileSpec>());
 }
 
 void QGeoTiledMapTomTom::evaluateCopyrights(const QSet<QGeoTileSpec> &visibleTiles)
 {
+    // Also a convenient hook to learn which tiles are on screen, to fetch those first.
+    if (m_engine)
+        m_engine->setVisibleTiles(this, visibleTiles);
+
     if (visibleTiles.isEmpty())
         return;
 
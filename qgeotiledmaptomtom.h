@@ -22,6 +22,7 @@
 #define QGEOTILEDMAPTOMTOM_H
 
 #include <QtLocation/private/qgeotiledmap_p.h>
+#include <QtCore/QPointer>
 
 #ifdef LOCATIONLABS
 #include <QtLocation/private/qgeotiledmaplabs_p.h>
@@ -46,7 +47,7 @@ protected:
 
 private:
     QString m_copyrights;
-    QGeoTiledMappingManagerEngineTomTom *m_engine;
+    QPointer<QGeoTiledMappingManagerEngineTomTom> m_engine;
 };
 
 QT_END_NAMESPACE
@@ -0,0 +1,154 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#include "qgeotileevictionpolicytomtom.h"
+
+QT_BEGIN_NAMESPACE
+
+QGeoTileEvictionPolicyTomTom::~QGeoTileEvictionPolicyTomTom()
+{
+}
+
+/*
+    Returns a new policy for the given name, or nullptr for unknown names, in which case
+    the cache keeps the eviction of QGeoFileTileCache.
+*/
+QGeoTileEvictionPolicyTomTom *QGeoTileEvictionPolicyTomTom::create(const QString &name)
+{
+    if (name == QLatin1String("lru"))
+        return new QGeoTileEvictionPolicyLruTomTom;
+    if (name == QLatin1String("lfu") || name == QLatin1String("frequency"))
+        return new QGeoTileEvictionPolicyFrequencyTomTom;
+    return nullptr;
+}
+
+void QGeoTileEvictionPolicyTomTom::insert(const QGeoTileSpec &spec, int cost)
+{
+    auto it = m_entries.find(spec);
+    if (it == m_entries.end()) {
+        it = m_entries.insert(spec, Entry());
+    } else {
+        m_order.erase(OrderKey(it->rank, it->sequence));
+        m_totalCost -= it->cost;
+    }
+    it->cost = cost;
+    m_totalCost += cost;
+    place(spec, *it);
+}
+
+void QGeoTileEvictionPolicyTomTom::touch(const QGeoTileSpec &spec)
+{
+    auto it = m_entries.find(spec);
+    if (it == m_entries.end())
+        return;
+    m_order.erase(OrderKey(it->rank, it->sequence));
+    ++it->hits;
+    place(spec, *it);
+}
+
+void QGeoTileEvictionPolicyTomTom::remove(const QGeoTileSpec &spec)
+{
+    auto it = m_entries.find(spec);
+    if (it == m_entries.end())
+        return;
+    m_order.erase(OrderKey(it->rank, it->sequence));
+    m_totalCost -= it->cost;
+    m_entries.erase(it);
+}
+
+bool QGeoTileEvictionPolicyTomTom::contains(const QGeoTileSpec &spec) const
+{
+    return m_entries.contains(spec);
+}
+
+QGeoTileSpec QGeoTileEvictionPolicyTomTom::takeVictim()
+{
+    if (m_order.empty())
+        return QGeoTileSpec();
+
+    const QGeoTileSpec spec = m_order.begin()->second;
+    const Entry entry = m_entries.take(spec);
+    m_order.erase(m_order.begin());
+    m_totalCost -= entry.cost;
+    evicted(entry);
+    return spec;
+}
+
+void QGeoTileEvictionPolicyTomTom::clear()
+{
+    m_entries.clear();
+    m_order.clear();
+    m_totalCost = 0;
+}
+
+int QGeoTileEvictionPolicyTomTom::count() const
+{
+    return m_entries.size();
+}
+
+qint64 QGeoTileEvictionPolicyTomTom::totalCost() const
+{
+    return m_totalCost;
+}
+
+void QGeoTileEvictionPolicyTomTom::evicted(const Entry &/*entry*/)
+{
+}
+
+void QGeoTileEvictionPolicyTomTom::place(const QGeoTileSpec &spec, Entry &entry)
+{
+    entry.sequence = ++m_sequence;
+    entry.rank = rank(spec, entry);
+    m_order.emplace(OrderKey(entry.rank, entry.sequence), spec);
+}
+
+QString QGeoTileEvictionPolicyLruTomTom::name() const
+{
+    return QStringLiteral("lru");
+}
+
+double QGeoTileEvictionPolicyLruTomTom::rank(const QGeoTileSpec &/*spec*/, const Entry &/*entry*/) const
+{
+    return 0.0; // ordered by last access only
+}
+
+QString QGeoTileEvictionPolicyFrequencyTomTom::name() const
+{
+    return QStringLiteral("lfu");
+}
+
+void QGeoTileEvictionPolicyFrequencyTomTom::setProtectedZoom(int zoom)
+{
+    m_protectedZoom = qMax(0, zoom);
+}
+
+double QGeoTileEvictionPolicyFrequencyTomTom::rank(const QGeoTileSpec &spec, const Entry &entry) const
+{
+    // Each zoom level below the protected one is worth half a hit more per access.
+    const double weight = 1.0 + 0.5 * qMax(0, m_protectedZoom - spec.zoom());
+    return m_age + (entry.hits + 1) * weight;
+}
+
+void QGeoTileEvictionPolicyFrequencyTomTom::evicted(const Entry &entry)
+{
+    m_age = entry.rank;
+}
+
+QT_END_NAMESPACE
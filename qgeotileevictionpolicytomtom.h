@@ -0,0 +1,111 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#ifndef QGEOTILEEVICTIONPOLICYTOMTOM_H
+#define QGEOTILEEVICTIONPOLICYTOMTOM_H
+
+#include <QtLocation/private/qgeotilespec_p.h>
+#include <QHash>
+#include <QString>
+#include <map>
+#include <utility>
+
+QT_BEGIN_NAMESPACE
+
+/*
+    Decides which disk cached tile goes first when the cache is over budget.
+    Entries are kept ordered by rank() and the lowest ranked one is the victim.
+    Ties are broken by the order of the last access, oldest first.
+*/
+class QGeoTileEvictionPolicyTomTom
+{
+public:
+    virtual ~QGeoTileEvictionPolicyTomTom();
+
+    static QGeoTileEvictionPolicyTomTom *create(const QString &name);
+
+    virtual QString name() const = 0;
+
+    void insert(const QGeoTileSpec &spec, int cost);
+    void touch(const QGeoTileSpec &spec);
+    void remove(const QGeoTileSpec &spec);
+    bool contains(const QGeoTileSpec &spec) const;
+    QGeoTileSpec takeVictim();
+    void clear();
+
+    int count() const;
+    qint64 totalCost() const;
+
+protected:
+    struct Entry
+    {
+        int cost = 0;
+        int hits = 0;
+        double rank = 0.0;
+        quint64 sequence = 0;
+    };
+
+    virtual double rank(const QGeoTileSpec &spec, const Entry &entry) const = 0;
+    virtual void evicted(const Entry &entry);
+
+private:
+    typedef std::pair<double, quint64> OrderKey;
+
+    void place(const QGeoTileSpec &spec, Entry &entry);
+
+    QHash<QGeoTileSpec, Entry> m_entries;
+    std::map<OrderKey, QGeoTileSpec> m_order;
+    quint64 m_sequence = 0;
+    qint64 m_totalCost = 0;
+};
+
+class QGeoTileEvictionPolicyLruTomTom : public QGeoTileEvictionPolicyTomTom
+{
+public:
+    QString name() const override;
+
+protected:
+    double rank(const QGeoTileSpec &spec, const Entry &entry) const override;
+};
+
+/*
+    LFU with dynamic aging: a tile ranks by its hits, weighted by how low its zoom level is,
+    on top of the rank of the last evicted tile. Tiles that were popular long ago thus
+    age out eventually, while overview tiles survive long pans at high zoom levels.
+*/
+class QGeoTileEvictionPolicyFrequencyTomTom : public QGeoTileEvictionPolicyTomTom
+{
+public:
+    QString name() const override;
+
+    void setProtectedZoom(int zoom);
+
+protected:
+    double rank(const QGeoTileSpec &spec, const Entry &entry) const override;
+    void evicted(const Entry &entry) override;
+
+private:
+    int m_protectedZoom = 10; // tiles at or above this zoom get no extra weight
+    double m_age = 0.0;
+};
+
+QT_END_NAMESPACE
+
+#endif // QGEOTILEEVICTIONPOLICYTOMTOM_H
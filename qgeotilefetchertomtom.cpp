@@ -21,6 +21,7 @@
 #include "qgeotilefetchertomtom.h"
 #include "qgeotiledmappingmanagerenginetomtom.h"
 #include "qgeomapreplytomtom.h"
+#include "qgeofiletilecachetomtom.h"
 #include "qtomtomcommon.h"
 
 #include <QtNetwork/QNetworkAccessManager>
@@ -55,12 +56,14 @@ QGeoTileFetcherTomTom::QGeoTileFetcherTomTom(int scaleFactor, QGeoTiledMappingMa
 :   QGeoTileFetcher(parent),
     m_engine(parent),
     m_networkManager(new QNetworkAccessManager(this)),
-    m_userAgent(QTomTomCommon::userAgent)
+    m_userAgent(QTomTomCommon::userAgent),
+    m_bufferPool(new QGeoTileBufferPoolTomTom)
 {
     m_scaleFactor = qBound(1, scaleFactor, 2);
     m_language = m_engine->locale().name().toLatin1();
     if (!acceptedLanguages.contains(m_language))
         m_language = "NGT-Latn";
+    m_clock.start();
 }
 
 void QGeoTileFetcherTomTom::setUserAgent(const QByteArray &userAgent)
@@ -73,6 +76,25 @@ void QGeoTileFetcherTomTom::setAccessToken(const QString &accessToken)
     m_accessToken = accessToken.toLatin1();
 }
 
+void QGeoTileFetcherTomTom::setVersionUrl(const QUrl &versionUrl)
+{
+    m_versionUrl = versionUrl;
+}
+
+void QGeoTileFetcherTomTom::setMaxConcurrency(int replies)
+{
+    m_maxWindow = qMax(1, replies);
+    m_window = qMin(m_window, double(m_maxWindow));
+}
+
+// 0 disables the resolution fallback
+void QGeoTileFetcherTomTom::setLowBandwidthThreshold(int bytesPerSecond)
+{
+    m_lowBandwidth = qMax(0, bytesPerSecond);
+    if (!m_lowBandwidth)
+        m_reducedResolution = false;
+}
+
 void QGeoTileFetcherTomTom::onCopyrightsFetched()
 {
     if (!m_copyrightsReply)
@@ -106,10 +128,205 @@ void QGeoTileFetcherTomTom::fetchCopyrightsData()
         connect(m_copyrightsReply, SIGNAL(finished()), this, SLOT(onCopyrightsFetched()));
 }
 
+void QGeoTileFetcherTomTom::onVersionFetched()
+{
+    if (!m_versionReply)
+        return;
+
+    m_versionReply->deleteLater();
+    if (m_engine && m_versionReply->error() == QNetworkReply::NoError) {
+        QMetaObject::invokeMethod(m_engine,
+                                  "onVersionFetched",
+                                  Qt::QueuedConnection,
+                                  Q_ARG(const QByteArray &, m_versionReply->readAll()));
+    }
+
+    m_versionReply = nullptr;
+}
+
+void QGeoTileFetcherTomTom::fetchVersionData()
+{
+    if (!m_versionUrl.isValid() || m_versionReply)
+        return;
+
+    QNetworkRequest request;
+    request.setHeader(QNetworkRequest::UserAgentHeader, m_userAgent);
+    request.setUrl(m_versionUrl);
+    m_versionReply = m_networkManager->get(request);
+
+    if (m_versionReply->isFinished())
+        onVersionFetched();
+    else
+        connect(m_versionReply, SIGNAL(finished()), this, SLOT(onVersionFetched()));
+}
+
 QGeoTiledMapReply *QGeoTileFetcherTomTom::getTileImage(const QGeoTileSpec &spec)
+{
+    QGeoMapReplyTomTom *reply = new QGeoMapReplyTomTom(spec);
+
+    // Tiles already on disk take the same asynchronous path, only served by the cache I/O pool
+    QGeoFileTileCacheTomTom *cache = static_cast<QGeoFileTileCacheTomTom *>(m_engine->tileCache());
+    if (cache && cache->readTileAsync(spec, m_engine->tilePriority(spec), reply)) {
+        connect(reply, &QGeoMapReplyTomTom::cacheMissed, this, &QGeoTileFetcherTomTom::onCacheMissed);
+        return reply;
+    }
+
+    enqueue(reply);
+    return reply;
+}
+
+void QGeoTileFetcherTomTom::onCacheMissed()
+{
+    QGeoMapReplyTomTom *reply = qobject_cast<QGeoMapReplyTomTom *>(sender());
+    if (!reply || reply->isFinished())
+        return;
+    enqueue(reply);
+}
+
+void QGeoTileFetcherTomTom::enqueue(QGeoMapReplyTomTom *reply)
+{
+    if (m_engine->tilePriority(reply->tileSpec()) == QGeoTiledMappingManagerEngineTomTom::VisibleTilePriority)
+        m_visibleQueue.append(reply);
+    else
+        m_prefetchQueue.append(reply);
+    dispatch();
+}
+
+/*
+    Starts queued fetches as long as the window allows, visible tiles first.
+    Replies aborted or deleted while queued are dropped here.
+*/
+void QGeoTileFetcherTomTom::dispatch()
+{
+    while (m_inFlight.size() < qMax(1, int(m_window))) {
+        QList<QPointer<QGeoMapReplyTomTom>> &queue = m_visibleQueue.isEmpty() ? m_prefetchQueue : m_visibleQueue;
+        if (queue.isEmpty())
+            break;
+        QGeoMapReplyTomTom *reply = queue.takeFirst().data();
+        if (!reply || reply->isFinished())
+            continue;
+
+        const QGeoTileSpec spec = reply->tileSpec();
+        const bool reduced = m_reducedResolution && m_scaleFactor > 1;
+        if (reduced) {
+            // Not worth keeping once bandwidth recovers
+            QGeoFileTileCacheTomTom *cache = static_cast<QGeoFileTileCacheTomTom *>(m_engine->tileCache());
+            if (cache)
+                cache->skipDiskInsert(spec);
+        }
+        QNetworkReply *networkReply = fetchTile(spec, reduced);
+        InFlight fetch;
+        fetch.start = m_clock.elapsed();
+        fetch.spec = spec;
+        fetch.reduced = reduced;
+        m_inFlight.insert(networkReply, fetch);
+        // Connected before the map reply, to see the reply before its data is consumed
+        connect(networkReply, SIGNAL(finished()), this, SLOT(onTileFetched()));
+        // The map reply consumes the data as it arrives, so the size is tracked here
+        connect(networkReply, &QNetworkReply::downloadProgress, this, [this, networkReply](qint64 received, qint64) {
+            const auto it = m_inFlight.find(networkReply);
+            if (it != m_inFlight.end())
+                it->received = received;
+        });
+        // Replies deleted unfinished, together with their map reply, never emit finished()
+        connect(networkReply, &QObject::destroyed, this, [this, networkReply]() {
+            const auto it = m_inFlight.find(networkReply);
+            if (it == m_inFlight.end())
+                return;
+            if (it->reduced)
+                keepDiskInsert(it->spec);
+            m_inFlight.erase(it);
+            dispatch();
+        });
+        reply->setBufferPool(m_bufferPool);
+        reply->setNetworkReply(networkReply);
+    }
+
+    const bool saturated = !m_visibleQueue.isEmpty() || !m_prefetchQueue.isEmpty();
+    if (saturated && !m_saturated) {
+        m_sampleStart = m_clock.elapsed();
+        m_sampleBytes = 0;
+    }
+    m_saturated = saturated;
+}
+
+void QGeoTileFetcherTomTom::onTileFetched()
+{
+    QNetworkReply *reply = static_cast<QNetworkReply *>(sender());
+    const auto it = m_inFlight.find(reply);
+    if (it == m_inFlight.end())
+        return;
+    const InFlight fetch = it.value();
+    m_inFlight.erase(it);
+
+    // A degraded tile that never arrives must not keep the full one off the disk later on.
+    if (fetch.reduced && reply->error() != QNetworkReply::NoError)
+        keepDiskInsert(fetch.spec);
+
+    if (reply->error() != QNetworkReply::OperationCanceledError)
+        updateWindow(m_clock.elapsed() - fetch.start, fetch.received, reply->error() != QNetworkReply::NoError);
+    dispatch();
+}
+
+void QGeoTileFetcherTomTom::keepDiskInsert(const QGeoTileSpec &spec)
+{
+    QGeoFileTileCacheTomTom *cache = static_cast<QGeoFileTileCacheTomTom *>(m_engine->tileCache());
+    if (cache)
+        cache->keepDiskInsert(spec);
+}
+
+void QGeoTileFetcherTomTom::updateWindow(qint64 latency, qint64 bytes, bool failed)
+{
+    ++m_sinceDecrease;
+    if (failed) {
+        if (m_sinceDecrease >= int(m_window)) { // once per window
+            m_window = qMax(1.0, m_window * 0.5);
+            m_sinceDecrease = 0;
+        }
+        return;
+    }
+
+    m_latency = m_latency > 0.0 ? 0.8 * m_latency + 0.2 * latency : latency;
+    // The minimum slowly forgets, to follow route changes
+    m_minLatency = (m_minLatency > 0.0) ? qMin(m_minLatency * 1.01, double(latency)) : latency;
+
+    if (m_latency > 2.0 * m_minLatency + 50.0) {
+        // Requests are queueing somewhere: back off
+        if (m_sinceDecrease >= int(m_window)) {
+            m_window = qMax(1.0, m_window * 0.75);
+            m_sinceDecrease = 0;
+        }
+    } else {
+        m_window = qMin(double(m_maxWindow), m_window + 1.0 / m_window);
+    }
+
+    if (!m_saturated)
+        return;
+    m_sampleBytes += bytes;
+    const qint64 elapsed = m_clock.elapsed() - m_sampleStart;
+    if (elapsed < 1000)
+        return;
+    const double sample = m_sampleBytes * 1000.0 / elapsed;
+    m_throughput = m_throughput >= 0.0 ? 0.7 * m_throughput + 0.3 * sample : sample;
+    m_sampleStart += elapsed;
+    m_sampleBytes = 0;
+
+    if (m_lowBandwidth > 0) {
+        if (!m_reducedResolution && m_throughput < m_lowBandwidth)
+            m_reducedResolution = true;
+        else if (m_reducedResolution && m_throughput > 2.0 * m_lowBandwidth)
+            m_reducedResolution = false;
+    }
+}
+
+QNetworkReply *QGeoTileFetcherTomTom::fetchTile(const QGeoTileSpec &spec, bool reducedResolution)
 {
     QNetworkRequest request;
     request.setHeader(QNetworkRequest::UserAgentHeader, m_userAgent);
+    if (m_engine->tilePriority(spec) == QGeoTiledMappingManagerEngineTomTom::VisibleTilePriority)
+        request.setPriority(QNetworkRequest::HighPriority);
+    else
+        request.setPriority(QNetworkRequest::LowPriority);
 
     const int mapId = qBound(0, spec.mapId() - 1, styles.size() - 1);
     QByteArray url = QTomTomCommon::baseUrlMappingPrefixed.at(
@@ -122,12 +339,10 @@ QGeoTiledMapReply *QGeoTileFetcherTomTom::getTileImage(const QGeoTileSpec &spec)
     url += QByteArrayLiteral("?key=") + m_accessToken;
     url += QByteArrayLiteral("&language=") + m_language;
     // ToDo: support "political views"
-    url += QByteArrayLiteral("&tileSize=") + ((m_scaleFactor > 1) ? QByteArrayLiteral("512") : QByteArrayLiteral("256"));
+    url += QByteArrayLiteral("&tileSize=") + ((m_scaleFactor > 1 && !reducedResolution) ? QByteArrayLiteral("512") : QByteArrayLiteral("256"));
     request.setUrl(QUrl(url));
 
-    QNetworkReply *reply = m_networkManager->get(request);
-
-    return new QGeoMapReplyTomTom(reply, spec);
+    return m_networkManager->get(request);
 }
 
 QT_END_NAMESPACE
@@ -22,11 +22,19 @@
 #define QGEOTILEFETCHERTOMTOM_H
 
 #include <qvector.h>
+#include <QtCore/QUrl>
+#include <QtCore/QHash>
+#include <QtCore/QPointer>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QElapsedTimer>
 #include <QtLocation/private/qgeotilefetcher_p.h>
+#include <QtLocation/private/qgeotilespec_p.h>
 
 QT_BEGIN_NAMESPACE
 
 class QGeoTiledMappingManagerEngineTomTom;
+class QGeoMapReplyTomTom;
+class QGeoTileBufferPoolTomTom;
 class QNetworkAccessManager;
 class QNetworkReply;
 
@@ -39,17 +47,33 @@ public:
 
     void setUserAgent(const QByteArray &userAgent);
     void setAccessToken(const QString &accessToken);
+    void setVersionUrl(const QUrl &versionUrl);
+    void setMaxConcurrency(int replies);
+    void setLowBandwidthThreshold(int bytesPerSecond);
 
 public Q_SLOTS:
     void onCopyrightsFetched();
     void fetchCopyrightsData();
+    void onVersionFetched();
+    void fetchVersionData();
+
+private Q_SLOTS:
+    void onCacheMissed();
+    void onTileFetched();
 
 private:
     QGeoTiledMapReply *getTileImage(const QGeoTileSpec &spec);
+    QNetworkReply *fetchTile(const QGeoTileSpec &spec, bool reducedResolution = false);
+    void enqueue(QGeoMapReplyTomTom *reply);
+    void dispatch();
+    void updateWindow(qint64 latency, qint64 bytes, bool failed);
+    void keepDiskInsert(const QGeoTileSpec &spec);
 
     QGeoTiledMappingManagerEngineTomTom *m_engine;
     QNetworkAccessManager *m_networkManager;
     QNetworkReply *m_copyrightsReply = nullptr;
+    QNetworkReply *m_versionReply = nullptr;
+    QUrl m_versionUrl;
     QByteArray m_userAgent;
     QByteArray m_format = QByteArrayLiteral("png");
     QByteArray m_replyFormat = QByteArrayLiteral("png");
@@ -57,6 +81,34 @@ private:
     QByteArray m_language;
     quint64 m_fetchedTiles = 0;
     int m_scaleFactor;
+    QSharedPointer<QGeoTileBufferPoolTomTom> m_bufferPool;
+
+    // AIMD controlled fetch window: grows by one tile per window of successful fetches
+    // while latency stays close to the minimum observed, shrinks multiplicatively on
+    // failures and on queueing delay.
+    QList<QPointer<QGeoMapReplyTomTom>> m_visibleQueue;
+    QList<QPointer<QGeoMapReplyTomTom>> m_prefetchQueue;
+    struct InFlight
+    {
+        qint64 start = 0; // ms
+        qint64 received = 0; // bytes
+        QGeoTileSpec spec;
+        bool reduced = false;
+    };
+    QHash<QNetworkReply *, InFlight> m_inFlight;
+    QElapsedTimer m_clock;
+    double m_window = 4.0;
+    int m_maxWindow = 16;
+    int m_sinceDecrease = 0;
+    double m_latency = 0.0; // ms, moving average
+    double m_minLatency = 0.0; // ms
+    // Throughput is only sampled while the window is full, as idle time says nothing about bandwidth.
+    double m_throughput = -1.0; // bytes/s, moving average
+    qint64 m_sampleStart = 0;
+    qint64 m_sampleBytes = 0;
+    bool m_saturated = false;
+    int m_lowBandwidth = 48 * 1024; // bytes/s below which high-dpi tiles are fetched at 256px
+    bool m_reducedResolution = false;
 };
 
 QT_END_NAMESPACE
@@ -318,46 +318,53 @@ void QPlaceSearchReplyTomTom::onReplyFinished()
         return;
     }
 
-    QJsonDocument document = QJsonDocument::fromJson(reply->readAll());
-    if (Q_UNLIKELY(!document.isObject())) {
-        setError(ParseError, tr("Response parse error"));
-        return;
-    }
-    const QJsonObject &responseObject = document.object();
-    if (Q_UNLIKELY(!responseObject.contains(QLatin1String("results"))
-                   || !responseObject.contains(QLatin1String("summary")))) {
-        setError(ParseError, tr("Malformed response: missing results or summary"));
-        return;
-    }
-
-    const QVariantMap summary = responseObject.value(QLatin1String("summary")).toObject().toVariantMap();
-    const int totalResults = summary.value(QLatin1String("totalResults")).toInt();
-    const int numResults = summary.value(QLatin1String("numResults")).toInt();
-    const int offset = summary.value(QLatin1String("offset")).toInt();
-
-    const QPlaceSearchRequest &req = request();
-    QList<QPlaceSearchResult> results = parseResults(responseObject, req);
-    const QPlaceSearchRequestPrivate *rpimpl = QPlaceSearchRequestPrivate::get(req);
-
-    if (rpimpl->page > 0) {
-        QPlaceSearchRequest previous;
-        QPlaceSearchRequestPrivate *previousPimpl = QPlaceSearchRequestPrivate::get(previous);
-        previousPimpl->page = rpimpl->page - 1;
-        previousPimpl->related = true;
-        setPreviousPageRequest(previous);
-    }
-
-    if (numResults && offset + numResults < totalResults) {
-        QPlaceSearchRequest next;
-        QPlaceSearchRequestPrivate *nextPimpl = QPlaceSearchRequestPrivate::get(next);
-        nextPimpl->page = rpimpl->page + 1;
-        nextPimpl->related = true;
-        setNextPageRequest(next);
-    }
+    const QByteArray payload = reply->readAll();
+    const QPlaceSearchRequest req = request();
+    QTomTomCommon::parseInBackground(this, [this, payload, req]() -> std::function<void()> {
+        QJsonDocument document = QJsonDocument::fromJson(payload);
+        if (Q_UNLIKELY(!document.isObject())) {
+            return [this]() {
+                setError(ParseError, tr("Response parse error"));
+            };
+        }
+        const QJsonObject &responseObject = document.object();
+        if (Q_UNLIKELY(!responseObject.contains(QLatin1String("results"))
+                       || !responseObject.contains(QLatin1String("summary")))) {
+            return [this]() {
+                setError(ParseError, tr("Malformed response: missing results or summary"));
+            };
+        }
 
-    setResults(results);
-    setFinished(true);
-    emit finished();
+        const QVariantMap summary = responseObject.value(QLatin1String("summary")).toObject().toVariantMap();
+        const int totalResults = summary.value(QLatin1String("totalResults")).toInt();
+        const int numResults = summary.value(QLatin1String("numResults")).toInt();
+        const int offset = summary.value(QLatin1String("offset")).toInt();
+        const QList<QPlaceSearchResult> results = parseResults(responseObject, req);
+
+        return [this, req, results, totalResults, numResults, offset]() {
+            const QPlaceSearchRequestPrivate *rpimpl = QPlaceSearchRequestPrivate::get(req);
+
+            if (rpimpl->page > 0) {
+                QPlaceSearchRequest previous;
+                QPlaceSearchRequestPrivate *previousPimpl = QPlaceSearchRequestPrivate::get(previous);
+                previousPimpl->page = rpimpl->page - 1;
+                previousPimpl->related = true;
+                setPreviousPageRequest(previous);
+            }
+
+            if (numResults && offset + numResults < totalResults) {
+                QPlaceSearchRequest next;
+                QPlaceSearchRequestPrivate *nextPimpl = QPlaceSearchRequestPrivate::get(next);
+                nextPimpl->page = rpimpl->page + 1;
+                nextPimpl->related = true;
+                setNextPageRequest(next);
+            }
+
+            setResults(results);
+            setFinished(true);
+            emit finished();
+        };
+    });
 }
 
 /* search suggestions */
@@ -409,29 +416,36 @@ void QPlaceSearchSuggestionReplyTomTom::onReplyFinished()
         return;
     }
 
-    QJsonDocument document = QJsonDocument::fromJson(reply->readAll());
-    if (Q_UNLIKELY(!document.isObject())) {
-        setError(ParseError, tr("Response parse error"));
-        return;
-    }
-    const QJsonObject &responseObject = document.object();
-    if (Q_UNLIKELY(!responseObject.contains(QLatin1String("results"))
-                   || !responseObject.contains(QLatin1String("summary")))) {
-        setError(ParseError, tr("Malformed response: missing results or summary"));
-        return;
-    }
+    const QByteArray payload = reply->readAll();
+    const QPlaceSearchRequest req = m_request;
+    QTomTomCommon::parseInBackground(this, [this, payload, req]() -> std::function<void()> {
+        QJsonDocument document = QJsonDocument::fromJson(payload);
+        if (Q_UNLIKELY(!document.isObject())) {
+            return [this]() {
+                setError(ParseError, tr("Response parse error"));
+            };
+        }
+        const QJsonObject &responseObject = document.object();
+        if (Q_UNLIKELY(!responseObject.contains(QLatin1String("results"))
+                       || !responseObject.contains(QLatin1String("summary")))) {
+            return [this]() {
+                setError(ParseError, tr("Malformed response: missing results or summary"));
+            };
+        }
 
-    const QPlaceSearchRequest &req = m_request;
-    QList<QPlaceSearchResult> results = parseResults(responseObject, req);
-    QStringList suggestions;
-    for (const auto &r: results)
-        suggestions.append(r.title());
+        QList<QPlaceSearchResult> results = parseResults(responseObject, req);
+        QStringList suggestions;
+        for (const auto &r: results)
+            suggestions.append(r.title());
 
-    // ToDo: support pagination here too!
+        // ToDo: support pagination here too!
 
-    setSuggestions(suggestions);
-    setFinished(true);
-    emit finished();
+        return [this, suggestions]() {
+            setSuggestions(suggestions);
+            setFinished(true);
+            emit finished();
+        };
+    });
 }
 
 /* category initialization */
@@ -491,108 +505,115 @@ void QPlaceCategoriesInitializationReplyTomTom::onReplyFinished()
         return;
     }
 
-    QJsonDocument document = QJsonDocument::fromJson(reply->readAll());
-    if (Q_UNLIKELY(!document.isObject())) {
-        setError(ParseError, tr("Response parse error"));
-        return;
-    }
-    const QJsonObject &responseObject = document.object();
-    if (Q_UNLIKELY(!responseObject.contains(QLatin1String("poiCategories")) )) {
-        setError(ParseError, tr("Malformed response: missing poiCategories"));
-        return;
-    }
-
-    QVariantList categoriesJson = responseObject.value(QLatin1String("poiCategories")).toArray().toVariantList();
-
-    QList<QString> rootCategories;
-    QMap<QString, SearchCategoryTomTom> categoryMap;
-    QPlaceManagerEngineTomTom *engine = qobject_cast<QPlaceManagerEngineTomTom *>(parent());
-
-    for (const auto &c: categoriesJson) {
-        const QVariantMap data = c.toMap();
-        SearchCategoryTomTom sc;
-        QStringList children;
-        const QString id = data.value("id").toString();
-        const QString name = data.value("name").toString();
-        if (id.isEmpty() || name.isEmpty())
-            continue;
-
-        for (const auto &child: data.value("childCategoryIds").toStringList())
-            children.append(child);
-        sc.children = children;
-        sc.childrenWithSynonyms = children;
-        sc.category.setName(name);
-        sc.category.setCategoryId(id);
-
-        /* forget synonyms for now
-        int cnt = 1;
-        for (const auto &s: data.value("synonyms").toStringList()) {
-            SearchCategoryTomTom sc_;
-            sc_.category.setName(s);
-            sc_.category.setCategoryId(id);
-            const QString id_ = id + QChar('_') + QString::number(cnt); // fake id
-            sc_.id = id_;
-            sc_.synonymOf = id;
-            categoryMap[id_] = sc_;
-            ++cnt;
+    const QByteArray payload = reply->readAll();
+    QTomTomCommon::parseInBackground(this, [this, payload]() -> std::function<void()> {
+        QJsonDocument document = QJsonDocument::fromJson(payload);
+        if (Q_UNLIKELY(!document.isObject())) {
+            return [this]() {
+                setError(ParseError, tr("Response parse error"));
+            };
+        }
+        const QJsonObject &responseObject = document.object();
+        if (Q_UNLIKELY(!responseObject.contains(QLatin1String("poiCategories")) )) {
+            return [this]() {
+                setError(ParseError, tr("Malformed response: missing poiCategories"));
+            };
         }
-        */
 
-        sc.id = id;
-        categoryMap[id] = sc;
-    }
+        QVariantList categoriesJson = responseObject.value(QLatin1String("poiCategories")).toArray().toVariantList();
+
+        QList<QString> rootCategories;
+        QMap<QString, SearchCategoryTomTom> categoryMap;
+
+        for (const auto &c: categoriesJson) {
+            const QVariantMap data = c.toMap();
+            SearchCategoryTomTom sc;
+            QStringList children;
+            const QString id = data.value("id").toString();
+            const QString name = data.value("name").toString();
+            if (id.isEmpty() || name.isEmpty())
+                continue;
+
+            for (const auto &child: data.value("childCategoryIds").toStringList())
+                children.append(child);
+            sc.children = children;
+            sc.childrenWithSynonyms = children;
+            sc.category.setName(name);
+            sc.category.setCategoryId(id);
+
+            /* forget synonyms for now
+            int cnt = 1;
+            for (const auto &s: data.value("synonyms").toStringList()) {
+                SearchCategoryTomTom sc_;
+                sc_.category.setName(s);
+                sc_.category.setCategoryId(id);
+                const QString id_ = id + QChar('_') + QString::number(cnt); // fake id
+                sc_.id = id_;
+                sc_.synonymOf = id;
+                categoryMap[id_] = sc_;
+                ++cnt;
+            }
+            */
+
+            sc.id = id;
+            categoryMap[id] = sc;
+        }
 
-    // Rebuild parenting structure.
-    for (const QString &key: categoryMap.keys()) {
-        if (key.isEmpty())
-            continue;
-        SearchCategoryTomTom &cat = categoryMap[key];
-        for (const QString &childKey: categoryMap.value(key).children) {
-            categoryMap[childKey].parent = key;
-            cat.childCategories.append(categoryMap[childKey].category);
+        // Rebuild parenting structure.
+        for (const QString &key: categoryMap.keys()) {
+            if (key.isEmpty())
+                continue;
+            SearchCategoryTomTom &cat = categoryMap[key];
+            for (const QString &childKey: categoryMap.value(key).children) {
+                categoryMap[childKey].parent = key;
+                cat.childCategories.append(categoryMap[childKey].category);
+            }
+        }
+        // fill childrenWithSynonyms
+        for (const QString &key: categoryMap.keys()) {
+            if (key.isEmpty())
+                continue;
+            SearchCategoryTomTom &cat = categoryMap[key];
+            if (cat.synonymOf.isEmpty())
+                continue;
+            cat.parent = categoryMap.value(cat.synonymOf).parent;
+            SearchCategoryTomTom &parentCat = categoryMap[cat.parent];
+            parentCat.childrenWithSynonyms.append(key);
+            parentCat.childCategories.append(cat.category);
         }
-    }
-    // fill childrenWithSynonyms
-    for (const QString &key: categoryMap.keys()) {
-        if (key.isEmpty())
-            continue;
-        SearchCategoryTomTom &cat = categoryMap[key];
-        if (cat.synonymOf.isEmpty())
-            continue;
-        cat.parent = categoryMap.value(cat.synonymOf).parent;
-        SearchCategoryTomTom &parentCat = categoryMap[cat.parent];
-        parentCat.childrenWithSynonyms.append(key);
-        parentCat.childCategories.append(cat.category);
-    }
 
-    QList<QPlaceCategory> rootCategoryObjects;
-    for (const QString &key: categoryMap.keys()) {
-        if (key.isEmpty())
-            continue;
-        if (categoryMap.value(key).parent.isEmpty()) {
-            rootCategories.append(key);
-            rootCategoryObjects.append(categoryMap.value(key).category);
+        QList<QPlaceCategory> rootCategoryObjects;
+        for (const QString &key: categoryMap.keys()) {
+            if (key.isEmpty())
+                continue;
+            if (categoryMap.value(key).parent.isEmpty()) {
+                rootCategories.append(key);
+                rootCategoryObjects.append(categoryMap.value(key).category);
+            }
         }
-    }
 
-    // Set the categories into the engine
-    engine->m_rootCategoriesIds = rootCategories;
-    engine->m_rootCategories = rootCategoryObjects;
-    engine->m_categoryMap = categoryMap;
+        QStringList rcn;
+        for (auto c: rootCategories)
+            rcn.append(categoryMap.value(c).category.name());
 
-    // ToDo: cache these
+//        for (const auto &c: rootCategories) {
+//            printCategory(categoryMap.value(c), categoryMap, 0);
+//        }
 
-    QStringList rcn;
-    for (auto c: rootCategories)
-        rcn.append(categoryMap.value(c).category.name());
+        return [this, rootCategories, rootCategoryObjects, categoryMap]() {
+            QPlaceManagerEngineTomTom *engine = qobject_cast<QPlaceManagerEngineTomTom *>(parent());
+            // Set the categories into the engine
+            engine->m_rootCategoriesIds = rootCategories;
+            engine->m_rootCategories = rootCategoryObjects;
+            engine->m_categoryMap = categoryMap;
 
-//    for (const auto &c: rootCategories) {
-//        printCategory(categoryMap.value(c), categoryMap, 0);
-//    }
+            // ToDo: cache these
 
-    qobject_cast<QPlaceManagerEngineTomTom *>(parent())->m_initStatus = QPlaceManagerEngineTomTom::Initialized;
-    setFinished(true);
-    emit finished();
+            qobject_cast<QPlaceManagerEngineTomTom *>(parent())->m_initStatus = QPlaceManagerEngineTomTom::Initialized;
+            setFinished(true);
+            emit finished();
+        };
+    });
 }
 
 void QPlaceCategoriesInitializationReplyTomTom::onFakeFinished()
@@ -26,15 +26,93 @@
 #include <QtCore/QVariantMap>
 #include <QtCore/QByteArray>
 #include <QtCore/QObject>
+#include <QtCore/QMutex>
+#include <QtCore/QRunnable>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QThreadPool>
+#include <QtCore/QUrlQuery>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkReply>
 #include <QtPositioning/QGeoLocation>
 #include <QtPositioning/QGeoCoordinate>
 #include <QtPositioning/QGeoAddress>
+#include <functional>
 
 QT_BEGIN_NAMESPACE
 
+/*
+    The object a background parse reports to. Cleared, on the receiver thread, when the
+    receiver is aborted or destroyed, so that late results are dropped.
+*/
+struct QTomTomParseTarget
+{
+    QMutex mutex;
+    QObject *receiver = nullptr;
+};
+
+class QTomTomParseTask : public QRunnable
+{
+public:
+    QTomTomParseTask(const QSharedPointer<QTomTomParseTarget> &target,
+                     const std::function<std::function<void()>()> &job)
+        : m_target(target), m_job(job) {}
+
+    void run() override
+    {
+        {
+            QMutexLocker locker(&m_target->mutex);
+            if (!m_target->receiver)
+                return;
+        }
+        const std::function<void()> deliver = m_job();
+        const QSharedPointer<QTomTomParseTarget> target = m_target;
+        // Posting under the lock: a receiver destroyed after this point also drops the event.
+        QMutexLocker locker(&m_target->mutex);
+        if (!m_target->receiver)
+            return;
+        QMetaObject::invokeMethod(m_target->receiver, [target, deliver]() {
+            {
+                QMutexLocker locker(&target->mutex);
+                if (!target->receiver)
+                    return;
+            }
+            deliver();
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    QSharedPointer<QTomTomParseTarget> m_target;
+    std::function<std::function<void()>()> m_job;
+};
+
 class QTomTomCommon
 {
 public:
+    static QThreadPool *parserPool()
+    {
+        static QThreadPool pool;
+        return &pool;
+    }
+
+    /*
+        Runs \a job on the parser pool, off the thread of \a reply. The job parses the payload and
+        returns the closure that hands the result over, which is then invoked on the reply thread.
+        If the reply is aborted or destroyed first, the job is skipped or its result dropped.
+    */
+    template <typename Reply>
+    static void parseInBackground(Reply *reply, const std::function<std::function<void()>()> &job)
+    {
+        QSharedPointer<QTomTomParseTarget> target(new QTomTomParseTarget);
+        target->receiver = reply;
+        const auto cancel = [target]() {
+            QMutexLocker locker(&target->mutex);
+            target->receiver = nullptr;
+        };
+        QObject::connect(reply, &Reply::aborted, cancel);
+        QObject::connect(reply, &QObject::destroyed, cancel);
+        parserPool()->start(new QTomTomParseTask(target, job));
+    }
+
     static void parseAddress(QGeoAddress &addr, const QVariantMap &data)
     {
         // text
@@ -70,6 +148,32 @@ public:
                             + data.value(QLatin1String("streetNumber")).toString() ); // Note, the order might be country-dependent.
     }
 
+    /*
+        Asynchronous services (batch, matrix) answer a submission with 202 and the download
+        location, and the download with 202 again until the result is ready. Given such a
+        202 reply, issues the next download request, waiting up to \a waitTimeSeconds on the
+        server. The key of the original request is carried over.
+    */
+    static QNetworkReply *downloadAsyncResult(QNetworkReply *reply, int waitTimeSeconds = 120)
+    {
+        QUrl location = reply->url();
+        const QByteArray header = reply->rawHeader(QByteArrayLiteral("Location"));
+        if (!header.isEmpty())
+            location = reply->url().resolved(QUrl::fromEncoded(header));
+        QUrlQuery query(location);
+        const QUrlQuery submitted(reply->url());
+        if (!query.hasQueryItem(QStringLiteral("key")))
+            query.addQueryItem(QStringLiteral("key"), submitted.queryItemValue(QStringLiteral("key")));
+        query.removeAllQueryItems(QStringLiteral("waitTimeSeconds"));
+        query.addQueryItem(QStringLiteral("waitTimeSeconds"), QString::number(waitTimeSeconds));
+        location.setQuery(query);
+
+        QNetworkRequest request(location);
+        request.setHeader(QNetworkRequest::UserAgentHeader,
+                          reply->request().header(QNetworkRequest::UserAgentHeader));
+        return reply->manager()->get(request);
+    }
+
     inline static QString missingAccessToken()
     {
         return QObject::tr("TomTom plugin requires a 'tomtom.access_token' parameter.\n"
@@ -106,6 +210,9 @@ public:
 
     inline static const QByteArray versionNumberRouting = QByteArrayLiteral("1");
     inline static const QByteArray baseUrlRouting = baseUrl + QByteArrayLiteral("/routing/") + versionNumberRouting + QByteArrayLiteral("/calculateRoute/");
+    inline static const QByteArray baseUrlMatrixRouting = baseUrl + QByteArrayLiteral("/routing/") + versionNumberRouting + QByteArrayLiteral("/matrix/json");
+    inline static const QByteArray baseUrlBatchRouting = baseUrl + QByteArrayLiteral("/routing/") + versionNumberRouting + QByteArrayLiteral("/batch/json");
+    inline static const QByteArray baseUrlReachableRange = baseUrl + QByteArrayLiteral("/routing/") + versionNumberRouting + QByteArrayLiteral("/calculateReachableRange/");
 
     inline static const QByteArray versionNumberPlaces = QByteArrayLiteral("2");
     inline static const QByteArray baseUrlPlaces = baseUrl + QByteArrayLiteral("/search/") + versionNumberPlaces + QByteArrayLiteral("/poiSearch/");
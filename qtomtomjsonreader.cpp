@@ -0,0 +1,331 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#include "qtomtomjsonreader.h"
+#include <QtCore/qnumeric.h>
+#include <cstring>
+
+QT_BEGIN_NAMESPACE
+
+static const double powersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+QTomTomJsonReader::QTomTomJsonReader(const QByteArray &data)
+    : m_data(data),
+      m_begin(m_data.constData()),
+      m_pos(m_begin),
+      m_end(m_begin + m_data.size())
+{
+}
+
+QTomTomJsonReader::Token QTomTomJsonReader::token() const
+{
+    return m_token;
+}
+
+bool QTomTomJsonReader::hasError() const
+{
+    return m_token == Invalid;
+}
+
+QString QTomTomJsonReader::errorString() const
+{
+    return m_errorString;
+}
+
+QTomTomJsonReader::Token QTomTomJsonReader::fail(const char *error)
+{
+    m_errorString = QString::fromLatin1("%1 at offset %2").arg(QLatin1String(error)).arg(m_pos - m_begin);
+    m_pos = m_end;
+    return m_token = Invalid;
+}
+
+void QTomTomJsonReader::valueRead()
+{
+    m_expectName = !m_stack.isEmpty() && m_stack.last() == '{';
+}
+
+QTomTomJsonReader::Token QTomTomJsonReader::next()
+{
+    if (m_token == Invalid)
+        return m_token;
+
+    while (m_pos < m_end) {
+        const char c = *m_pos;
+        if (c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == ',' || c == ':')
+            ++m_pos;
+        else
+            break;
+    }
+    if (m_pos == m_end) {
+        if (!m_stack.isEmpty())
+            return fail("Unexpected end of document");
+        return m_token = EndOfDocument;
+    }
+    m_tokenStart = m_pos;
+
+    switch (*m_pos) {
+    case '{':
+    case '[':
+        if (m_expectName)
+            return fail("Name expected");
+        m_stack.append(*m_pos);
+        m_expectName = *m_pos == '{';
+        ++m_pos;
+        return m_token = m_stack.last() == '{' ? BeginObject : BeginArray;
+    case '}':
+    case ']': {
+        const char open = *m_pos == '}' ? '{' : '[';
+        if (m_stack.isEmpty() || m_stack.last() != open)
+            return fail("Mismatched bracket");
+        m_stack.removeLast();
+        ++m_pos;
+        valueRead();
+        return m_token = open == '{' ? EndObject : EndArray;
+    }
+    case '"':
+        if (!readString())
+            return fail("Unterminated string");
+        if (m_expectName) {
+            m_expectName = false;
+            return m_token = Name;
+        }
+        valueRead();
+        return m_token = String;
+    case 't':
+    case 'f':
+    case 'n': {
+        if (m_expectName)
+            return fail("Name expected");
+        const char *literal = *m_pos == 't' ? "true" : (*m_pos == 'f' ? "false" : "null");
+        const int size = int(std::strlen(literal));
+        if (m_end - m_pos < size || std::memcmp(m_pos, literal, size) != 0)
+            return fail("Invalid literal");
+        m_pos += size;
+        m_bool = *literal == 't';
+        valueRead();
+        return m_token = *literal == 'n' ? Null : Bool;
+    }
+    default:
+        if (m_expectName)
+            return fail("Name expected");
+        if (!readNumber())
+            return fail("Invalid number");
+        valueRead();
+        return m_token = Number;
+    }
+}
+
+bool QTomTomJsonReader::readString()
+{
+    const char *start = ++m_pos;
+    while (m_pos < m_end && *m_pos != '"' && *m_pos != '\\')
+        ++m_pos;
+    if (m_pos == m_end)
+        return false;
+    if (*m_pos == '"') {
+        m_view = start;
+        m_viewSize = int(m_pos - start);
+        ++m_pos;
+        return true;
+    }
+
+    // Slow path, for strings with escapes
+    m_unescaped = QByteArray(start, int(m_pos - start));
+    while (m_pos < m_end && *m_pos != '"') {
+        if (*m_pos != '\\') {
+            m_unescaped += *m_pos++;
+            continue;
+        }
+        if (++m_pos == m_end)
+            return false;
+        const char e = *m_pos++;
+        switch (e) {
+        case 'b': m_unescaped += '\b'; break;
+        case 'f': m_unescaped += '\f'; break;
+        case 'n': m_unescaped += '\n'; break;
+        case 'r': m_unescaped += '\r'; break;
+        case 't': m_unescaped += '\t'; break;
+        case 'u': {
+            auto hex = [this](uint &value) {
+                if (m_end - m_pos < 4)
+                    return false;
+                bool ok = false;
+                value = QByteArray::fromRawData(m_pos, 4).toUInt(&ok, 16);
+                m_pos += 4;
+                return ok;
+            };
+            uint ucs = 0;
+            if (!hex(ucs))
+                return false;
+            if (QChar::isHighSurrogate(ucs) && m_end - m_pos >= 6 && m_pos[0] == '\\' && m_pos[1] == 'u') {
+                m_pos += 2;
+                uint low = 0;
+                if (!hex(low))
+                    return false;
+                ucs = QChar::surrogateToUcs4(ushort(ucs), ushort(low));
+            }
+            m_unescaped += QString::fromUcs4(&ucs, 1).toUtf8();
+            break;
+        }
+        default: // '"', '\\', '/'
+            m_unescaped += e;
+        }
+    }
+    if (m_pos == m_end)
+        return false;
+    ++m_pos;
+    m_view = m_unescaped.constData();
+    m_viewSize = m_unescaped.size();
+    return true;
+}
+
+/*
+    Plain decimals with up to 15 significant digits, the vast majority of the numbers
+    in TomTom replies, are converted exactly with a single division. Anything else goes
+    through QByteArray::toDouble(), which is also locale independent.
+*/
+bool QTomTomJsonReader::readNumber()
+{
+    const char *start = m_pos;
+    bool negative = false;
+    if (*m_pos == '-') {
+        negative = true;
+        ++m_pos;
+    }
+
+    quint64 mantissa = 0;
+    int digits = 0;
+    int decimals = 0;
+    bool fraction = false;
+    bool simple = true;
+    for (; m_pos < m_end; ++m_pos) {
+        const char c = *m_pos;
+        if (c >= '0' && c <= '9') {
+            if (mantissa || c != '0')
+                ++digits;
+            mantissa = mantissa * 10 + quint64(c - '0');
+            if (fraction)
+                ++decimals;
+        } else if (c == '.' && !fraction) {
+            fraction = true;
+        } else if (c == 'e' || c == 'E' || c == '+' || c == '-') {
+            simple = false;
+        } else {
+            break;
+        }
+        if (digits > 15)
+            simple = false;
+    }
+    if (m_pos == start || (negative && m_pos == start + 1))
+        return false;
+
+    if (simple && decimals <= 22) {
+        m_number = double(mantissa) / powersOfTen[decimals];
+        if (negative)
+            m_number = -m_number;
+        return true;
+    }
+
+    bool ok = false;
+    m_number = QByteArray(start, int(m_pos - start)).toDouble(&ok);
+    return ok;
+}
+
+bool QTomTomJsonReader::isName(const char *name) const
+{
+    const int size = int(std::strlen(name));
+    return m_viewSize == size && std::memcmp(m_view, name, size) == 0;
+}
+
+QByteArray QTomTomJsonReader::bytes() const
+{
+    return QByteArray(m_view, m_viewSize);
+}
+
+QString QTomTomJsonReader::string() const
+{
+    return QString::fromUtf8(m_view, m_viewSize);
+}
+
+double QTomTomJsonReader::number() const
+{
+    return m_number;
+}
+
+int QTomTomJsonReader::toInt() const
+{
+    return int(m_number);
+}
+
+bool QTomTomJsonReader::boolean() const
+{
+    return m_bool;
+}
+
+// Skips the value following the current name or array element.
+void QTomTomJsonReader::skipValue()
+{
+    next();
+    skipCurrent();
+}
+
+// If the current token opens an object or an array, skips to its end.
+void QTomTomJsonReader::skipCurrent()
+{
+    if (m_token != BeginObject && m_token != BeginArray)
+        return;
+    int depth = 1;
+    while (depth > 0) {
+        switch (next()) {
+        case BeginObject:
+        case BeginArray:
+            ++depth;
+            break;
+        case EndObject:
+        case EndArray:
+            --depth;
+            break;
+        case EndOfDocument:
+        case Invalid:
+            return;
+        default:
+            break;
+        }
+    }
+}
+
+/*
+    Reads the value following the current name or array element and returns its source text,
+    to be handed over whole to another parser.
+*/
+QByteArray QTomTomJsonReader::rawValue()
+{
+    next();
+    const char *start = m_tokenStart;
+    skipCurrent();
+    if (m_token == Invalid || m_token == EndOfDocument)
+        return QByteArray();
+    return QByteArray(start, int(m_pos - start));
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,97 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#ifndef QTOMTOMJSONREADER_H
+#define QTOMTOMJSONREADER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QVarLengthArray>
+
+QT_BEGIN_NAMESPACE
+
+/*
+    Pull parser for JSON documents, reading one token at a time without building a tree.
+    Names and strings without escapes are not copied, and numbers are parsed independently
+    of the locale. The reader is lenient about separators, but validates nesting.
+*/
+class QTomTomJsonReader
+{
+public:
+    enum Token {
+        NoToken,
+        BeginObject,
+        EndObject,
+        BeginArray,
+        EndArray,
+        Name,
+        String,
+        Number,
+        Bool,
+        Null,
+        EndOfDocument,
+        Invalid
+    };
+
+    explicit QTomTomJsonReader(const QByteArray &data);
+
+    Token next();
+    Token token() const;
+
+    bool isName(const char *name) const;
+    QByteArray bytes() const;
+    QString string() const;
+    double number() const;
+    int toInt() const;
+    bool boolean() const;
+
+    void skipValue();
+    void skipCurrent();
+    QByteArray rawValue();
+
+    bool hasError() const;
+    QString errorString() const;
+
+private:
+    Token fail(const char *error);
+    void valueRead();
+    bool readString();
+    bool readNumber();
+
+    QByteArray m_data;
+    const char *m_begin;
+    const char *m_pos;
+    const char *m_end;
+    const char *m_tokenStart = nullptr;
+    Token m_token = NoToken;
+    QVarLengthArray<char, 32> m_stack;
+    bool m_expectName = false;
+
+    const char *m_view = nullptr;
+    int m_viewSize = 0;
+    QByteArray m_unescaped;
+    double m_number = 0.0;
+    bool m_bool = false;
+    QString m_errorString;
+};
+
+QT_END_NAMESPACE
+
+#endif // QTOMTOMJSONREADER_H
@@ -0,0 +1,413 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#include "qgeoroutingmanagerenginetomtom.h"
+#include "qgeoroutebatchreplytomtom.h"
+#include "routefixture.h"
+#include <QtTest/QtTest>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+#include <functional>
+
+QT_USE_NAMESPACE
+
+/*
+    Stands in for the asynchronous batch routing service: answers requests, in order,
+    with the scripted responses, and leaves them hanging once the script is over.
+*/
+class BatchServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Response
+    {
+        int status;
+        QByteArray body;
+        QByteArray location;
+    };
+    struct Request
+    {
+        QByteArray method;
+        QUrl url;
+        QByteArray body;
+    };
+
+    BatchServer()
+    {
+        connect(&m_server, &QTcpServer::newConnection, this, &BatchServer::onNewConnection);
+    }
+
+    bool listen()
+    {
+        return m_server.listen(QHostAddress::LocalHost);
+    }
+
+    QUrl url(const QString &path) const
+    {
+        return QUrl(QStringLiteral("http://127.0.0.1:%1%2").arg(m_server.serverPort()).arg(path));
+    }
+
+    void respond(int status, const QByteArray &body = QByteArray(), const QByteArray &location = QByteArray())
+    {
+        m_script.append(Response{status, body, location});
+    }
+
+    // Answers every request through handler instead of the script
+    void setHandler(const std::function<Response(const Request &)> &handler)
+    {
+        m_handler = handler;
+    }
+
+    QList<Request> requests;
+
+private Q_SLOTS:
+    void onNewConnection()
+    {
+        while (QTcpSocket *socket = m_server.nextPendingConnection()) {
+            connect(socket, &QTcpSocket::readyRead, this, &BatchServer::onReadyRead);
+            connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        }
+    }
+
+    void onReadyRead()
+    {
+        QTcpSocket *socket = static_cast<QTcpSocket *>(sender());
+        QByteArray &buffer = m_buffers[socket];
+        buffer += socket->readAll();
+
+        const int headerEnd = buffer.indexOf("\r\n\r\n");
+        if (headerEnd < 0)
+            return;
+        const QList<QByteArray> lines = buffer.left(headerEnd).split('\n');
+        int contentLength = 0;
+        for (const QByteArray &line : lines) {
+            if (line.toLower().startsWith("content-length:"))
+                contentLength = line.mid(15).trimmed().toInt();
+        }
+        if (buffer.size() < headerEnd + 4 + contentLength)
+            return;
+
+        const QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+        Request request;
+        request.method = requestLine.value(0);
+        request.url = QUrl::fromEncoded(requestLine.value(1));
+        request.body = buffer.mid(headerEnd + 4, contentLength);
+        requests.append(request);
+        m_buffers.remove(socket);
+
+        if (!m_handler && m_script.isEmpty())
+            return; // left hanging
+        const Response response = m_handler ? m_handler(request) : m_script.takeFirst();
+        QByteArray reply = "HTTP/1.1 " + QByteArray::number(response.status) + ' '
+                + (response.status == 200 ? "OK" : response.status == 202 ? "Accepted" : "Error") + "\r\n";
+        if (!response.location.isEmpty())
+            reply += "Location: " + response.location + "\r\n";
+        reply += "Content-Type: application/json\r\n";
+        reply += "Content-Length: " + QByteArray::number(response.body.size()) + "\r\n";
+        reply += "Connection: close\r\n\r\n";
+        reply += response.body;
+        socket->write(reply);
+        socket->disconnectFromHost();
+    }
+
+private:
+    QTcpServer m_server;
+    QHash<QTcpSocket *, QByteArray> m_buffers;
+    QList<Response> m_script;
+    std::function<Response(const Request &)> m_handler;
+};
+
+// Collects what a batch reply reports, by request index.
+struct BatchRecorder
+{
+    explicit BatchRecorder(QGeoRouteBatchReplyTomTom *reply)
+    {
+        QObject::connect(reply, &QGeoRouteBatchReplyTomTom::routesCalculated, reply,
+                         [this](int index, const QList<QGeoRoute> &routes) {
+            calculated.insert(index, routes);
+        });
+        QObject::connect(reply, &QGeoRouteBatchReplyTomTom::routeError, reply,
+                         [this](int index, QGeoRouteReply::Error error, const QString &errorString) {
+            errors.insert(index, error);
+            errorStrings.insert(index, errorString);
+        });
+        QObject::connect(reply, &QGeoRouteBatchReplyTomTom::finished, reply, [this]() { ++finished; });
+        QObject::connect(reply, &QGeoRouteBatchReplyTomTom::aborted, reply, [this]() { ++aborted; });
+    }
+
+    QMap<int, QList<QGeoRoute>> calculated;
+    QMap<int, QGeoRouteReply::Error> errors;
+    QMap<int, QString> errorStrings;
+    int finished = 0;
+    int aborted = 0;
+};
+
+class tst_batchrouting : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void submitPollDownload();
+    void immediateResult();
+    void splitInBatches();
+    void itemError();
+    void submissionError();
+    void unexpectedStatus();
+    void invalidPayload();
+    void missingItems();
+    void abort();
+    void noRequests();
+
+private:
+    QGeoRoutingManagerEngineTomTom *engine(int batchSize = 100);
+    static QList<QGeoRouteRequest> routeRequests(int count);
+    static QByteArray batchResult(const QList<int> &statusCodes);
+
+    QScopedPointer<BatchServer> m_server;
+    QScopedPointer<QGeoRoutingManagerEngineTomTom> m_engine;
+};
+
+void tst_batchrouting::init()
+{
+    m_server.reset(new BatchServer);
+    QVERIFY(m_server->listen());
+}
+
+void tst_batchrouting::cleanup()
+{
+    m_engine.reset();
+    m_server.reset();
+}
+
+QGeoRoutingManagerEngineTomTom *tst_batchrouting::engine(int batchSize)
+{
+    QVariantMap parameters;
+    parameters.insert(QStringLiteral("tomtom.access_token"), QStringLiteral("test"));
+    parameters.insert(QStringLiteral("tomtom.routing.cache.disk"), QStringLiteral("false"));
+    parameters.insert(QStringLiteral("tomtom.routing.cache.ttl"), 0);
+    parameters.insert(QStringLiteral("tomtom.routing.batch.url"), m_server->url(QStringLiteral("/routing/1/batch/json")));
+    parameters.insert(QStringLiteral("tomtom.routing.batch.size"), batchSize);
+    QGeoServiceProvider::Error error = QGeoServiceProvider::NoError;
+    QString errorString;
+    m_engine.reset(new QGeoRoutingManagerEngineTomTom(parameters, &error, &errorString));
+    return m_engine.data();
+}
+
+QList<QGeoRouteRequest> tst_batchrouting::routeRequests(int count)
+{
+    QList<QGeoRouteRequest> requests;
+    for (int i = 0; i < count; ++i)
+        requests.append(QGeoRouteRequest(QGeoCoordinate(45.0, 7.0 + i * 0.01), QGeoCoordinate(45.1, 7.05)));
+    return requests;
+}
+
+QByteArray tst_batchrouting::batchResult(const QList<int> &statusCodes)
+{
+    QByteArray json = QByteArrayLiteral("{\"formatVersion\":\"0.0.12\",\"batchItems\":[");
+    for (int i = 0; i < statusCodes.size(); ++i) {
+        if (i)
+            json += ',';
+        json += QByteArrayLiteral("{\"statusCode\":") + QByteArray::number(statusCodes.at(i))
+                + QByteArrayLiteral(",\"response\":")
+                + (statusCodes.at(i) == 200 ? routeReplyFixture(100)
+                                            : QByteArrayLiteral("{\"error\":{\"description\":\"Bad request\"}}"))
+                + '}';
+    }
+    json += "]}";
+    return json;
+}
+
+void tst_batchrouting::submitPollDownload()
+{
+    m_server->respond(202, QByteArray(), "/routing/1/batch/download/abc");
+    m_server->respond(202, QByteArray(), "/routing/1/batch/download/abc");
+    m_server->respond(200, batchResult({200, 200}));
+
+    QGeoRouteBatchReplyTomTom *reply = engine()->calculateRoutes(routeRequests(2));
+    const BatchRecorder recorder(reply);
+
+    QTRY_COMPARE(recorder.finished, 1);
+    QCOMPARE(recorder.errors.size(), 0);
+    QCOMPARE(recorder.calculated.size(), 2);
+    QCOMPARE(reply->completedCount(), 2);
+    QVERIFY(reply->isFinished());
+    QList<int> indexes = recorder.calculated.keys();
+    std::sort(indexes.begin(), indexes.end());
+    QCOMPARE(indexes, QList<int>() << 0 << 1);
+    for (const QList<QGeoRoute> &routes : recorder.calculated)
+        QVERIFY(!routes.isEmpty());
+
+    QCOMPARE(m_server->requests.size(), 3);
+    const BatchServer::Request submit = m_server->requests.at(0);
+    QCOMPARE(submit.method, QByteArray("POST"));
+    QCOMPARE(submit.url.path(), QStringLiteral("/routing/1/batch/json"));
+    QCOMPARE(QUrlQuery(submit.url).queryItemValue(QStringLiteral("key")), QStringLiteral("test"));
+    QCOMPARE(submit.body.count("\"query\":"), 2);
+    QVERIFY(!submit.body.contains("key="));
+    for (int i = 1; i < 3; ++i) {
+        const BatchServer::Request download = m_server->requests.at(i);
+        QCOMPARE(download.method, QByteArray("GET"));
+        QCOMPARE(download.url.path(), QStringLiteral("/routing/1/batch/download/abc"));
+        const QUrlQuery query(download.url);
+        QCOMPARE(query.queryItemValue(QStringLiteral("key")), QStringLiteral("test"));
+        QVERIFY(query.hasQueryItem(QStringLiteral("waitTimeSeconds")));
+    }
+}
+
+void tst_batchrouting::immediateResult()
+{
+    m_server->respond(200, batchResult({200}));
+
+    QGeoRouteBatchReplyTomTom *reply = engine()->calculateRoutes(routeRequests(1));
+    const BatchRecorder recorder(reply);
+
+    QTRY_COMPARE(recorder.finished, 1);
+    QCOMPARE(recorder.calculated.size(), 1);
+    QCOMPARE(m_server->requests.size(), 1);
+}
+
+void tst_batchrouting::splitInBatches()
+{
+    // Both batches are submitted at once and may arrive in either order,
+    // so each is answered according to its size.
+    m_server->setHandler([](const BatchServer::Request &request) {
+        QList<int> statusCodes;
+        for (int i = 0; i < request.body.count("\"query\":"); ++i)
+            statusCodes.append(200);
+        return BatchServer::Response{200, batchResult(statusCodes), QByteArray()};
+    });
+
+    QGeoRouteBatchReplyTomTom *reply = engine(2)->calculateRoutes(routeRequests(3));
+    const BatchRecorder recorder(reply);
+
+    QTRY_COMPARE(recorder.finished, 1);
+    QCOMPARE(recorder.errors.size(), 0);
+    QCOMPARE(recorder.calculated.size(), 3);
+    QCOMPARE(m_server->requests.size(), 2);
+    QList<int> sizes;
+    for (const BatchServer::Request &request : qAsConst(m_server->requests))
+        sizes.append(request.body.count("\"query\":"));
+    std::sort(sizes.begin(), sizes.end());
+    QCOMPARE(sizes, QList<int>() << 1 << 2);
+}
+
+void tst_batchrouting::itemError()
+{
+    m_server->respond(200, batchResult({200, 400}));
+
+    QGeoRouteBatchReplyTomTom *reply = engine()->calculateRoutes(routeRequests(2));
+    const BatchRecorder recorder(reply);
+
+    QTRY_COMPARE(recorder.finished, 1);
+    QCOMPARE(recorder.calculated.keys(), QList<int>() << 0);
+    QCOMPARE(recorder.errors.keys(), QList<int>() << 1);
+    QCOMPARE(recorder.errors.value(1), QGeoRouteReply::CommunicationError);
+    QVERIFY(recorder.errorStrings.value(1).contains(QLatin1String("400")));
+}
+
+void tst_batchrouting::submissionError()
+{
+    m_server->respond(500, QByteArrayLiteral("{\"error\":{\"description\":\"Internal error\"}}"));
+
+    QGeoRouteBatchReplyTomTom *reply = engine()->calculateRoutes(routeRequests(2));
+    const BatchRecorder recorder(reply);
+
+    QTRY_COMPARE(recorder.finished, 1);
+    QCOMPARE(recorder.calculated.size(), 0);
+    QCOMPARE(recorder.errors.size(), 2);
+    for (QGeoRouteReply::Error error : recorder.errors)
+        QCOMPARE(error, QGeoRouteReply::CommunicationError);
+}
+
+void tst_batchrouting::unexpectedStatus()
+{
+    m_server->respond(204);
+
+    QGeoRouteBatchReplyTomTom *reply = engine()->calculateRoutes(routeRequests(1));
+    const BatchRecorder recorder(reply);
+
+    QTRY_COMPARE(recorder.finished, 1);
+    QCOMPARE(recorder.errors.size(), 1);
+    QVERIFY(recorder.errorStrings.value(0).contains(QLatin1String("204")));
+}
+
+void tst_batchrouting::invalidPayload()
+{
+    m_server->respond(202, QByteArray(), "/routing/1/batch/download/abc");
+    m_server->respond(200, QByteArrayLiteral("{\"batchItems\":[{\"statusCode\":200,"));
+
+    QGeoRouteBatchReplyTomTom *reply = engine()->calculateRoutes(routeRequests(2));
+    const BatchRecorder recorder(reply);
+
+    QTRY_COMPARE(recorder.finished, 1);
+    QCOMPARE(recorder.errors.size(), 2);
+    for (QGeoRouteReply::Error error : recorder.errors)
+        QCOMPARE(error, QGeoRouteReply::ParseError);
+}
+
+void tst_batchrouting::missingItems()
+{
+    m_server->respond(200, batchResult({200}));
+
+    QGeoRouteBatchReplyTomTom *reply = engine()->calculateRoutes(routeRequests(2));
+    const BatchRecorder recorder(reply);
+
+    QTRY_COMPARE(recorder.finished, 1);
+    QCOMPARE(recorder.calculated.size(), 0);
+    QCOMPARE(recorder.errors.size(), 2);
+    QCOMPARE(recorder.errors.value(0), QGeoRouteReply::ParseError);
+}
+
+void tst_batchrouting::abort()
+{
+    m_server->respond(202, QByteArray(), "/routing/1/batch/download/abc");
+    // The download is left hanging
+
+    QGeoRouteBatchReplyTomTom *reply = engine()->calculateRoutes(routeRequests(2));
+    const BatchRecorder recorder(reply);
+
+    QTRY_COMPARE(m_server->requests.size(), 2);
+    reply->abort();
+    QCOMPARE(recorder.aborted, 1);
+    QVERIFY(reply->isFinished());
+    reply->abort();
+    QCOMPARE(recorder.aborted, 1);
+    QTest::qWait(100);
+    QCOMPARE(recorder.finished, 0);
+    QCOMPARE(recorder.errors.size(), 0);
+}
+
+void tst_batchrouting::noRequests()
+{
+    QGeoRouteBatchReplyTomTom *reply = engine()->calculateRoutes(QList<QGeoRouteRequest>());
+    const BatchRecorder recorder(reply);
+
+    QVERIFY(reply->isFinished());
+    QTRY_COMPARE(recorder.finished, 1);
+    QCOMPARE(m_server->requests.size(), 0);
+}
+
+QTEST_GUILESS_MAIN(tst_batchrouting)
+
+#include "tst_batchrouting.moc"
@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = tst_filetilecache
+CONFIG += testcase console
+CONFIG -= app_bundle
+
+QT += testlib
+
+include(../../plugin.pri)
+
+SOURCES += \
+    tst_filetilecache.cpp
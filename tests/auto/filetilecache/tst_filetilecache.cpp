@@ -0,0 +1,144 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#include "qgeofiletilecachetomtom.h"
+#include "qgeotileevictionpolicytomtom.h"
+#include <QtTest/QtTest>
+#include <QTemporaryDir>
+
+QT_USE_NAMESPACE
+
+// Exposes the tile file names
+class TileCache : public QGeoFileTileCacheTomTom
+{
+public:
+    TileCache(const QString &directory)
+        : QGeoFileTileCacheTomTom(QList<QGeoMapType>(), 1, directory)
+    {
+    }
+    using QGeoFileTileCacheTomTom::tileSpecToFilename;
+};
+
+/*
+    Startup of the disk cache when eviction goes through a policy, which must not evict
+    tiles that fit in the budget, whether given or the default one.
+*/
+class tst_filetilecache : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void defaultBudget_data();
+    void defaultBudget();
+    void explicitBudget();
+
+private:
+    static void writeTiles(const TileCache &cache, const QString &directory, int count);
+    static int countTiles(const QString &directory);
+};
+
+static const int tileCount = 10;
+static const int tileBytes = 1000;
+
+void tst_filetilecache::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+}
+
+void tst_filetilecache::writeTiles(const TileCache &cache, const QString &directory, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const QGeoTileSpec spec(QStringLiteral("tomtom"), 1, 10, i, 0);
+        QFile file(cache.tileSpecToFilename(spec, QStringLiteral("png"), directory));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        QCOMPARE(file.write(QByteArray(tileBytes, 'x')), qint64(tileBytes));
+    }
+}
+
+int tst_filetilecache::countTiles(const QString &directory)
+{
+    return QDir(directory).entryList(QStringList() << QStringLiteral("tomtom-*.png"), QDir::Files).size();
+}
+
+void tst_filetilecache::defaultBudget_data()
+{
+    QTest::addColumn<QString>("policy");
+    QTest::addColumn<bool>("shared");
+    QTest::addColumn<int>("costStrategy");
+
+    QTest::newRow("lru bytesize") << QStringLiteral("lru") << false << int(QAbstractGeoTileCache::ByteSize);
+    QTest::newRow("lfu bytesize") << QStringLiteral("lfu") << false << int(QAbstractGeoTileCache::ByteSize);
+    QTest::newRow("lru unitary") << QStringLiteral("lru") << false << int(QAbstractGeoTileCache::Unitary);
+    // Shared mode installs an LRU policy when none is set
+    QTest::newRow("shared bytesize") << QString() << true << int(QAbstractGeoTileCache::ByteSize);
+    QTest::newRow("shared unitary") << QString() << true << int(QAbstractGeoTileCache::Unitary);
+}
+
+void tst_filetilecache::defaultBudget()
+{
+    QFETCH(QString, policy);
+    QFETCH(bool, shared);
+    QFETCH(int, costStrategy);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    {
+        TileCache cache(dir.path());
+        writeTiles(cache, dir.path(), tileCount);
+        cache.setCostStrategyDisk(QAbstractGeoTileCache::CostStrategy(costStrategy));
+        if (!policy.isEmpty())
+            cache.setEvictionPolicy(QGeoTileEvictionPolicyTomTom::create(policy));
+        cache.setSharedCache(shared);
+        cache.init();
+
+        QCOMPARE(cache.maxDiskUsage(), costStrategy == QAbstractGeoTileCache::ByteSize ? 50 * 1024 * 1024 : 1000);
+        QCOMPARE(countTiles(dir.path()), tileCount);
+    }
+    // And again on the next start
+    {
+        TileCache cache(dir.path());
+        cache.setCostStrategyDisk(QAbstractGeoTileCache::CostStrategy(costStrategy));
+        if (!policy.isEmpty())
+            cache.setEvictionPolicy(QGeoTileEvictionPolicyTomTom::create(policy));
+        cache.setSharedCache(shared);
+        cache.init();
+        QCOMPARE(countTiles(dir.path()), tileCount);
+    }
+}
+
+void tst_filetilecache::explicitBudget()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    TileCache cache(dir.path());
+    writeTiles(cache, dir.path(), tileCount);
+    cache.setCostStrategyDisk(QAbstractGeoTileCache::ByteSize);
+    cache.setEvictionPolicy(QGeoTileEvictionPolicyTomTom::create(QStringLiteral("lru")));
+    cache.setMaxDiskUsage(4 * tileBytes + tileBytes / 2);
+    cache.init();
+
+    QCOMPARE(cache.maxDiskUsage(), 4 * tileBytes + tileBytes / 2);
+    QCOMPARE(countTiles(dir.path()), 4);
+}
+
+QTEST_GUILESS_MAIN(tst_filetilecache)
+
+#include "tst_filetilecache.moc"
@@ -0,0 +1,99 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#include "qgeoroutingmanagerenginetomtom.h"
+#include "routefixture.h"
+#include <QtLocation/private/qgeorouteparser_p.h>
+#include <QtLocation/QGeoRouteSegment>
+#include <QtTest/QtTest>
+
+QT_USE_NAMESPACE
+
+/*
+    Parses routes of growing size with dense instructions, so that matching instructions
+    to the geometry dominates, up to 100k points. The time per point is reported next to
+    the QBENCHMARK result: it stays flat when matching is linear.
+*/
+class tst_bench_routematching : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void match_data();
+    void match();
+
+private:
+    QScopedPointer<QGeoRoutingManagerEngineTomTom> m_engine;
+};
+
+void tst_bench_routematching::initTestCase()
+{
+    QVariantMap parameters;
+    parameters.insert(QStringLiteral("tomtom.access_token"), QStringLiteral("benchmark"));
+    parameters.insert(QStringLiteral("tomtom.routing.cache.disk"), QStringLiteral("false"));
+    parameters.insert(QStringLiteral("tomtom.routing.cache.ttl"), 0);
+    QGeoServiceProvider::Error error = QGeoServiceProvider::NoError;
+    QString errorString;
+    m_engine.reset(new QGeoRoutingManagerEngineTomTom(parameters, &error, &errorString));
+    QCOMPARE(error, QGeoServiceProvider::NoError);
+}
+
+void tst_bench_routematching::match_data()
+{
+    QTest::addColumn<int>("points");
+    QTest::addColumn<QByteArray>("json");
+
+    for (int points : { 1000, 10000, 25000, 50000, 100000 }) {
+        QTest::newRow(qPrintable(QStringLiteral("%1 points").arg(points)))
+                << points << routeReplyFixture(points, 0, 3, 5);
+    }
+}
+
+void tst_bench_routematching::match()
+{
+    QFETCH(int, points);
+    QFETCH(QByteArray, json);
+    const QGeoRouteParser *parser = m_engine->routeParser();
+    const QGeoRouteRequest request(QGeoCoordinate(45.0, 7.0), QGeoCoordinate(46.0, 8.0));
+
+    QList<QGeoRoute> routes;
+    QString errorString;
+    QElapsedTimer timer;
+    timer.start();
+    QCOMPARE(parser->parseReply(routes, errorString, json, request), QGeoRouteReply::NoError);
+    const qint64 elapsed = timer.nsecsElapsed();
+    QCOMPARE(routes.size(), 1);
+
+    int segments = 0;
+    for (QGeoRouteSegment s = routes.first().firstRouteSegment(); s.isValid(); s = s.nextRouteSegment())
+        ++segments;
+    QVERIFY(segments >= points / 10); // one per instruction, every 5 points
+    qInfo() << segments << "segments," << elapsed / points << "ns per point";
+
+    QBENCHMARK {
+        QList<QGeoRoute> routes;
+        parser->parseReply(routes, errorString, json, request);
+    }
+}
+
+QTEST_GUILESS_MAIN(tst_bench_routematching)
+
+#include "tst_bench_routematching.moc"
@@ -0,0 +1,15 @@
+TEMPLATE = app
+TARGET = tst_bench_routeparser
+CONFIG += benchmark console
+CONFIG -= app_bundle
+
+QT += testlib
+
+include(../../plugin.pri)
+INCLUDEPATH += $$PWD/../../shared
+
+HEADERS += \
+    ../../shared/routefixture.h
+
+SOURCES += \
+    tst_bench_routeparser.cpp
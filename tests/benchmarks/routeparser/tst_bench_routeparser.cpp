@@ -0,0 +1,127 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#include "qgeoroutingmanagerenginetomtom.h"
+#include "routefixture.h"
+#include <QtLocation/private/qgeorouteparser_p.h>
+#include <QtTest/QtTest>
+#include <QJsonDocument>
+
+QT_USE_NAMESPACE
+
+/*
+    Compares the streaming route parser with building the JSON tree the previous parser
+    started from, on long routes with alternatives. Reports parse time, through QBENCHMARK,
+    and the peak memory growth of one parse. Recorded replies can be added through the
+    TOMTOM_ROUTE_FIXTURES environment variable, naming a directory of *.json files.
+*/
+class tst_bench_routeparser : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void streaming_data();
+    void streaming();
+    void document_data();
+    void document();
+
+private:
+    void fixtures();
+
+    QScopedPointer<QGeoRoutingManagerEngineTomTom> m_engine;
+};
+
+void tst_bench_routeparser::initTestCase()
+{
+    QVariantMap parameters;
+    parameters.insert(QStringLiteral("tomtom.access_token"), QStringLiteral("benchmark"));
+    parameters.insert(QStringLiteral("tomtom.routing.cache.disk"), QStringLiteral("false"));
+    parameters.insert(QStringLiteral("tomtom.routing.cache.ttl"), 0);
+    QGeoServiceProvider::Error error = QGeoServiceProvider::NoError;
+    QString errorString;
+    m_engine.reset(new QGeoRoutingManagerEngineTomTom(parameters, &error, &errorString));
+    QCOMPARE(error, QGeoServiceProvider::NoError);
+}
+
+void tst_bench_routeparser::fixtures()
+{
+    QTest::addColumn<QByteArray>("json");
+
+    QTest::newRow("1k points, 2 alternatives") << routeReplyFixture(1000, 2);
+    QTest::newRow("10k points, 2 alternatives") << routeReplyFixture(10000, 2);
+    QTest::newRow("100k points, 2 alternatives") << routeReplyFixture(100000, 2);
+    QTest::newRow("100k points, 5 legs") << routeReplyFixture(100000, 0, 5);
+    for (const auto &fixture : recordedFixtures("TOMTOM_ROUTE_FIXTURES"))
+        QTest::newRow(qPrintable(fixture.first)) << fixture.second;
+}
+
+void tst_bench_routeparser::streaming_data()
+{
+    fixtures();
+}
+
+void tst_bench_routeparser::streaming()
+{
+    QFETCH(QByteArray, json);
+    const QGeoRouteParser *parser = m_engine->routeParser();
+    QGeoRouteRequest request(QGeoCoordinate(45.0, 7.0), QGeoCoordinate(46.0, 8.0));
+    request.setNumberAlternativeRoutes(5);
+
+    const qint64 peak = peakMemoryGrowthKb([&]() {
+        QList<QGeoRoute> routes;
+        QString errorString;
+        QCOMPARE(parser->parseReply(routes, errorString, json, request), QGeoRouteReply::NoError);
+        QVERIFY(!routes.isEmpty());
+    });
+    qInfo() << "input" << json.size() / 1024 << "KB, peak memory growth" << peak << "KB";
+
+    QBENCHMARK {
+        QList<QGeoRoute> routes;
+        QString errorString;
+        parser->parseReply(routes, errorString, json, request);
+    }
+}
+
+void tst_bench_routeparser::document_data()
+{
+    fixtures();
+}
+
+// The QJsonDocument and QVariant trees the previous parser built before reading anything
+void tst_bench_routeparser::document()
+{
+    QFETCH(QByteArray, json);
+
+    const qint64 peak = peakMemoryGrowthKb([&]() {
+        const QVariant tree = QJsonDocument::fromJson(json).toVariant();
+        QVERIFY(tree.isValid());
+    });
+    qInfo() << "input" << json.size() / 1024 << "KB, peak memory growth" << peak << "KB";
+
+    QBENCHMARK {
+        const QVariant tree = QJsonDocument::fromJson(json).toVariant();
+        Q_UNUSED(tree);
+    }
+}
+
+QTEST_GUILESS_MAIN(tst_bench_routeparser)
+
+#include "tst_bench_routeparser.moc"
@@ -0,0 +1,16 @@
+TEMPLATE = app
+TARGET = tst_bench_tilereplay
+CONFIG += benchmark console
+CONFIG -= app_bundle
+
+QT += testlib location-private positioning-private
+
+PLUGIN_DIR = $$PWD/../../..
+INCLUDEPATH += $$PLUGIN_DIR
+
+HEADERS += \
+    $$PLUGIN_DIR/qgeotileevictionpolicytomtom.h
+
+SOURCES += \
+    tst_bench_tilereplay.cpp \
+    $$PLUGIN_DIR/qgeotileevictionpolicytomtom.cpp
@@ -0,0 +1,190 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#include "qgeotileevictionpolicytomtom.h"
+#include <QtTest/QtTest>
+#include <QFile>
+#include <QRandomGenerator>
+#include <QScopedPointer>
+
+QT_USE_NAMESPACE
+
+/*
+    Replays tile access traces against the disk eviction policies and reports the hit
+    rate of each, under a few disk budgets. A recorded trace can be passed through the
+    TOMTOM_TILE_TRACE environment variable, one access per line as
+    "mapId zoom x y bytes". Without it, a synthetic trace is used: sessions that open
+    on overview tiles around a few places and then pan at high zoom levels.
+*/
+class tst_bench_tilereplay : public QObject
+{
+    Q_OBJECT
+
+    struct Access
+    {
+        QGeoTileSpec spec;
+        int bytes;
+    };
+
+private Q_SLOTS:
+    void initTestCase();
+    void replay_data();
+    void replay();
+
+private:
+    static QVector<Access> loadTrace(const QString &path);
+    static QVector<Access> syntheticTrace();
+
+    QVector<Access> m_trace;
+};
+
+static const char plugin[] = "tomtom";
+
+QVector<tst_bench_tilereplay::Access> tst_bench_tilereplay::loadTrace(const QString &path)
+{
+    QVector<Access> trace;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return trace;
+    while (!file.atEnd()) {
+        const QList<QByteArray> fields = file.readLine().simplified().split(' ');
+        if (fields.size() != 5)
+            continue;
+        Access a;
+        a.spec = QGeoTileSpec(QLatin1String(plugin), fields.at(0).toInt(), fields.at(1).toInt(),
+                              fields.at(2).toInt(), fields.at(3).toInt());
+        a.bytes = fields.at(4).toInt();
+        trace.append(a);
+    }
+    return trace;
+}
+
+QVector<tst_bench_tilereplay::Access> tst_bench_tilereplay::syntheticTrace()
+{
+    static const int sessions = 200;
+    static const int places = 6;
+    QRandomGenerator random(2024);
+    QVector<Access> trace;
+
+    auto access = [&trace](int mapId, int zoom, int x, int y) {
+        Access a;
+        a.spec = QGeoTileSpec(QLatin1String(plugin), mapId, zoom, x, y);
+        // Deterministic per tile, so that revisits cost the same
+        a.bytes = 8 * 1024 + int(qHash(a.spec) % (32 * 1024));
+        trace.append(a);
+    };
+
+    for (int s = 0; s < sessions; ++s) {
+        const int mapId = 1 + random.bounded(2);
+        const int place = random.bounded(places);
+        // Places spread over the world, in tiles at zoom 17
+        const int px = (place * 21841 + 5003) % (1 << 17);
+        const int py = (place * 13007 + 40009) % (1 << 17);
+
+        // Overview: the viewport around the place, zooming in
+        for (int zoom = 3; zoom <= 10; ++zoom) {
+            const int cx = px >> (17 - zoom);
+            const int cy = py >> (17 - zoom);
+            for (int dy = -1; dy <= 1; ++dy)
+                for (int dx = -2; dx <= 2; ++dx)
+                    access(mapId, zoom, qMax(0, cx + dx), qMax(0, cy + dy));
+        }
+
+        // A long pan at high zoom, in a random direction
+        const int zoom = 15 + random.bounded(3);
+        const int steps = 100 + random.bounded(300);
+        const int stepX = random.bounded(3) - 1;
+        const int stepY = stepX ? random.bounded(3) - 1 : (random.bounded(2) ? 1 : -1);
+        int cx = px >> (17 - zoom);
+        int cy = py >> (17 - zoom);
+        for (int i = 0; i < steps; ++i) {
+            cx += stepX;
+            cy += stepY;
+            for (int dy = -1; dy <= 1; ++dy)
+                for (int dx = -2; dx <= 2; ++dx)
+                    access(mapId, zoom, qMax(0, cx + dx), qMax(0, cy + dy));
+        }
+    }
+    return trace;
+}
+
+void tst_bench_tilereplay::initTestCase()
+{
+    const QString path = qEnvironmentVariable("TOMTOM_TILE_TRACE");
+    if (!path.isEmpty()) {
+        m_trace = loadTrace(path);
+        QVERIFY2(!m_trace.isEmpty(), qPrintable(QStringLiteral("empty or unreadable trace ") + path));
+    } else {
+        m_trace = syntheticTrace();
+    }
+    qInfo() << "Replaying" << m_trace.size() << "tile accesses";
+}
+
+void tst_bench_tilereplay::replay_data()
+{
+    QTest::addColumn<QString>("policy");
+    QTest::addColumn<qint64>("budget");
+
+    const QStringList policies = { QStringLiteral("lru"), QStringLiteral("lfu") };
+    const QList<qint64> budgets = { 4 * 1024 * 1024, 16 * 1024 * 1024, 64 * 1024 * 1024 };
+    for (const QString &policy : policies) {
+        for (qint64 budget : budgets) {
+            QTest::newRow(qPrintable(QStringLiteral("%1 %2MB").arg(policy).arg(budget / (1024 * 1024))))
+                    << policy << budget;
+        }
+    }
+}
+
+void tst_bench_tilereplay::replay()
+{
+    QFETCH(QString, policy);
+    QFETCH(qint64, budget);
+
+    quint64 hits = 0;
+    quint64 lowZoomHits = 0;
+    quint64 lowZoomAccesses = 0;
+    QBENCHMARK_ONCE {
+        QScopedPointer<QGeoTileEvictionPolicyTomTom> p(QGeoTileEvictionPolicyTomTom::create(policy));
+        QVERIFY(p);
+        hits = lowZoomHits = lowZoomAccesses = 0;
+        for (const Access &a : qAsConst(m_trace)) {
+            const bool lowZoom = a.spec.zoom() <= 10;
+            lowZoomAccesses += lowZoom;
+            if (p->contains(a.spec)) {
+                p->touch(a.spec);
+                ++hits;
+                lowZoomHits += lowZoom;
+                continue;
+            }
+            p->insert(a.spec, a.bytes);
+            while (p->count() && p->totalCost() > budget)
+                p->takeVictim();
+        }
+    }
+
+    qInfo().noquote() << QString::fromLatin1("%1 %2MB: hit rate %3%, zoom <= 10 hit rate %4%")
+                         .arg(policy).arg(budget / (1024 * 1024))
+                         .arg(100.0 * hits / qMax(1, m_trace.size()), 0, 'f', 1)
+                         .arg(100.0 * lowZoomHits / qMax<quint64>(1, lowZoomAccesses), 0, 'f', 1);
+}
+
+QTEST_APPLESS_MAIN(tst_bench_tilereplay)
+
+#include "tst_bench_tilereplay.moc"
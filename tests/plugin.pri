@@ -0,0 +1,49 @@
+# The plugin sources, built into the benchmarks and tests instead of loading the plugin.
+# Keep in sync with tomtom.pro, minus the plugin factory.
+PLUGIN_DIR = $$PWD/..
+INCLUDEPATH += $$PLUGIN_DIR
+
+QT += location-private positioning-private network
+
+qtConfig(location-labs-plugin): DEFINES += LOCATIONLABS
+
+HEADERS += \
+    $$PLUGIN_DIR/qgeocodingmanagerenginetomtom.h \
+    $$PLUGIN_DIR/qgeoroutingmanagerenginetomtom.h \
+    $$PLUGIN_DIR/qgeotilefetchertomtom.h \
+    $$PLUGIN_DIR/qgeomapreplytomtom.h \
+    $$PLUGIN_DIR/qgeofiletilecachetomtom.h \
+    $$PLUGIN_DIR/qgeotileevictionpolicytomtom.h \
+    $$PLUGIN_DIR/qgeotilearchivetomtom.h \
+    $$PLUGIN_DIR/qgeotiledmaptomtom.h \
+    $$PLUGIN_DIR/qgeoroutereplytomtom.h \
+    $$PLUGIN_DIR/qgeoroutetomtom.h \
+    $$PLUGIN_DIR/qgeoroutecachetomtom.h \
+    $$PLUGIN_DIR/qgeoroutebatchreplytomtom.h \
+    $$PLUGIN_DIR/qgeoroutematrixtomtom.h \
+    $$PLUGIN_DIR/qgeoreachablerangereplytomtom.h \
+    $$PLUGIN_DIR/qgeotiledmappingmanagerenginetomtom.h \
+    $$PLUGIN_DIR/qgeocodereplytomtom.h \
+    $$PLUGIN_DIR/qplacemanagerenginetomtom.h \
+    $$PLUGIN_DIR/qtomtomcommon.h \
+    $$PLUGIN_DIR/qtomtomjsonreader.h
+
+SOURCES += \
+    $$PLUGIN_DIR/qgeocodingmanagerenginetomtom.cpp \
+    $$PLUGIN_DIR/qgeoroutingmanagerenginetomtom.cpp \
+    $$PLUGIN_DIR/qgeotilefetchertomtom.cpp \
+    $$PLUGIN_DIR/qgeomapreplytomtom.cpp \
+    $$PLUGIN_DIR/qgeofiletilecachetomtom.cpp \
+    $$PLUGIN_DIR/qgeotileevictionpolicytomtom.cpp \
+    $$PLUGIN_DIR/qgeotilearchivetomtom.cpp \
+    $$PLUGIN_DIR/qgeotiledmaptomtom.cpp \
+    $$PLUGIN_DIR/qgeoroutereplytomtom.cpp \
+    $$PLUGIN_DIR/qgeoroutetomtom.cpp \
+    $$PLUGIN_DIR/qgeoroutecachetomtom.cpp \
+    $$PLUGIN_DIR/qgeoroutebatchreplytomtom.cpp \
+    $$PLUGIN_DIR/qgeoroutematrixtomtom.cpp \
+    $$PLUGIN_DIR/qgeoreachablerangereplytomtom.cpp \
+    $$PLUGIN_DIR/qgeotiledmappingmanagerenginetomtom.cpp \
+    $$PLUGIN_DIR/qgeocodereplytomtom.cpp \
+    $$PLUGIN_DIR/qplacemanagerenginetomtom.cpp \
+    $$PLUGIN_DIR/qtomtomjsonreader.cpp
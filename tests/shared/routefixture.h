@@ -0,0 +1,163 @@
+/****************************************************************************
+**
+** Copyright (C) 2024- Paolo Angelelli <paoletto@gmail.com>
+**
+** Commercial License Usage
+** Licensees holding a valid commercial qdemviewer license may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement with the copyright holder. For licensing terms
+** and conditions and further information contact the copyright holder.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3. The licenses are as published by
+** the Free Software Foundation at https://www.gnu.org/licenses/gpl-3.0.html,
+** with the exception that the use of this work for training artificial intelligence
+** is prohibited for both commercial and non-commercial use.
+**
+****************************************************************************/
+
+#ifndef ROUTEFIXTURE_H
+#define ROUTEFIXTURE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QPair>
+#include <QtCore/QVector>
+
+QT_BEGIN_NAMESPACE
+
+/*
+    Builds a calculateRoute reply shaped like those of the TomTom routing service: routes
+    of the given number of points, split in legs, with an instruction every
+    instructionEvery points. Alternatives share their first and last thirds with the main
+    route, and detour in between.
+*/
+inline QByteArray routeReplyFixture(int points, int alternatives = 0, int legs = 1, int instructionEvery = 25)
+{
+    auto coordinate = [](double latitude, double longitude) {
+        return QByteArrayLiteral("{\"latitude\":") + QByteArray::number(latitude, 'f', 5)
+                + QByteArrayLiteral(",\"longitude\":") + QByteArray::number(longitude, 'f', 5) + '}';
+    };
+    auto summary = [](int points) {
+        return QByteArrayLiteral("{\"lengthInMeters\":") + QByteArray::number(points * 12)
+                + QByteArrayLiteral(",\"travelTimeInSeconds\":") + QByteArray::number(points) + '}';
+    };
+
+    QByteArray json = QByteArrayLiteral("{\"formatVersion\":\"0.0.12\",\"routes\":[");
+    json.reserve(points * (alternatives + 1) * 48);
+    for (int r = 0; r <= alternatives; ++r) {
+        QVector<QByteArray> path;
+        path.reserve(points);
+        for (int i = 0; i < points; ++i) {
+            const bool detour = r > 0 && i > points / 3 && i < 2 * points / 3;
+            path.append(coordinate(45.0 + i * 1e-4, 7.0 + i * 5e-5 + (detour ? r * 1e-3 : 0.0)));
+        }
+
+        if (r)
+            json += ',';
+        json += QByteArrayLiteral("{\"summary\":") + summary(points) + QByteArrayLiteral(",\"legs\":[");
+        const int legSize = (points + legs - 1) / legs;
+        for (int l = 0; l < legs; ++l) {
+            const int first = l * legSize;
+            const int last = qMin(points, first + legSize);
+            if (l)
+                json += ',';
+            json += QByteArrayLiteral("{\"summary\":") + summary(last - first) + QByteArrayLiteral(",\"points\":[");
+            for (int i = first; i < last; ++i) {
+                if (i > first)
+                    json += ',';
+                json += path.at(i);
+            }
+            json += "]}";
+        }
+        json += QByteArrayLiteral("],\"guidance\":{\"instructions\":[");
+        for (int i = 0; i < points; i += instructionEvery) {
+            const int index = qMin(i, points - 1);
+            const bool depart = i == 0;
+            const bool arrive = i + instructionEvery >= points;
+            if (i)
+                json += ',';
+            json += QByteArrayLiteral("{\"routeOffsetInMeters\":") + QByteArray::number(index * 12)
+                    + QByteArrayLiteral(",\"travelTimeInSeconds\":") + QByteArray::number(index)
+                    + QByteArrayLiteral(",\"point\":") + path.at(index)
+                    + QByteArrayLiteral(",\"instructionType\":\"TURN\",\"drivingSide\":\"RIGHT\",\"maneuver\":\"")
+                    + (depart ? "DEPART" : (i / instructionEvery) % 2 ? "TURN_LEFT" : "TURN_RIGHT")
+                    + QByteArrayLiteral("\",\"message\":\"Turn onto Via Roma\"}");
+            if (arrive && index != points - 1) {
+                json += QByteArrayLiteral(",{\"routeOffsetInMeters\":") + QByteArray::number(points * 12)
+                        + QByteArrayLiteral(",\"travelTimeInSeconds\":") + QByteArray::number(points)
+                        + QByteArrayLiteral(",\"point\":") + path.last()
+                        + QByteArrayLiteral(",\"instructionType\":\"LOCATION_ARRIVAL\",\"drivingSide\":\"RIGHT\","
+                                            "\"maneuver\":\"ARRIVE\",\"message\":\"You have arrived\"}");
+            }
+        }
+        json += "]}}";
+    }
+    json += "]}";
+    return json;
+}
+
+/*
+    Recorded replies, the *.json files of the directory named by the given environment
+    variable, keyed by file name.
+*/
+inline QVector<QPair<QString, QByteArray>> recordedFixtures(const char *variable)
+{
+    QVector<QPair<QString, QByteArray>> fixtures;
+    const QString path = qEnvironmentVariable(variable);
+    if (path.isEmpty())
+        return fixtures;
+    const QDir dir(path);
+    for (const QString &name : dir.entryList(QStringList() << QStringLiteral("*.json"), QDir::Files)) {
+        QFile file(dir.filePath(name));
+        if (file.open(QIODevice::ReadOnly))
+            fixtures.append(qMakePair(name, file.readAll()));
+    }
+    return fixtures;
+}
+
+#ifdef Q_OS_LINUX
+inline qint64 procStatusKb(const char *field)
+{
+    QFile status(QStringLiteral("/proc/self/status"));
+    if (!status.open(QIODevice::ReadOnly))
+        return -1;
+    const QByteArray prefix = QByteArray(field) + ':';
+    while (!status.atEnd()) {
+        const QByteArray line = status.readLine();
+        if (line.startsWith(prefix))
+            return line.mid(prefix.size()).simplified().split(' ').first().toLongLong();
+    }
+    return -1;
+}
+#endif
+
+/*
+    Runs f and returns how much the peak resident memory grew meanwhile, in KB, or -1
+    where that cannot be measured.
+*/
+template <typename F>
+qint64 peakMemoryGrowthKb(F f)
+{
+#ifdef Q_OS_LINUX
+    QFile clearRefs(QStringLiteral("/proc/self/clear_refs"));
+    if (clearRefs.open(QIODevice::WriteOnly)) { // resets VmHWM to the current VmRSS
+        clearRefs.write("5");
+        clearRefs.close();
+    }
+    const qint64 before = procStatusKb("VmRSS");
+    f();
+    const qint64 peak = procStatusKb("VmHWM");
+    return (before < 0 || peak < 0) ? -1 : qMax<qint64>(0, peak - before);
+#else
+    f();
+    return -1;
+#endif
+}
+
+QT_END_NAMESPACE
+
+#endif // ROUTEFIXTURE_H
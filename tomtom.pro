@@ -13,12 +13,20 @@ HEADERS += \
     qgeotilefetchertomtom.h \
     qgeomapreplytomtom.h \
     qgeofiletilecachetomtom.h \
+    qgeotileevictionpolicytomtom.h \
+    qgeotilearchivetomtom.h \
     qgeotiledmaptomtom.h \
     qgeoroutereplytomtom.h \
+    qgeoroutetomtom.h \
+    qgeoroutecachetomtom.h \
+    qgeoroutebatchreplytomtom.h \
+    qgeoroutematrixtomtom.h \
+    qgeoreachablerangereplytomtom.h \
     qgeotiledmappingmanagerenginetomtom.h \
     qgeocodereplytomtom.h \
     qplacemanagerenginetomtom.h \
-    qtomtomcommon.h
+    qtomtomcommon.h \
+    qtomtomjsonreader.h
 
 SOURCES += \
     qgeocodingmanagerenginetomtom.cpp \
@@ -27,11 +35,19 @@ SOURCES += \
     qgeotilefetchertomtom.cpp \
     qgeomapreplytomtom.cpp \
     qgeofiletilecachetomtom.cpp \
+    qgeotileevictionpolicytomtom.cpp \
+    qgeotilearchivetomtom.cpp \
     qgeotiledmaptomtom.cpp \
     qgeoroutereplytomtom.cpp \
+    qgeoroutetomtom.cpp \
+    qgeoroutecachetomtom.cpp \
+    qgeoroutebatchreplytomtom.cpp \
+    qgeoroutematrixtomtom.cpp \
+    qgeoreachablerangereplytomtom.cpp \
     qgeotiledmappingmanagerenginetomtom.cpp \
     qgeocodereplytomtom.cpp \
     qplacemanagerenginetomtom.cpp \
+    qtomtomjsonreader.cpp \
 
 OTHER_FILES += \
     tomtom_plugin.json \